@@ -0,0 +1,153 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "util.h"
+#include "validation.h"
+
+#include <list>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <boost/thread/mutex.hpp>
+
+class CMappedBlockFile
+{
+public:
+    const unsigned char* data;
+    size_t size;
+
+    CMappedBlockFile(const unsigned char* dataIn, size_t sizeIn) : data(dataIn), size(sizeIn) {}
+    ~CMappedBlockFile()
+    {
+#ifndef WIN32
+        munmap((void*)data, size);
+#endif
+    }
+};
+
+typedef std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile> > > MappedFileList;
+
+/** Recently used block files first */
+static MappedFileList listMappedFiles;
+static boost::mutex csMappedFiles;
+
+/**
+ * Return a mapping of block file nFile that covers its first nMinSize bytes.
+ * Block files are appended to, so a mapping that is too short is replaced by
+ * one of the current file size.
+ */
+static std::shared_ptr<const CMappedBlockFile> GetMappedFile(int nFile, size_t nMinSize)
+{
+#ifdef WIN32
+    return NULL;
+#else
+    // A few mapped block files would exhaust a 32-bit address space.
+    if (sizeof(void*) < 8)
+        return NULL;
+
+    boost::mutex::scoped_lock lock(csMappedFiles);
+    for (MappedFileList::iterator it = listMappedFiles.begin(); it != listMappedFiles.end(); it++) {
+        if (it->first != nFile)
+            continue;
+        std::shared_ptr<const CMappedBlockFile> file = it->second;
+        listMappedFiles.erase(it);
+        if (file->size < nMinSize)
+            break;
+        listMappedFiles.push_front(std::make_pair(nFile, file));
+        return file;
+    }
+
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (size_t)st.st_size >= nMinSize)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrint("net", "%s: cannot map %s\n", __func__, path.string());
+        return NULL;
+    }
+
+    std::shared_ptr<const CMappedBlockFile> file = std::make_shared<const CMappedBlockFile>((const unsigned char*)data, st.st_size);
+    listMappedFiles.push_front(std::make_pair(nFile, file));
+    if (listMappedFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        listMappedFiles.pop_back();
+    return file;
+#endif
+}
+
+bool MapBlockFromDisk(CMappedData& data, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (pos.IsNull() || pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return false;
+    std::shared_ptr<const CMappedBlockFile> file = GetMappedFile(pos.nFile, pos.nPos);
+    if (!file)
+        return false;
+
+    // WriteBlockToDisk stores the network magic and the block size in front of the block
+    const unsigned char* pheader = file->data + pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int);
+    unsigned int nSize;
+    memcpy(&nSize, pheader + MESSAGE_START_SIZE, sizeof(nSize));
+    nSize = le32toh(nSize);
+    if (memcmp(pheader, messageStart, MESSAGE_START_SIZE) != 0 || nSize > MAX_SIZE)
+        return error("%s: invalid block header at %s", __func__, pos.ToString());
+    if (file->size < (size_t)pos.nPos + nSize) {
+        file = GetMappedFile(pos.nFile, (size_t)pos.nPos + nSize);
+        if (!file)
+            return false;
+    }
+
+    data.pbegin = file->data + pos.nPos;
+    data.nSize = nSize;
+    data.file = file;
+    return true;
+}
+
+bool MapBlockFromDisk(CMappedData& data, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!MapBlockFromDisk(data, pindex->GetBlockPos(), messageStart))
+        return false;
+
+    CBlockHeader header;
+    try {
+        CMemoryReader reader = data.GetReader(SER_DISK, CLIENT_VERSION);
+        reader >> header;
+    } catch (const std::exception& e) {
+        return error("%s: cannot read block header at %s", __func__, pindex->GetBlockPos().ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s: block hash mismatch at %s", __func__, pindex->GetBlockPos().ToString());
+    return true;
+}
+
+bool MapBlockFileAt(CMappedData& data, const CDiskBlockPos& pos)
+{
+    // The size stored in front of the block keeps readers from running into the next one
+    return MapBlockFromDisk(data, pos, Params().MessageStart());
+}
+
+void UnmapBlockFile(int nFile)
+{
+    boost::mutex::scoped_lock lock(csMappedFiles);
+    for (MappedFileList::iterator it = listMappedFiles.begin(); it != listMappedFiles.end(); it++) {
+        if (it->first == nFile) {
+            listMappedFiles.erase(it);
+            return;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DYNAMIC_BLOCKFILEMAP_H
+#define DYNAMIC_BLOCKFILEMAP_H
+
+#include "protocol.h"
+#include "streams.h"
+
+#include <memory>
+
+class CBlockIndex;
+struct CDiskBlockPos;
+
+/** Number of block files kept mapped at once */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 8;
+
+/** A blk?????.dat file mapped read-only into memory */
+class CMappedBlockFile;
+
+/**
+ * Bytes of a memory-mapped block file. The mapping stays valid as long as
+ * this object lives, also when the file is evicted from the map or pruned.
+ */
+class CMappedData
+{
+public:
+    CMappedData() : pbegin(NULL), nSize(0) {}
+
+    bool IsNull() const { return pbegin == NULL; }
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+
+    CMemoryReader GetReader(int nType, int nVersion) const
+    {
+        return CMemoryReader((const char*)begin(), (const char*)end(), nType, nVersion);
+    }
+
+    // Serializes to the raw bytes, so a stored block can be sent as it is
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return nSize;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s.write((const char*)pbegin, nSize);
+    }
+
+private:
+    std::shared_ptr<const CMappedBlockFile> file;
+    const unsigned char* pbegin;
+    size_t nSize;
+
+    friend bool MapBlockFromDisk(CMappedData& data, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+    friend bool MapBlockFileAt(CMappedData& data, const CDiskBlockPos& pos);
+};
+
+/**
+ * Map the serialized block stored at pos, after checking the network magic
+ * and size written in front of it. Returns false if the block file cannot be
+ * mapped, callers then read it with OpenBlockFile instead.
+ */
+bool MapBlockFromDisk(CMappedData& data, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+
+/** Map the block of pindex, checking that the stored header hashes to the block hash */
+bool MapBlockFromDisk(CMappedData& data, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+
+/** Map the block stored at pos up to its stored size, e.g. to read a transaction located by the txindex */
+bool MapBlockFileAt(CMappedData& data, const CDiskBlockPos& pos);
+
+/** Drop the mapping of a block file, e.g. because it was pruned */
+void UnmapBlockFile(int nFile);
+
+#endif // DYNAMIC_BLOCKFILEMAP_H
@@ -10,6 +10,7 @@
 #include "memusage.h"
 #include "random.h"
 
+#include <algorithm>
 #include <assert.h>
 
 /**
@@ -48,6 +49,15 @@ bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return fal
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    CCoinsMap mapDirty;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            mapDirty.insert(*it);
+    }
+    return BatchWrite(mapDirty, hashBlock);
+}
 bool CCoinsView::GetStats(CCoinsStats &stats) const { return false; }
 
 
@@ -57,11 +67,12 @@ bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveC
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchSync(mapCoins, hashBlock); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0), nAccessCount(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
 {
@@ -72,24 +83,65 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
+/**
+ * Combine the outputs a child entry changed with those its parent entry had
+ * already changed, before the parent takes over the child's coins. The parent
+ * stops tracking outputs once the set relative to its own base is unknown.
+ */
+static void MergeChangedOutputs(CCoinsCacheEntry& parent, CCoinsCacheEntry& child)
+{
+    bool fChildTracked = child.flags & CCoinsCacheEntry::OUTPUTS_TRACKED;
+    if (!(parent.flags & CCoinsCacheEntry::DIRTY)) {
+        // The parent still matched its own base.
+        parent.vChanged.clear();
+        if (fChildTracked) {
+            parent.flags |= CCoinsCacheEntry::OUTPUTS_TRACKED;
+            parent.vChanged.swap(child.vChanged);
+        }
+    } else if ((parent.flags & CCoinsCacheEntry::OUTPUTS_TRACKED) && fChildTracked) {
+        for (unsigned int n = 0; n < child.vChanged.size(); n++)
+            if (child.vChanged[n])
+                parent.MarkChanged(n);
+    } else {
+        parent.flags &= ~CCoinsCacheEntry::OUTPUTS_TRACKED;
+        std::vector<bool>().swap(parent.vChanged);
+    }
+}
+
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
+        it->second.nLastAccess = ++nAccessCount;
         return it;
+    }
+    nCacheMisses++;
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
     tmp.swap(ret->second.coins);
+    ret->second.nLastAccess = ++nAccessCount;
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.DynamicMemoryUsage();
     return ret;
 }
 
+void CCoinsViewCache::WarmCoins(const uint256 &txid, CCoins &coins) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return;
+    coins.swap(ret.first->second.coins);
+    ret.first->second.nLastAccess = ++nAccessCount;
+    if (ret.first->second.coins.IsPruned())
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    cachedCoinsUsage += ret.first->second.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
     if (it != cacheCoins.end()) {
@@ -104,6 +156,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
     size_t cachedCoinUsage = 0;
     if (ret.second) {
+        nCacheMisses++;
         if (!base->GetCoins(txid, ret.first->second.coins)) {
             // The parent view does not have this entry; mark it as fresh.
             ret.first->second.coins.Clear();
@@ -113,20 +166,30 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        nCacheHits++;
+        cachedCoinUsage = ret.first->second.DynamicMemoryUsage();
     }
+    ret.first->second.nLastAccess = ++nAccessCount;
     // Assume that whenever ModifyCoins is called, the entry will be modified.
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    // An entry that still matches its parent starts tracking which of its
+    // outputs change, so flushing it only has to touch those.
+    if (!(ret.first->second.flags & CCoinsCacheEntry::DIRTY)) {
+        ret.first->second.flags |= CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::OUTPUTS_TRACKED;
+        ret.first->second.vChanged.clear();
+    }
     return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid) {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    size_t cachedCoinUsage = ret.second ? 0 : ret.first->second.DynamicMemoryUsage();
     ret.first->second.coins.Clear();
     ret.first->second.flags = CCoinsCacheEntry::FRESH;
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, 0);
+    ret.first->second.vChanged.clear();
+    ret.first->second.nLastAccess = ++nAccessCount;
+    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
 const CCoins* CCoinsViewCache::AccessCoins(const uint256 &txid) const {
@@ -175,8 +238,15 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
+                    entry.nLastAccess = ++nAccessCount;
+                    // The parent matched the grandparent, so the outputs the
+                    // child changed are the ones that differ from it.
+                    if (it->second.flags & CCoinsCacheEntry::OUTPUTS_TRACKED) {
+                        entry.flags |= CCoinsCacheEntry::OUTPUTS_TRACKED;
+                        entry.vChanged.swap(it->second.vChanged);
+                    }
+                    cachedCoinsUsage += entry.DynamicMemoryUsage();
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
                     // and already exist in the grandparent
@@ -189,14 +259,16 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                    MergeChangedOutputs(itUs->second, it->second);
+                    cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.nLastAccess = ++nAccessCount;
                 }
             }
         }
@@ -207,6 +279,11 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
     return true;
 }
 
+bool CCoinsViewCache::BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
+    // Merge copies of the dirty entries, the child keeps its own.
+    return CCoinsView::BatchSync(mapCoins, hashBlockIn);
+}
+
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
@@ -214,11 +291,55 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    assert(!hasModifier);
+    if (!base->BatchSync(cacheCoins, hashBlock))
+        return false;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            if (it->second.coins.IsPruned()) {
+                cachedCoinsUsage -= it->second.DynamicMemoryUsage();
+                cacheCoins.erase(it++);
+                continue;
+            }
+            // The base has the entry now, so it is neither dirty nor fresh.
+            it->second.flags = 0;
+            cachedCoinsUsage -= memusage::DynamicUsage(it->second.vChanged);
+            std::vector<bool>().swap(it->second.vChanged);
+        }
+        it++;
+    }
+    return true;
+}
+
+size_t CCoinsViewCache::Trim(size_t nTargetUsage) {
+    assert(!hasModifier);
+    if (DynamicMemoryUsage() <= nTargetUsage)
+        return 0;
+
+    // Erasing from the map leaves the iterators to the other entries valid.
+    std::vector<std::pair<uint64_t, CCoinsMap::iterator> > vClean;
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            vClean.push_back(std::make_pair(it->second.nLastAccess, it));
+    }
+    std::sort(vClean.begin(), vClean.end(), [](const std::pair<uint64_t, CCoinsMap::iterator>& a, const std::pair<uint64_t, CCoinsMap::iterator>& b) {
+        return a.first < b.first;
+    });
+
+    size_t nTrimmed = 0;
+    for (; nTrimmed < vClean.size() && DynamicMemoryUsage() > nTargetUsage; nTrimmed++) {
+        cachedCoinsUsage -= vClean[nTrimmed].second->second.DynamicMemoryUsage();
+        cacheCoins.erase(vClean[nTrimmed].second);
+    }
+    return nTrimmed;
+}
+
 void CCoinsViewCache::Uncache(const uint256& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
-        cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+        cachedCoinsUsage -= it->second.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
 }
@@ -282,18 +403,44 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight, CAmount
 CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    const CCoins& coins = it->second.coins;
+    nHeightBefore = coins.nHeight;
+    fCoinBaseBefore = coins.fCoinBase;
+    nVersionBefore = coins.nVersion;
+    if (it->second.flags & CCoinsCacheEntry::OUTPUTS_TRACKED) {
+        vOutputsBefore.reserve(coins.vout.size());
+        BOOST_FOREACH(const CTxOut& out, coins.vout)
+            vOutputsBefore.push_back(std::make_pair(out.nValue, out.scriptPubKey.size()));
+    }
 }
 
 CCoinsModifier::~CCoinsModifier()
 {
     assert(cache.hasModifier);
     cache.hasModifier = false;
+    CCoinsCacheEntry& entry = it->second;
+    if (entry.flags & CCoinsCacheEntry::OUTPUTS_TRACKED) {
+        // Outputs are spent, restored or replaced along with the transaction
+        // metadata, which every output record carries; comparing values and
+        // script sizes finds those changes without copying the outputs.
+        bool fMetaChanged = entry.coins.nHeight != nHeightBefore || entry.coins.fCoinBase != fCoinBaseBefore || entry.coins.nVersion != nVersionBefore;
+        size_t nOutputs = std::max(vOutputsBefore.size(), entry.coins.vout.size());
+        for (unsigned int n = 0; n < nOutputs; n++) {
+            std::pair<CAmount, unsigned int> before(-1, 0), after(-1, 0);
+            if (n < vOutputsBefore.size())
+                before = vOutputsBefore[n];
+            if (n < entry.coins.vout.size())
+                after = std::make_pair(entry.coins.vout[n].nValue, entry.coins.vout[n].scriptPubKey.size());
+            if (fMetaChanged || before != after)
+                entry.MarkChanged(n);
+        }
+    }
     it->second.coins.Cleanup();
     cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
     } else {
         // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        cache.cachedCoinsUsage += it->second.DynamicMemoryUsage();
     }
 }
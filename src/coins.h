@@ -288,13 +288,27 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    std::vector<bool> vChanged; // Outputs that may differ from the parent view, see OUTPUTS_TRACKED.
+    uint64_t nLastAccess; // The cache's access count at the last lookup or change, Trim drops the lowest first.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        OUTPUTS_TRACKED = (1 << 2), // Only the outputs set in vChanged differ from the parent view.
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), nLastAccess(0) {}
+
+    //! Record that output n may differ from the parent view
+    void MarkChanged(unsigned int n) {
+        if (vChanged.size() <= n)
+            vChanged.resize(n + 1, false);
+        vChanged[n] = true;
+    }
+
+    size_t DynamicMemoryUsage() const {
+        return coins.DynamicMemoryUsage() + memusage::DynamicUsage(vChanged);
+    }
 };
 
 typedef std::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
@@ -331,6 +345,9 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Do the same bulk modification as BatchWrite, but leave mapCoins untouched.
+    virtual bool BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
 
@@ -351,7 +368,9 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
 };
 
@@ -369,6 +388,10 @@ private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
     size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    std::vector<std::pair<CAmount, unsigned int> > vOutputsBefore; // Value and script size of the outputs before modification, if the entry tracks them
+    int nHeightBefore;
+    bool fCoinBaseBefore;
+    int nVersionBefore;
     CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
@@ -396,6 +419,13 @@ protected:
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Lookups answered by this cache and lookups that had to ask the base view. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
+    /* Counts lookups and changes of entries, to tell recently used entries from cold ones. */
+    mutable uint64_t nAccessCount;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -406,6 +436,7 @@ public:
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock);
 
     /**
      * Check if we have the given tx already loaded in this cache.
@@ -414,6 +445,12 @@ public:
      */
     bool HaveCoinsInCache(const uint256 &txid) const;
 
+    /**
+     * Add an entry the caller read from the backing view, as a lookup would
+     * have done. Entries that are cached already are kept, they may be newer.
+     */
+    void WarmCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
@@ -446,12 +483,29 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush,
+     * but keep the entries cached: spent ones are dropped, the others are
+     * unmodified afterwards and stay warm for the next lookups.
+     */
+    bool Sync();
+
+    /**
+     * Drop unmodified entries until the cache uses at most nTargetUsage bytes,
+     * the least recently used ones first. Returns the number of entries that
+     * were dropped.
+     */
+    size_t Trim(size_t nTargetUsage);
+
     /**
      * Removes the transaction with the given hash from the cache, if it is
      * not modified.
      */
     void Uncache(const uint256 &txid);
 
+    //! Number of lookups answered by the cache and of those that went to the base view
+    void GetCacheHits(uint64_t &nHits, uint64_t &nMisses) const { nHits = nCacheHits; nMisses = nCacheMisses; }
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
@@ -10,6 +10,8 @@
 #include "random.h"
 #include "util.h"
 
+#include <algorithm>
+#include <iterator>
 #include <memenv.h>
 #include <stdint.h>
 
@@ -17,7 +19,10 @@
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
 
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
 {
@@ -33,14 +38,99 @@ void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
     throw dbwrapper_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** The databases that can be tuned with -dbopt */
+static const char* const DB_PROFILE_NAMES[] = {"chainstate", "blockindex", "ddns"};
+
+/** Split -dbopt=<name>:<option>=<value> */
+static bool ParseDBOption(const std::string& strOpt, std::string& strName, std::string& strKey, int64_t& nValue)
+{
+    size_t nColon = strOpt.find(':');
+    size_t nEquals = strOpt.find('=', nColon == std::string::npos ? 0 : nColon);
+    if (nColon == std::string::npos || nEquals == std::string::npos)
+        return false;
+    strName = strOpt.substr(0, nColon);
+    strKey = boost::algorithm::to_lower_copy(strOpt.substr(nColon + 1, nEquals - nColon - 1));
+    return ParseInt64(strOpt.substr(nEquals + 1), &nValue) && nValue >= 0;
+}
+
+static bool SetProfileOption(CDBProfile& profile, const std::string& strKey, int64_t nValue)
+{
+    if (strKey == "maxopenfiles" && nValue >= 16 && nValue <= MAX_DB_OPEN_FILES)
+        profile.nMaxOpenFiles = nValue;
+    else if (strKey == "blocksize" && nValue >= 1024)
+        profile.nBlockSize = nValue;
+    else if (strKey == "compression" && nValue <= 1)
+        profile.fCompression = nValue;
+    else if (strKey == "writebuffer")
+        profile.nWriteBufferSize = nValue;
+    else if (strKey == "blockcache" && nValue <= 100)
+        profile.nBlockCachePercent = nValue;
+    else if (strKey == "bloombits" && nValue <= 64)
+        profile.nBloomBits = nValue;
+    else
+        return false;
+    return true;
+}
+
+CDBProfile GetDBProfile(const std::string& strName)
+{
+    CDBProfile profile;
+    BOOST_FOREACH(const std::string& strOpt, mapMultiArgs["-dbopt"]) {
+        std::string strOptName, strKey;
+        int64_t nValue;
+        if (ParseDBOption(strOpt, strOptName, strKey, nValue) && strOptName == strName)
+            SetProfileOption(profile, strKey, nValue);
+    }
+    return profile;
+}
+
+int GetDBExtraFileDescriptors()
+{
+    int nExtra = 0;
+    BOOST_FOREACH(const char* pszName, DB_PROFILE_NAMES)
+        nExtra += std::max(GetDBProfile(pszName).nMaxOpenFiles - CDBProfile().nMaxOpenFiles, 0);
+    return nExtra;
+}
+
+bool CheckDBOptions(std::string& strError)
+{
+    BOOST_FOREACH(const std::string& strOpt, mapMultiArgs["-dbopt"]) {
+        std::string strName, strKey;
+        int64_t nValue;
+        CDBProfile profile;
+        if (!ParseDBOption(strOpt, strName, strKey, nValue) || !SetProfileOption(profile, strKey, nValue)) {
+            strError = strprintf("Invalid -dbopt '%s'", strOpt);
+            return false;
+        }
+        if (std::find(std::begin(DB_PROFILE_NAMES), std::end(DB_PROFILE_NAMES), strName) == std::end(DB_PROFILE_NAMES)) {
+            strError = strprintf("Unknown database '%s' in -dbopt", strName);
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Open databases that have a name, for getdbstats */
+static boost::mutex csOpenDBs;
+static std::vector<const CDBWrapper*> vOpenDBs;
+
+void ForEachDBWrapper(const boost::function<void(const CDBWrapper&)>& fn)
+{
+    boost::mutex::scoped_lock lock(csOpenDBs);
+    BOOST_FOREACH(const CDBWrapper* pdbw, vOpenDBs)
+        fn(*pdbw);
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile& profile)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize / 100 * profile.nBlockCachePercent);
+    // up to two write buffers may be held in memory simultaneously, together they stay within the cache
+    options.write_buffer_size = profile.nWriteBufferSize ? std::min(profile.nWriteBufferSize, nCacheSize / 2) : nCacheSize / 4;
+    options.filter_policy = profile.nBloomBits ? leveldb::NewBloomFilterPolicy(profile.nBloomBits) : NULL;
+    options.compression = profile.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = profile.nMaxOpenFiles;
+    options.block_size = profile.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -49,14 +139,17 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const std::string& name)
+    : strName(name)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    if (!strName.empty())
+        profile = GetDBProfile(strName);
+    options = GetOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -92,10 +185,19 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), GetObfuscateKeyHex());
+
+    if (!strName.empty()) {
+        boost::mutex::scoped_lock lock(csOpenDBs);
+        vOpenDBs.push_back(this);
+    }
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    if (!strName.empty()) {
+        boost::mutex::scoped_lock lock(csOpenDBs);
+        vOpenDBs.erase(std::remove(vOpenDBs.begin(), vOpenDBs.end(), this), vOpenDBs.end());
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -150,6 +252,24 @@ std::string CDBWrapper::GetObfuscateKeyHex() const
     return HexStr(obfuscate_key);
 }
 
+std::string CDBWrapper::GetProperty(const std::string& strProperty) const
+{
+    std::string strValue;
+    if (!pdb->GetProperty("leveldb." + strProperty, &strValue))
+        return "";
+    return strValue;
+}
+
+uint64_t CDBWrapper::GetApproximateSize() const
+{
+    // Every key used starts with a byte below 0xff.
+    const std::string strBegin, strEnd(1, '\xff');
+    leveldb::Range range(strBegin, strEnd);
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
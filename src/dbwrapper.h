@@ -19,6 +19,7 @@
 #include <leveldb/write_batch.h>
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -28,6 +29,34 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error);
 
+/**
+ * LevelDB tuning of one database. The defaults of every named database can be
+ * overridden with -dbopt=<name>:<option>=<value>.
+ */
+struct CDBProfile
+{
+    int nMaxOpenFiles;
+    size_t nBlockSize; //! bytes of user data per block
+    bool fCompression; //! Snappy compression, if LevelDB was built with it
+    size_t nWriteBufferSize; //! bytes, 0 for a quarter of the database cache, at most half of it
+    int nBlockCachePercent; //! share of the database cache used for uncompressed blocks
+    int nBloomBits; //! bits per key of the bloom filter, 0 for none
+
+    CDBProfile() : nMaxOpenFiles(64), nBlockSize(4096), fCompression(false), nWriteBufferSize(0), nBlockCachePercent(50), nBloomBits(10) {}
+};
+
+/** Upper bound of -dbopt maxopenfiles */
+static const int MAX_DB_OPEN_FILES = 1000;
+
+/** The profile of a named database, with -dbopt applied */
+CDBProfile GetDBProfile(const std::string& strName);
+
+/** File descriptors that -dbopt maxopenfiles asks for beyond the defaults, over all databases */
+int GetDBExtraFileDescriptors();
+
+/** Check every -dbopt before a database is opened */
+bool CheckDBOptions(std::string& strError);
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -70,6 +99,11 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CDBIterator
@@ -125,6 +159,10 @@ public:
         return true;
     }
 
+    unsigned int GetKeySize() {
+        return piter->key().size();
+    }
+
     unsigned int GetValueSize() {
         return piter->value().size();
     }
@@ -134,6 +172,12 @@ public:
 class CDBWrapper
 {
 private:
+    //! name of the profile the database was opened with, empty if none
+    std::string strName;
+
+    //! the tuning the database was opened with
+    CDBProfile profile;
+
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
@@ -174,8 +218,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] name        Profile to open the database with, see CDBProfile. Named
+     *                        databases are listed by getdbstats.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const std::string& name = "");
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -273,7 +319,24 @@ public:
      */
     std::string GetObfuscateKeyHex() const;
 
+    const std::string& GetName() const { return strName; }
+    const CDBProfile& GetProfile() const { return profile; }
+    //! the write buffer in effect, the profile's value clamped to the database cache
+    size_t GetWriteBufferSize() const { return options.write_buffer_size; }
+
+    /**
+     * Return the value of a LevelDB property, e.g. "stats" for "leveldb.stats",
+     * or an empty string if LevelDB does not know it.
+     */
+    std::string GetProperty(const std::string& strProperty) const;
+
+    /** Approximate size of the database files in bytes */
+    uint64_t GetApproximateSize() const;
+
 };
 
+/** Call fn for every open database that has a name; none of them is closed meanwhile */
+void ForEachDBWrapper(const boost::function<void(const CDBWrapper&)>& fn);
+
 #endif // DYNAMIC_DBWRAPPER_H
 
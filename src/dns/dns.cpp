@@ -6,29 +6,41 @@
 
 #include "dns/dns.h"
 
+#include "blockfilemap.h"
+#include "hash.h"
+#include "init.h"
+#include "random.h"
 #include "script/interpreter.h"
 #include "policy/policy.h"
 #include "rpcserver.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "wallet/wallet.h"
 
 #include <univalue.h>
 
+#include <cmath>
 #include <fstream>
 
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
 #include <boost/xpressive/xpressive_dynamic.hpp>
 
-std::map<CNameVal, std::set<uint256> > mapNamePending; // for pending tx
+CNameCache nameCache;
+CNameBloom nameBloom;
+CNameDB* pnameDB = NULL;
 
 // forward decls
 extern std::string _(const char* psz);
 extern std::map<uint256, CTransaction> mapTransactions;
 extern CWallet* pwalletMain;
+bool createNameIndexFile(int nFromHeight);
+static bool CheckNameInputs(const CTransaction& tx, const CBlockIndex* pindexBlock, std::vector<nameTempProxy> &vName, const CDiskTxPos& pos, const CAmount& txFee, bool& fDBError);
 
 class CNamecoinHooks : public CHooks
 {
@@ -36,13 +48,14 @@ public:
     virtual bool IsNameFeeEnough(const CTransaction& tx, const CAmount& txFee);
     virtual bool CheckInputs(const CTransaction& tx, const CBlockIndex* pindexBlock, std::vector<nameTempProxy> &vName, const CDiskTxPos& pos, const CAmount& txFee);
     virtual bool DisconnectInputs(const CTransaction& tx);
+    virtual bool DisconnectBlock(const CBlockIndex* pindex);
     virtual bool ConnectBlock(CBlockIndex* pindex, const std::vector<nameTempProxy>& vName);
     virtual bool ExtractAddress(const CScript& script, std::string& address);
-    virtual void AddToPendingNames(const CTransaction& tx);
     virtual bool RemoveNameScriptPrefix(const CScript& scriptIn, CScript& scriptOut);
     virtual bool IsNameScript(CScript scr);
     virtual bool getNameValue(const std::string& sName, std::string& sValue);
     virtual bool DumpToTextFile();
+    virtual bool FlushNames();
 };
 
 bool CTransaction::ReadFromDisk(const CDiskTxPos& postx)
@@ -50,8 +63,21 @@ bool CTransaction::ReadFromDisk(const CDiskTxPos& postx)
     if (!fTxIndex)
         return false;
 
-    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
     CBlockHeader header;
+    CMappedData data;
+    if (MapBlockFileAt(data, postx)) {
+        CMemoryReader reader = data.GetReader(SER_DISK, CLIENT_VERSION);
+        try {
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> *this;
+        } catch (const std::exception& e) {
+            return error("%s() : deserialize error\n%s", __PRETTY_FUNCTION__, e.what());
+        }
+        return true;
+    }
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
     try {
         file >> header;
         fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
@@ -105,17 +131,7 @@ bool CalculateExpiresAt(CNameRecord& nameRec)
 
     int64_t sum = 0;
     for(unsigned int i = nameRec.nLastActiveChainIndex; i < nameRec.vtxPos.size(); i++)
-    {
-        CTransaction tx;
-        if (!tx.ReadFromDisk(nameRec.vtxPos[i].txPos))
-            return error("CalculateExpiresAt() : could not read tx from disk");
-
-        NameTxInfo nti;
-        if (!DecodeNameTx(tx, nti))
-            return error("CalculateExpiresAt() : %s is not namecoin tx, this should never happen", tx.GetHash().GetHex());
-
-        sum += nti.nRentalDays * 1350; //days to blocks. 1350 is average number of PoS blocks per day
-    }
+        sum += (int64_t)nameRec.vtxPos[i].nRentalDays * 1350; //days to blocks. 1350 is average number of PoS blocks per day
 
     //limit to INT_MAX value
     sum += nameRec.vtxPos[nameRec.nLastActiveChainIndex].nHeight;
@@ -142,8 +158,7 @@ bool NameActive(CNameDB& dbName, const CNameVal& name, int currentBlockHeight =
 
 bool NameActive(const CNameVal& name, int currentBlockHeight = -1)
 {
-    CNameDB dbName("r");
-    return NameActive(dbName, name, currentBlockHeight);
+    return NameActive(*pnameDB, name, currentBlockHeight);
 }
 
 // Returns minimum name operation fee rounded down to cents. Should be used during|before transaction creation.
@@ -162,7 +177,28 @@ CAmount GetNameOpFee(const unsigned int& nRentalDays, const int& op)
     return txMinFee;
 }
 
-// scans nameindex.dat and return names with their last CNameIndex
+// destination address of a name output
+static std::string NameOutputAddress(const CTxOut& out)
+{
+    NameTxInfo nti;
+    CScript::const_iterator pc = out.scriptPubKey.begin();
+    CTxDestination address;
+    if (!DecodeNameScript(out.scriptPubKey, nti, pc) || !ExtractDestination(CScript(pc, out.scriptPubKey.end()), address))
+        return "";
+    return CDynamicAddress(address).ToString();
+}
+
+static bool IsMineNameAddress(const std::string& strAddress)
+{
+    CDynamicAddress address(strAddress);
+    return pwalletMain && address.IsValid() && IsMine(*pwalletMain, address.Get()) == ISMINE_SPENDABLE;
+}
+
+CNameDB::CNameDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "ddns", nCacheSize, fMemory, fWipe, false, "ddns"), fCorrupt(false)
+{
+}
+
+// scans the name index and return names with their last CNameIndex
 bool CNameDB::ScanNames(const CNameVal& name, unsigned int nMax,
         std::vector<
             std::pair<
@@ -171,61 +207,584 @@ bool CNameDB::ScanNames(const CNameVal& name, unsigned int nMax,
             >
         > &nameScan)
 {
-    Dbc* pcursor = GetCursor();
-    if (!pcursor)
-        return false;
+    for (CNameIterator it(*this, name); it.Valid() && nameScan.size() < nMax; it.Next())
+        nameScan.push_back(std::make_pair(it.GetName(), std::make_pair(it.GetRecord().vtxPos.back(), it.GetRecord().nExpiresAt)));
+    return true;
+}
 
-    unsigned int fFlags = DB_SET_RANGE;
+static bool NameHasPrefix(const CNameVal& name, const CNameVal& prefix)
+{
+    return name.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), name.begin());
+}
+
+void CNameDB::GetDirtyNames(const CNameVal& nameStart, const CNameVal& prefix, std::map<CNameVal, CNameRecord>& mapNames)
+{
+    LOCK(cs);
+    std::map<CNameVal, CNameRecord>::const_iterator it = mapDirty.lower_bound(std::max(nameStart, prefix));
+    for (; it != mapDirty.end() && NameHasPrefix(it->first, prefix); ++it)
+        mapNames.insert(*it);
+}
+
+CNameIterator::CNameIterator(CNameDB& db, const CNameVal& nameStart, const CNameVal& prefixIn) : prefix(prefixIn), fValid(false)
+{
+    // the unflushed records are copied before the cursors take their snapshot, so that a flush
+    // in between can't hide a change from both
+    db.GetDirtyNames(nameStart, prefix, mapDirty);
+    itDirty = mapDirty.begin();
+
+    pcursor.reset(db.NewIterator());
+    pcursor->Seek(CNameKey("namer", std::max(nameStart, prefix)));
+    LoadKey();
+    Next();
+}
+
+void CNameIterator::LoadKey()
+{
+    CNameKey key;
+    fCursorValid = pcursor->Valid() && pcursor->GetKey(key) &&
+        key.strType == "namer" && NameHasPrefix(key.name, prefix);
+    if (fCursorValid)
+        cursorName = key.name;
+}
+
+void CNameIterator::Next()
+{
     while (true)
     {
-        // Read next record
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        if (fFlags == DB_SET_RANGE)
-            ssKey << std::make_pair(std::string("namei"), name);
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
-        fFlags = DB_NEXT;
-        if (ret == DB_NOTFOUND)
-            break;
-        else if (ret != 0)
-            return false;
+        // the smallest name left in either source
+        const CNameVal* pname = NULL;
+        if (itDirty != mapDirty.end())
+            pname = &itDirty->first;
+        if (fCursorValid && (!pname || cursorName < *pname))
+            pname = &cursorName;
+        if (!pname)
+        {
+            fValid = false;
+            return;
+        }
+        name = *pname;
 
-        // Unserialize
-        std::string strType;
-        ssKey >> strType;
-        if (strType == "namei")
+        bool fFound = false;
+        if (itDirty != mapDirty.end() && itDirty->first == name)
         {
-            CNameVal name2;
-            ssKey >> name2;
-            CNameRecord val;
-            ssValue >> val;
-            if (val.deleted() || val.vtxPos.empty())
-                continue;
-            nameScan.push_back(std::make_pair(name2, std::make_pair(val.vtxPos.back(), val.nExpiresAt)));
+            rec = itDirty->second;
+            fFound = true;
+            ++itDirty;
         }
+        if (fCursorValid && cursorName == name)
+        {
+            if (!fFound && !(fFound = pcursor->GetValue(rec)))
+                LogPrintf("CNameIterator::Next() : failed to read %s\n", stringFromNameVal(name));
+            pcursor->Next();
+            LoadKey();
+        }
+
+        // erased names have an empty record
+        if (fFound && !rec.deleted())
+        {
+            fValid = true;
+            return;
+        }
+    }
+}
+
+std::string GetRegexLiteralPrefix(const std::string& strRegexp)
+{
+    // each alternative could have an anchor of its own
+    if (strRegexp.empty() || strRegexp[0] != '^' || strRegexp.find('|') != std::string::npos)
+        return "";
 
-        if (nameScan.size() >= nMax)
+    std::string strPrefix;
+    for (unsigned int i = 1; i < strRegexp.size(); i++)
+    {
+        char c = strRegexp[i];
+        if (c == '\\')
+        {
+            // escaped punctuation is literal, escaped letters and digits are classes or back references
+            if (i + 1 == strRegexp.size() || isalnum((unsigned char)strRegexp[i + 1]))
+                break;
+            c = strRegexp[++i];
+        }
+        else if (strchr(".[](){}*+?^$", c))
+        {
+            // these quantifiers allow the last literal to be missing
+            if ((c == '*' || c == '?' || c == '{') && !strPrefix.empty())
+                strPrefix.erase(strPrefix.size() - 1);
             break;
+        }
+        strPrefix += c;
     }
-    pcursor->close();
-    return true;
+    return strPrefix;
+}
+
+void CNameDB::WriteName(const CNameVal& name, const CNameRecord& rec)
+{
+    LOCK(cs);
+    mapDirty[name] = rec;
+}
+
+bool CNameDB::ExistsName(const CNameVal& name)
+{
+    {
+        LOCK(cs);
+        std::map<CNameVal, CNameRecord>::const_iterator it = mapDirty.find(name);
+        if (it != mapDirty.end())
+            return !it->second.vtxPos.empty();
+    }
+    return Exists(CNameKey("namer", name));
+}
+
+void CNameDB::EraseName(const CNameVal& name)
+{
+    LOCK(cs);
+    mapDirty[name] = CNameRecord();
 }
 
 bool CNameDB::ReadName(const CNameVal& name, CNameRecord& rec)
 {
-    bool ret = Read(std::make_pair(std::string("namei"), name), rec);
-    int s = rec.vtxPos.size();
+    {
+        LOCK(cs);
+        std::map<CNameVal, CNameRecord>::const_iterator it = mapDirty.find(name);
+        if (it != mapDirty.end())
+        {
+            if (it->second.vtxPos.empty())
+                return false;
+            rec = it->second;
+            return true;
+        }
+    }
+
+    if (!Read(CNameKey("namer", name), rec))
+        return false;
 
-     // check if array index is out of array bounds
+    // check if array index is out of array bounds
+    int s = rec.vtxPos.size();
     if (s > 0 && rec.nLastActiveChainIndex >= s)
     {
-        // delete nameindex and kill the application. nameindex should be recreated on next start
-        boost::system::error_code err;
-        boost::filesystem::remove(GetDataDir() / this->strFile, err);
-        LogPrintf("Nameindex is corrupt! It will be recreated on next start.");
-        assert(rec.nLastActiveChainIndex < s);
+        // forget the best block, so that the name index gets rebuilt on next start
+        {
+            LOCK(cs);
+            fCorrupt = true;
+        }
+        Erase(std::string("bestblock"), true);
+        return error("%s: name index is corrupt, it will be rebuilt on next start", __func__);
     }
-    return ret;
+    return true;
+}
+
+void CNameDB::SetBestBlock(const uint256& hash)
+{
+    LOCK(cs);
+    hashBestBlock = hash;
+}
+
+uint256 CNameDB::GetBestBlock()
+{
+    LOCK(cs);
+    if (!hashBestBlock.IsNull())
+        return hashBestBlock;
+
+    uint256 hash;
+    if (!Read(std::string("bestblock"), hash))
+        return uint256();
+    return hash;
+}
+
+// writes the changed records together with the best block they belong to
+bool CNameDB::FlushNames()
+{
+    LOCK(cs);
+    if (mapDirty.empty() && hashBestBlock.IsNull())
+        return true;
+
+    CDBBatch batch(&GetObfuscateKey());
+    BOOST_FOREACH(const PAIRTYPE(CNameVal, CNameRecord)& item, mapDirty)
+    {
+        if (item.second.vtxPos.empty())
+            batch.Erase(CNameKey("namer", item.first));
+        else
+            batch.Write(CNameKey("namer", item.first), item.second);
+    }
+    // a corrupt index must not claim to be up to date again
+    if (fCorrupt)
+        batch.Erase(std::string("bestblock"));
+    else if (!hashBestBlock.IsNull())
+        batch.Write(std::string("bestblock"), hashBestBlock);
+
+    LogPrint("names", "Committing %u changed names to the name index\n", mapDirty.size());
+    if (!WriteBatch(batch))
+        return false;
+
+    mapDirty.clear();
+    hashBestBlock.SetNull();
+    return true;
+}
+
+// fills the name cache with every name record in the name index
+bool CNameDB::FillNameCache(CNameCache& cache)
+{
+    // stays complete unless names have to be evicted while filling
+    cache.Clear();
+    cache.SetComplete(true);
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(CNameKey("namer", CNameVal()));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        CNameKey key;
+        if (!pcursor->GetKey(key) || key.strType != "namer")
+            break;
+
+        CNameRecord nameRec;
+        if (!pcursor->GetValue(nameRec))
+        {
+            cache.SetComplete(false);
+            return false;
+        }
+        cache.Update(key.name, nameRec, true);
+    }
+
+    LOCK(cs);
+    BOOST_FOREACH(const PAIRTYPE(CNameVal, CNameRecord)& item, mapDirty)
+    {
+        if (item.second.vtxPos.empty())
+            cache.Erase(item.first);
+        else
+            cache.Update(item.first, item.second);
+    }
+    return true;
+}
+
+bool CNameDB::FillNameBloom(CNameBloom& bloom, double nFPRate, size_t nMaxBytes)
+{
+    // only the keys are needed, the records are not decoded
+    std::vector<CNameVal> vNames;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(CNameKey("namer", CNameVal()));
+    for (; pcursor->Valid(); pcursor->Next())
+    {
+        CNameKey key;
+        if (!pcursor->GetKey(key) || key.strType != "namer")
+            break;
+        vNames.push_back(key.name);
+    }
+
+    {
+        LOCK(cs);
+        BOOST_FOREACH(const PAIRTYPE(CNameVal, CNameRecord)& item, mapDirty)
+            if (!item.second.vtxPos.empty())
+                vNames.push_back(item.first);
+    }
+
+    // built aside and swapped in at once, the resolver threads keep querying the old filter meanwhile
+    // and never see a half filled one. Leave room for the names registered until the next rebuild.
+    CNameBloom fresh;
+    fresh.Reset(vNames.size() * 2, nFPRate, nMaxBytes);
+    BOOST_FOREACH(const CNameVal& name, vNames)
+        fresh.Insert(name);
+    bloom.Swap(fresh);
+    return true;
+}
+
+void CNameBloom::Reset(size_t nNames, double nFPRate, size_t nMaxBytes)
+{
+    LOCK(cs);
+    nCapacity = std::max(nNames, (size_t)1000);
+    nElements = 0;
+    nTweak = GetRand(std::numeric_limits<uint32_t>::max());
+
+    // optimal size and number of hash functions for the target rate, capped by nMaxBytes
+    double nBits = -1.0 / (M_LN2 * M_LN2) * nCapacity * log(nFPRate);
+    vData.assign(std::min((size_t)(nBits / 8) + 1, nMaxBytes), 0);
+    nHashFuncs = vData.empty() ? 0 : std::max(1, std::min((int)(vData.size() * 8.0 / nCapacity * M_LN2), 30));
+}
+
+void CNameBloom::Swap(CNameBloom& other)
+{
+    LOCK2(cs, other.cs);
+    vData.swap(other.vData);
+    std::swap(nHashFuncs, other.nHashFuncs);
+    std::swap(nTweak, other.nTweak);
+    std::swap(nCapacity, other.nCapacity);
+    std::swap(nElements, other.nElements);
+}
+
+// double hashing, the i-th bit of a name is h1 + i * h2
+static void NameBloomHashes(const CNameVal& name, uint32_t nTweak, uint32_t& h1, uint32_t& h2)
+{
+    h1 = MurmurHash3(nTweak, name);
+    h2 = MurmurHash3(nTweak ^ 0xFBA4C795, name) | 1;
+}
+
+void CNameBloom::Insert(const CNameVal& name)
+{
+    LOCK(cs);
+    if (vData.empty())
+        return;
+
+    uint32_t h1, h2;
+    NameBloomHashes(name, nTweak, h1, h2);
+    uint64_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        uint64_t nIndex = (h1 + (uint64_t)i * h2) % nBits;
+        vData[nIndex >> 3] |= (1 << (7 & nIndex));
+    }
+    nElements++;
+}
+
+bool CNameBloom::MayContain(const CNameVal& name)
+{
+    LOCK(cs);
+    if (vData.empty())
+        return true;
+
+    nQueries++;
+    uint32_t h1, h2;
+    NameBloomHashes(name, nTweak, h1, h2);
+    uint64_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < nHashFuncs; i++)
+    {
+        uint64_t nIndex = (h1 + (uint64_t)i * h2) % nBits;
+        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+        {
+            nRejected++;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CNameBloom::IsEnabled() const
+{
+    LOCK(cs);
+    return !vData.empty();
+}
+
+bool CNameBloom::IsOverfull() const
+{
+    LOCK(cs);
+    return !vData.empty() && nElements > 2 * nCapacity;
+}
+
+size_t CNameBloom::GetBytes() const
+{
+    LOCK(cs);
+    return vData.size();
+}
+
+size_t CNameBloom::GetElements() const
+{
+    LOCK(cs);
+    return nElements;
+}
+
+double CNameBloom::GetFPRate() const
+{
+    LOCK(cs);
+    if (vData.empty())
+        return 1.0;
+    return pow(1.0 - exp(-(double)nHashFuncs * nElements / (vData.size() * 8.0)), nHashFuncs);
+}
+
+UniValue CNameBloom::GetInfo() const
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled", IsEnabled()));
+    obj.push_back(Pair("names", (uint64_t)GetElements()));
+    obj.push_back(Pair("bytes", (uint64_t)GetBytes()));
+    {
+        LOCK(cs);
+        obj.push_back(Pair("capacity", (uint64_t)nCapacity));
+        obj.push_back(Pair("hashfuncs", (int)nHashFuncs));
+    }
+    obj.push_back(Pair("fprate", GetFPRate()));
+    obj.push_back(Pair("queries", (uint64_t)nQueries));
+    obj.push_back(Pair("rejected", (uint64_t)nRejected));
+    return obj;
+}
+
+void CNameCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = std::max(nMaxSizeIn, (size_t)1);
+    while (mapNames.size() > nMaxSize)
+    {
+        mapNames.erase(listLRU.back());
+        listLRU.pop_back();
+        fComplete = false;
+    }
+}
+
+void CNameCache::SetComplete(bool fCompleteIn)
+{
+    LOCK(cs);
+    fComplete = fCompleteIn;
+}
+
+bool CNameCache::IsComplete() const
+{
+    LOCK(cs);
+    return fComplete;
+}
+
+size_t CNameCache::GetSize() const
+{
+    LOCK(cs);
+    return mapNames.size();
+}
+
+void CNameCache::Clear()
+{
+    LOCK(cs);
+    mapNames.clear();
+    listLRU.clear();
+    fComplete = false;
+    nGeneration++;
+}
+
+void CNameCache::Insert(const CNameVal& name, const CNameVal& value, int nExpiresAt)
+{
+    AssertLockHeld(cs);
+
+    std::map<CNameVal, CNameCacheEntry>::iterator it = mapNames.find(name);
+    if (it == mapNames.end())
+    {
+        if (mapNames.size() >= nMaxSize)
+        {
+            // evict least recently used name, misses have to go to the name index from now on
+            mapNames.erase(listLRU.back());
+            listLRU.pop_back();
+            fComplete = false;
+        }
+        listLRU.push_front(name);
+        it = mapNames.insert(std::make_pair(name, CNameCacheEntry())).first;
+    }
+    else
+        listLRU.splice(listLRU.begin(), listLRU, it->second.itLRU);
+
+    it->second.value = value;
+    it->second.nExpiresAt = nExpiresAt;
+    it->second.itLRU = listLRU.begin();
+}
+
+void CNameCache::Update(const CNameVal& name, const CNameRecord& nameRec, bool fOnlyIfMissing)
+{
+    LOCK(cs);
+    if (fOnlyIfMissing && mapNames.count(name))
+        return;
+    if (!fOnlyIfMissing)
+        nGeneration++;
+
+    if (nameRec.deleted())
+        Insert(name, CNameVal(), -1);
+    else
+        Insert(name, nameRec.vtxPos.back().value, nameRec.nExpiresAt);
+}
+
+void CNameCache::Erase(const CNameVal& name)
+{
+    LOCK(cs);
+    nGeneration++;
+    std::map<CNameVal, CNameCacheEntry>::iterator it = mapNames.find(name);
+    if (it == mapNames.end())
+        return;
+    listLRU.erase(it->second.itLRU);
+    mapNames.erase(it);
+}
+
+bool CNameCache::Get(const CNameVal& name, CNameVal& value, int& nExpiresAt)
+{
+    LOCK(cs);
+    std::map<CNameVal, CNameCacheEntry>::iterator it = mapNames.find(name);
+    if (it == mapNames.end())
+        return false;
+    listLRU.splice(listLRU.begin(), listLRU, it->second.itLRU);
+    value = it->second.value;
+    nExpiresAt = it->second.nExpiresAt;
+    return true;
+}
+
+bool fillNameCache()
+{
+    nameCache.SetMaxSize(GetArg("-namecachesize", DEFAULT_NAME_CACHE_SIZE));
+
+    if (!pnameDB->FillNameCache(nameCache))
+        return error("fillNameCache() : failed to read names from the name index");
+
+    LogPrintf("Loaded %u names into the name cache%s\n", nameCache.GetSize(),
+              nameCache.IsComplete() ? "" : ", names which did not fit will be read from the name index");
+    return true;
+}
+
+bool fillNameBloom()
+{
+    double nFPRate = atof(GetArg("-namebloomfprate", boost::lexical_cast<std::string>(DEFAULT_NAME_BLOOM_FPRATE)).c_str());
+    if (nFPRate <= 0 || nFPRate >= 1)
+    {
+        LogPrintf("Invalid -namebloomfprate=%s, using %g\n", GetArg("-namebloomfprate", ""), DEFAULT_NAME_BLOOM_FPRATE);
+        nFPRate = DEFAULT_NAME_BLOOM_FPRATE;
+    }
+    size_t nMaxBytes = std::max((int64_t)0, std::min(GetArg("-namebloommaxmem", DEFAULT_NAME_BLOOM_MAXMEM), (int64_t)512)) << 20;
+
+    if (!pnameDB->FillNameBloom(nameBloom, nFPRate, nMaxBytes))
+        return error("fillNameBloom() : failed to read names from the name index");
+
+    if (nameBloom.IsEnabled())
+        LogPrintf("Name filter: %u names in %u bytes, estimated false positive rate %g\n",
+                  nameBloom.GetElements(), nameBloom.GetBytes(), nameBloom.GetFPRate());
+    return true;
+}
+
+// Opens the name index. It is caught up if it belongs to an ancestor of the chainstate tip (the
+// chainstate gets flushed first), otherwise it is rebuilt from the block chain. fWipe starts from an
+// empty name index, for a reindex that connects every block again.
+bool InitNameIndex(size_t nCacheSize, bool fWipe)
+{
+    delete pnameDB;
+    pnameDB = new CNameDB(nCacheSize, false, fWipe);
+
+    if (fWipe)
+    {
+        LogPrintf("Wiping the name index, it is recreated while the blocks are reindexed\n");
+        return pnameDB->WriteVersion(NAMEINDEX_VERSION);
+    }
+
+    // -rebuildnameindex recovers a corrupted name index from the block files, without a -reindex
+    if (GetBoolArg("-rebuildnameindex", false))
+    {
+        LogPrintf("Rebuilding the name index (-rebuildnameindex)\n");
+        delete pnameDB;
+        pnameDB = new CNameDB(nCacheSize, false, true);
+        return createNameIndexFile(0);
+    }
+
+    if (pnameDB->IsEmpty() && boost::filesystem::exists(GetDataDir() / "ddns.dat"))
+        LogPrintf("ddns.dat of an older version is no longer used, the name index will be rebuilt\n");
+
+    // records of older formats are stored under keys that no longer sort by name
+    int nVersion = 0;
+    bool fOutdated = !pnameDB->IsEmpty() && (!pnameDB->ReadVersion(nVersion) || nVersion < NAMEINDEX_VERSION);
+
+    // without a chain tip only an index that has not seen any block is up to date
+    uint256 hashBest = pnameDB->GetBestBlock();
+    if (!fOutdated && (chainActive.Tip() == NULL ? hashBest.IsNull() : hashBest == chainActive.Tip()->GetBlockHash()))
+        return true;
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+    if (!fOutdated && !hashBest.IsNull() && mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+    {
+        LogPrintf("Name index is at height %d, catching up with the chain tip\n", mi->second->nHeight);
+        return createNameIndexFile(mi->second->nHeight + 1);
+    }
+
+    if (fOutdated)
+        LogPrintf("Name index format %d is outdated, rebuilding it\n", nVersion);
+    else
+        LogPrintf("Name index does not match the chain tip, rebuilding it\n");
+    delete pnameDB;
+    pnameDB = new CNameDB(nCacheSize, false, true);
+    return createNameIndexFile(0);
 }
 
 CHooks* InitHook()
@@ -336,22 +895,21 @@ UniValue sendtoname(const UniValue& params, bool fHelp)
 
 bool GetNameCurrentAddress(const CNameVal& name, CDynamicAddress& address, std::string& error)
 {
-    CNameDB dbName("r");
+    CNameDB& dbName = *pnameDB;
     if (!dbName.ExistsName(name))
     {
         error = "Name not found";
         return false;
     }
 
-    CTransaction tx;
-    NameTxInfo nti;
-    if (!(GetLastTxOfName(dbName, name, tx) && DecodeNameTx(tx, nti, true)))
+    CNameRecord nameRec;
+    if (!dbName.ReadName(name, nameRec) || nameRec.deleted())
     {
-        error = "Failed to read/decode last name transaction";
+        error = "Failed to read last name transaction";
         return false;
     }
 
-    address.SetString(nti.strAddress);
+    address.SetString(nameRec.vtxPos.back().strAddress);
     if (!address.IsValid())
     {
         error = "Name contains invalid address"; // this error should never happen, and if it does - this probably means that client blockchain database is corrupted
@@ -419,56 +977,36 @@ void GetNameList(const CNameVal& nameUniq, std::map<CNameVal, NameTxInfo>& mapNa
     if (IsInitialBlockDownload())
         return;
 
-    CNameDB dbName("r");
+    CNameDB& dbName = *pnameDB;
     //vector<UniValue> oRes;
 
-    CNameVal name;
-    std::vector<std::pair<CNameVal, std::pair<CNameIndex,int> > > nameScan;
-    if (!dbName.ScanNames(name, 100000000, nameScan))
-        return; // throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
-
-    std::pair<CNameVal, std::pair<CNameIndex,int> > pairScan;
-    BOOST_FOREACH(pairScan, nameScan)
+    for (CNameIterator it(dbName, CNameVal()); it.Valid(); it.Next())
     {
-        CNameVal name = pairScan.first;
-        CNameIndex txName = pairScan.second.first;
-        CNameVal value = txName.value;
-        int nHeightRegister = txName.nHeight;
-        int op = txName.op;
-
-        CNameRecord nameRec;
-        if (!dbName.ReadName(pairScan.first, nameRec))
-            continue;
-        int nExpiresAt = nameRec.nExpiresAt;
-
-        int nRentalDays = nExpiresAt - nHeightRegister;
-        NameTxInfo nti(name, value, nRentalDays, op, 0, "");
-        CTransaction tx;
-        GetLastTxOfName(dbName, name, tx, nameRec);
-        if (!DecodeNameTx(tx, nti, true))
-            continue;
-
-        nti.nExpiresAt = nExpiresAt;
+        const CNameIndex& txName = it.GetRecord().vtxPos.back();
+        NameTxInfo nti(it.GetName(), txName.value, txName.nRentalDays, txName.op, 0, "");
+        nti.strAddress = txName.strAddress;
+        nti.fIsMine = IsMineNameAddress(txName.strAddress);
+        nti.nExpiresAt = it.GetRecord().nExpiresAt;
         mapNames[nti.name] = nti;
     }
 
     // add all pending names
-    BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &item, mapNamePending)
+    std::map<CNameVal, std::set<uint256> > mapMempoolNames;
+    mempool.getNameIndex(mapMempoolNames);
+    BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &item, mapMempoolNames)
     {
-        if (!item.second.size())
-            continue;
-
         // if there is a set of pending op on a single name - select last one, by nTime
         CTransaction tx;
         uint32_t nTime = 0;
         bool found = false;
         BOOST_FOREACH(const uint256& hash, item.second)
         {
-            if (!mempool.exists(hash))
+            CTransaction txPending;
+            if (!mempool.lookup(hash, txPending))
                 continue;
-            if (mempool.mapTx.find(hash)->GetTx().nLockTime > nTime)
+            if (txPending.nLockTime > nTime)
             {
-                tx = mempool.mapTx.find(hash)->GetTx();
+                tx = txPending;
                 nTime = tx.nLockTime;
                 found = true;
             }
@@ -499,7 +1037,9 @@ UniValue name_debug(const UniValue& params, bool fHelp)
 
     {
         LOCK(cs_main);
-        BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &pairPending, mapNamePending)
+        std::map<CNameVal, std::set<uint256> > mapMempoolNames;
+        mempool.getNameIndex(mapMempoolNames);
+        BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &pairPending, mapMempoolNames)
         {
             std::string name = stringFromNameVal(pairPending.first);
             LogPrintf("%s :\n", name);
@@ -517,6 +1057,42 @@ UniValue name_debug(const UniValue& params, bool fHelp)
     return true;
 }
 
+UniValue name_cacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "name_cacheinfo\n"
+            "Returns the state of the in-memory name cache and of the filter over registered names.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"cache\": {\n"
+            "    \"names\": n,          (numeric) names cached\n"
+            "    \"complete\": true|false (boolean) true if every name in the name index is cached\n"
+            "  },\n"
+            "  \"bloom\": {\n"
+            "    \"enabled\": true|false, (boolean) false if -namebloommaxmem=0\n"
+            "    \"names\": n,          (numeric) names added to the filter\n"
+            "    \"bytes\": n,          (numeric) memory used by the filter\n"
+            "    \"capacity\": n,       (numeric) names the filter was sized for\n"
+            "    \"hashfuncs\": n,      (numeric) hash functions per name\n"
+            "    \"fprate\": x.xxx,     (numeric) estimated false positive rate\n"
+            "    \"queries\": n,        (numeric) lookups that missed the name cache and checked the filter\n"
+            "    \"rejected\": n        (numeric) lookups answered without reading the name index\n"
+            "  }\n"
+            "}\n"
+            + HelpExampleCli("name_cacheinfo", "")
+            + HelpExampleRpc("name_cacheinfo", ""));
+
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("names", (uint64_t)nameCache.GetSize()));
+    cache.push_back(Pair("complete", nameCache.IsComplete()));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("cache", cache));
+    obj.push_back(Pair("bloom", nameBloom.GetInfo()));
+    return obj;
+}
+
 UniValue name_show(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 3)
@@ -536,31 +1112,27 @@ UniValue name_show(const UniValue& params, bool fHelp)
     CNameVal name = nameValFromValue(params[0]);
     std::string outputType = params.size() > 1 ? params[1].get_str() : "";
     std::string sName = stringFromNameVal(name);
-    NameTxInfo nti;
+    CNameVal value;
     {
         LOCK(cs_main);
         CNameRecord nameRec;
-        CNameDB dbName("r");
+        CNameDB& dbName = *pnameDB;
         if (!dbName.ReadName(name, nameRec))
             throw JSONRPCError(RPC_WALLET_ERROR, "failed to read from name DB");
 
         if (nameRec.vtxPos.size() < 1)
             throw JSONRPCError(RPC_WALLET_ERROR, "no result returned");
 
-        CTransaction tx;
-        if (!tx.ReadFromDisk(nameRec.vtxPos.back().txPos))
-            throw JSONRPCError(RPC_WALLET_ERROR, "failed to read from from disk");
-
-        if (!DecodeNameTx(tx, nti, true))
-            throw JSONRPCError(RPC_WALLET_ERROR, "failed to decode name");
+        const CNameIndex& txName = nameRec.vtxPos.back();
+        value = txName.value;
 
         oName.push_back(Pair("name", sName));
-        oName.push_back(Pair("value", encodeNameVal(nti.value, outputType)));
-        oName.push_back(Pair("txid", tx.GetHash().GetHex()));
-        oName.push_back(Pair("address", nti.strAddress));
+        oName.push_back(Pair("value", encodeNameVal(value, outputType)));
+        oName.push_back(Pair("txid", txName.txHash.GetHex()));
+        oName.push_back(Pair("address", txName.strAddress));
         oName.push_back(Pair("expires_in", nameRec.nExpiresAt - chainActive.Height()));
         oName.push_back(Pair("expires_at", nameRec.nExpiresAt));
-        oName.push_back(Pair("time", (boost::int64_t)tx.nLockTime));
+        oName.push_back(Pair("time", (boost::int64_t)txName.nTime));
         if (nameRec.deleted())
             oName.push_back(Pair("deleted", true));
         else
@@ -576,7 +1148,7 @@ UniValue name_show(const UniValue& params, bool fHelp)
         if (!file.is_open())
             throw JSONRPCError(RPC_PARSE_ERROR, "Failed to open file. Check if you have permission to open it.");
 
-        file.write((const char*)&nti.value[0], nti.value.size());
+        file.write((const char*)&value[0], value.size());
         file.close();
     }
 
@@ -621,7 +1193,7 @@ UniValue name_history (const UniValue& params, bool fHelp)
     CNameRecord nameRec;
     {
         LOCK(cs_main);
-        CNameDB dbName("r");
+        CNameDB& dbName = *pnameDB;
         if (!dbName.ReadName(name, nameRec))
             throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read from name DB");
     }
@@ -635,26 +1207,20 @@ UniValue name_history (const UniValue& params, bool fHelp)
     UniValue res(UniValue::VARR);
     for (unsigned int i = fFullHistory ? 0 : nameRec.nLastActiveChainIndex; i < nameRec.vtxPos.size(); i++)
     {
-        CTransaction tx;
-        if (!tx.ReadFromDisk(nameRec.vtxPos[i].txPos))
-            throw JSONRPCError(RPC_DATABASE_ERROR, "could not read transaction from disk");
-
-        NameTxInfo nti;
-        if (!DecodeNameTx(tx, nti, true))
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to decode namecoin transaction");
+        const CNameIndex& txName = nameRec.vtxPos[i];
 
         UniValue obj(UniValue::VOBJ);
-        obj.push_back(Pair("txid",             tx.GetHash().ToString()));
-        obj.push_back(Pair("time",             (boost::int64_t)tx.nLockTime));
-        obj.push_back(Pair("height",           nameRec.vtxPos[i].nHeight));
-        obj.push_back(Pair("address",          nti.strAddress));
-        if (nti.fIsMine)
+        obj.push_back(Pair("txid",             txName.txHash.ToString()));
+        obj.push_back(Pair("time",             (boost::int64_t)txName.nTime));
+        obj.push_back(Pair("height",           txName.nHeight));
+        obj.push_back(Pair("address",          txName.strAddress));
+        if (IsMineNameAddress(txName.strAddress))
             obj.push_back(Pair("address_is_mine",  "true"));
-        obj.push_back(Pair("operation",        stringFromOp(nti.op)));
-        if (nti.op == OP_NAME_UPDATE || nti.op == OP_NAME_NEW || nti.op == OP_NAME_MULTISIG)
-            obj.push_back(Pair("days_added",       nti.nRentalDays));
-        if (nti.op == OP_NAME_UPDATE || nti.op == OP_NAME_NEW || nti.op == OP_NAME_MULTISIG)
-        obj.push_back(Pair("value", encodeNameVal(nti.value, outputType)));
+        obj.push_back(Pair("operation",        stringFromOp(txName.op)));
+        if (txName.op == OP_NAME_UPDATE || txName.op == OP_NAME_NEW || txName.op == OP_NAME_MULTISIG)
+            obj.push_back(Pair("days_added",       txName.nRentalDays));
+        if (txName.op == OP_NAME_UPDATE || txName.op == OP_NAME_NEW || txName.op == OP_NAME_MULTISIG)
+        obj.push_back(Pair("value", encodeNameVal(txName.value, outputType)));
 
         res.push_back(obj);
     }
@@ -691,15 +1257,17 @@ UniValue name_mempool (const UniValue& params, bool fHelp)
     std::string outputType = params.size() > 0 ? params[0].get_str() : "";
 
     UniValue res(UniValue::VARR);
-    BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &pairPending, mapNamePending)
+    std::map<CNameVal, std::set<uint256> > mapMempoolNames;
+    mempool.getNameIndex(mapMempoolNames);
+    BOOST_FOREACH(const PAIRTYPE(CNameVal, std::set<uint256>) &pairPending, mapMempoolNames)
     {
         std::string sName = stringFromNameVal(pairPending.first);
         BOOST_FOREACH(const uint256& hash, pairPending.second)
         {
-            if (!mempool.exists(hash))
+            CTransaction tx;
+            if (!mempool.lookup(hash, tx))
                 continue;
 
-            CTransaction tx = mempool.mapTx.find(hash)->GetTx();
             NameTxInfo nti;
             if (!DecodeNameTx(tx, nti, true))
                 throw JSONRPCError(RPC_DATABASE_ERROR, "failed to decode namecoin transaction");
@@ -733,9 +1301,9 @@ bool mycompare2 (const UniValue& lhs, const UniValue& rhs)
 
 UniValue name_filter(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 6)
+    if (fHelp || params.size() > 7)
         throw std::runtime_error(
-                "name_filter [regexp] [maxage=0] [from=0] [nb=0] [stat] [valuetype]\n"
+                "name_filter [regexp] [maxage=0] [from=0] [nb=0] [stat] [valuetype] [start]\n"
                 "scan and filter names\n"
                 "[regexp] : apply [regexp] on names, empty means all names\n"
                 "[maxage] : look in last [maxage] blocks\n"
@@ -743,9 +1311,11 @@ UniValue name_filter(const UniValue& params, bool fHelp)
                 "[nb] : show [nb] results, 0 means all\n"
                 "[stat] : show some stats instead of results\n"
                 "[valuetype] : if \"hex\" or \"base64\" is specified then it will print value in corresponding format instead of string.\n"                
+                "[start] : page through the names in name order, only names after [start] are shown and \"next\" is the [start] of the next page\n"
                 "name_filter \"\" 5 # list names updated in last 5 blocks\n"
                 "name_filter \"^id/\" # list all names from the \"id\" namespace\n"
                 "name_filter \"^id/\" 0 0 0 stat # display stats (number of names) on active names from the \"id\" namespace\n"
+                "name_filter \"^id/\" 0 0 100 \"\" \"\" \"\" # list the first 100 names from the \"id\" namespace and where to continue\n"
                 );
 
     if (IsInitialBlockDownload())
@@ -761,24 +1331,26 @@ UniValue name_filter(const UniValue& params, bool fHelp)
     int nNb           = params.size() > 3 ? params[3].get_int() : 0;
     bool fStat        = params.size() > 4 ? (params[4].get_str() == "stat" ? true : false) : false;
     std::string outputType = params.size() > 5 ? params[5].get_str() : "";
+    bool fPaged       = params.size() > 6;
+    CNameVal nameStart = fPaged ? nameValFromString(params[6].get_str()) : CNameVal();
 
-    CNameDB dbName("r");
     std::vector<UniValue> oRes;
 
-    CNameVal name;
-    std::vector<std::pair<CNameVal, std::pair<CNameIndex,int> > > nameScan;
-    if (!dbName.ScanNames(name, 100000000, nameScan))
-        throw JSONRPCError(RPC_WALLET_ERROR, "scan failed");
-
     // compile regex once
     using namespace boost::xpressive;
     smatch nameparts;
     sregex cregex = sregex::compile(strRegexp);
 
-    std::pair<CNameVal, std::pair<CNameIndex,int> > pairScan;
-    BOOST_FOREACH(pairScan, nameScan)
+    // only the names starting with the literal text the regex is anchored to are read
+    CNameVal prefix = nameValFromString(GetRegexLiteralPrefix(strRegexp));
+
+    std::string strNext, strLast;
+    for (CNameIterator it(*pnameDB, nameStart, prefix); it.Valid(); it.Next())
     {
-        std::string name = stringFromNameVal(pairScan.first);
+        if (fPaged && it.GetName() == nameStart)
+            continue;
+
+        std::string name = stringFromNameVal(it.GetName());
 
         //don't show multisig names
         if (name.length() >= 8 && name.substr(0,8) == "address:")
@@ -792,11 +1364,8 @@ UniValue name_filter(const UniValue& params, bool fHelp)
         if(strRegexp != "" && !regex_search(name, nameparts, cregex))
             continue;
 
-        CNameIndex txName = pairScan.second.first;
-
-        CNameRecord nameRec;
-        if (!dbName.ReadName(pairScan.first, nameRec))
-            continue;
+        const CNameRecord& nameRec = it.GetRecord();
+        const CNameIndex& txName = nameRec.vtxPos.back();
 
         // max age
         int nHeight = nameRec.vtxPos[nameRec.nLastActiveChainIndex].nHeight;
@@ -808,6 +1377,13 @@ UniValue name_filter(const UniValue& params, bool fHelp)
         if(nCountFrom < nFrom + 1)
             continue;
 
+        // a full page only points to the next one if another name matches
+        if (nNb > 0 && nCountNb >= nNb)
+        {
+            strNext = strLast;
+            break;
+        }
+
         UniValue oName(UniValue::VOBJ);
         if (!fStat) {
             oName.push_back(Pair("name", name));
@@ -823,27 +1399,37 @@ UniValue name_filter(const UniValue& params, bool fHelp)
         oRes.push_back(oName);
 
         nCountNb++;
-        // nb limits
-        if(nNb > 0 && nCountNb >= nNb)
+        strLast = name;
+        // nb limits, pages look one name further
+        if(!fPaged && nNb > 0 && nCountNb >= nNb)
             break;
     }
 
     UniValue oRes2(UniValue::VARR);
-    if (!fStat)
-    {
-        std::sort(oRes.begin(), oRes.end(), mycompare2); //sort by nHeight
-        BOOST_FOREACH(const UniValue& res, oRes)
-            oRes2.push_back(res);
-    }
-    else
+    if (fStat)
     {
         UniValue oStat(UniValue::VOBJ);
         oStat.push_back(Pair("blocks",    chainActive.Height()));
-        oStat.push_back(Pair("count",     (int)oRes2.size()));
+        oStat.push_back(Pair("count",     (int)oRes.size()));
         //oStat.push_back(Pair("sha256sum", SHA256(oRes), true));
         return oStat;
     }
 
+    // pages stay in name order
+    if (!fPaged)
+        std::sort(oRes.begin(), oRes.end(), mycompare2); //sort by nHeight
+    BOOST_FOREACH(const UniValue& res, oRes)
+        oRes2.push_back(res);
+
+    if (fPaged)
+    {
+        UniValue oPage(UniValue::VOBJ);
+        oPage.push_back(Pair("names", oRes2));
+        if (!strNext.empty())
+            oPage.push_back(Pair("next", strNext));
+        return oPage;
+    }
+
     return oRes2;
 }
 
@@ -866,7 +1452,7 @@ UniValue name_scan(const UniValue& params, bool fHelp)
     int mMaxShownValue = params.size() > 2 ? params[2].get_int() : 0;
     std::string outputType  = params.size() > 3 ? params[3].get_str() : "";
 
-    CNameDB dbName("r");
+    CNameDB& dbName = *pnameDB;
     UniValue oRes(UniValue::VARR);
 
     std::vector<std::pair<CNameVal, std::pair<CNameIndex,int> > > nameScan;
@@ -1143,10 +1729,11 @@ NameTxReturn name_operation(const int op, const CNameVal& name, CNameVal value,
         LOCK2(cs_main, pwalletMain->cs_wallet);
 
         // wait until other name operation on this name are completed
-        if (mapNamePending.count(name) && mapNamePending[name].size())
+        std::set<uint256> setPending;
+        if (mempool.getNameIndex(name, setPending))
         {
-            ss << "there are " << mapNamePending[name].size() <<
-                  " pending operations on that name, including " << mapNamePending[name].begin()->GetHex();
+            ss << "there are " << setPending.size() <<
+                  " pending operations on that name, including " << setPending.begin()->GetHex();
             ret.err_msg = ss.str();
             return ret;
         }
@@ -1173,7 +1760,7 @@ NameTxReturn name_operation(const int op, const CNameVal& name, CNameVal value,
         CWalletTx wtxIn = CWalletTx();
         if (op == OP_NAME_UPDATE || op == OP_NAME_DELETE)
         {
-            CNameDB dbName("r");
+            CNameDB& dbName = *pnameDB;
             CTransaction prevTx;
             CNameRecord nameRec;
             if (!GetLastTxOfName(dbName, name, prevTx, nameRec))
@@ -1267,54 +1854,136 @@ NameTxReturn name_operation(const int op, const CNameVal& name, CNameVal value,
     return ret;
 }
 
-bool createNameIndexFile()
+// Name txs of one block as prepared by the rebuild workers
+struct CNameRebuildBlock
 {
-    LogPrintf("Scanning blockchain for names to create fast index...\n");
-    CNameDB dbName("cr+");
+    struct CNameRebuildTx
+    {
+        CTransaction tx;
+        CDiskTxPos pos;
+        CAmount fee;
+    };
 
-    if (!fTxIndex)
-        return error("createNameIndexFile() : transaction index not available");
+    std::vector<CNameRebuildTx> vTx;
+    std::string strError;
+};
 
-    int maxHeight = chainActive.Height();
-    for (int nHeight=0; nHeight<=maxHeight; nHeight++)
+// Reads the block and keeps its name txs together with their position and fee. Fees are looked up
+// through the tx index directly, without GetTransaction and its cs_main lock.
+static void PrepareNameRebuildBlock(const CBlockIndex* pindex, CNameRebuildBlock& result)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
     {
-        CBlockIndex* pindex = chainActive[nHeight];
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("createNameIndexFile() : *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        result.strError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        return;
+    }
 
-        // collect name tx from block
-        std::vector<nameTempProxy> vName;
-        CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())); // start position
-        for (unsigned int i=0; i<block.vtx.size(); i++)
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())); // start position
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+        if (tx.IsCoinBase() || tx.nVersion != NAMECOIN_TX_VERSION)
         {
-            const CTransaction& tx = block.vtx[i];
-            if (tx.IsCoinBase())
+            pos.nTxOffset += nTxSize; // set next tx position
+            continue;
+        }
+
+        CAmount input = 0;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            CDiskTxPos posPrev;
+            CTransaction txPrev;
+            if (!pblocktree->ReadTxIndex(txin.prevout.hash, posPrev) || !txPrev.ReadFromDisk(posPrev) ||
+                txin.prevout.n >= txPrev.vout.size())
             {
-                pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);  // set next tx position
-                continue;
+                result.strError = strprintf("prev transaction %s of %s not found", txin.prevout.hash.GetHex(), tx.GetHash().GetHex());
+                return;
             }
+            input += txPrev.vout[txin.prevout.n].nValue;
+        }
 
-            // calculate tx fee
-            CAmount input = 0;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                CTransaction txPrev;
-                uint256 hashBlock = uint256S("0");
-                if (!GetTransaction(txin.prevout.hash, txPrev, Params().GetConsensus(), hashBlock))
-                    return error("createNameIndexFile() : prev transaction not found");
+        CNameRebuildBlock::CNameRebuildTx nameTx;
+        nameTx.tx = tx;
+        nameTx.pos = pos;
+        nameTx.fee = input - tx.GetValueOut();
+        result.vTx.push_back(nameTx);
+        pos.nTxOffset += nTxSize;
+    }
+}
 
-                input += txPrev.vout[txin.prevout.n].nValue;
-            }
-            CAmount fee = input - tx.GetValueOut();
+static void ThreadPrepareNameRebuild(const std::vector<CBlockIndex*>* pvBlocks, std::vector<CNameRebuildBlock>* pvResults, std::atomic<size_t>* pnNext)
+{
+    size_t i;
+    while ((i = (*pnNext)++) < pvBlocks->size())
+        PrepareNameRebuildBlock((*pvBlocks)[i], (*pvResults)[i]);
+}
+
+// Builds the name index from the block files. Blocks are read and their name txs prepared by several
+// threads, a window of blocks at a time; the name ops are then applied in height order. Changes are
+// flushed together with the best block every few windows, so an interrupted rebuild resumes there.
+bool createNameIndexFile(int nFromHeight)
+{
+    LogPrintf("Scanning blockchain for names to create fast index...\n");
 
-            hooks->CheckInputs(tx, pindex, vName, pos, fee);                    // collect valid name tx to vName
-            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);  // set next tx position
+    if (!fTxIndex)
+        return error("createNameIndexFile() : transaction index not available");
+
+    if (nFromHeight == 0)
+    {
+        if (!pnameDB->WriteVersion(NAMEINDEX_VERSION))
+            return error("createNameIndexFile() : failed to write name index version");
+    }
+
+    int nThreads = GetArg("-nameindexthreads", GetNumCores());
+    nThreads = std::max(1, std::min(nThreads, MAX_NAMEINDEX_THREADS));
+    int64_t nStart = GetTimeMillis();
+    int maxHeight = chainActive.Height();
+    for (int nWindow = nFromHeight; nWindow <= maxHeight; nWindow += NAMEINDEX_REBUILD_WINDOW)
+    {
+        std::vector<CBlockIndex*> vBlocks;
+        for (int nHeight = nWindow; nHeight <= std::min(maxHeight, nWindow + NAMEINDEX_REBUILD_WINDOW - 1); nHeight++)
+            vBlocks.push_back(chainActive[nHeight]);
+
+        std::vector<CNameRebuildBlock> vResults(vBlocks.size());
+        std::atomic<size_t> nNext(0);
+        boost::thread_group workers;
+        for (int i = 0; i < nThreads; i++)
+            workers.create_thread(boost::bind(&ThreadPrepareNameRebuild, &vBlocks, &vResults, &nNext));
+        workers.join_all();
+
+        for (size_t i = 0; i < vBlocks.size(); i++)
+        {
+            CBlockIndex* pindex = vBlocks[i];
+            if (!vResults[i].strError.empty())
+                return error("createNameIndexFile() : %s", vResults[i].strError);
+
+            // collect valid name tx to vName and execute the name operations, if any. Rejected name ops
+            // are skipped like in ConnectBlock, a name DB that cannot be read stops the rebuild.
+            std::vector<nameTempProxy> vName;
+            BOOST_FOREACH(const CNameRebuildBlock::CNameRebuildTx& nameTx, vResults[i].vTx)
+            {
+                bool fDBError = false;
+                if (!CheckNameInputs(nameTx.tx, pindex, vName, nameTx.pos, nameTx.fee, fDBError) && fDBError)
+                    return error("createNameIndexFile() : failed to read from name DB at height %d", pindex->nHeight);
+            }
+            if (!hooks->ConnectBlock(pindex, vName))
+                return error("createNameIndexFile() : failed to connect the names of block %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
 
-        // execute name operations, if any
-        hooks->ConnectBlock(pindex, vName);
+        // keep the buffered changes small, written as one sorted batch
+        int nDone = nWindow + vBlocks.size();
+        if (nDone > maxHeight || (nDone - nFromHeight) % NAMEINDEX_REBUILD_FLUSH == 0)
+        {
+            if (!pnameDB->FlushNames())
+                return error("createNameIndexFile() : failed to write to name DB");
+            LogPrintf("Name index: %d of %d blocks scanned, %.1fs\n", nDone, maxHeight + 1, (GetTimeMillis() - nStart) * 0.001);
+            if (ShutdownRequested())
+                return error("createNameIndexFile() : interrupted, the name index will resume at height %d", nDone);
+        }
     }
+    if (!pnameDB->FlushNames())
+        return error("createNameIndexFile() : failed to write to name DB");
     return true;
 }
 
@@ -1369,36 +2038,17 @@ int IndexOfNameOutput(const CTransaction& tx)
     return nti.nOut;
 }
 
-void CNamecoinHooks::AddToPendingNames(const CTransaction& tx)
-{
-    if (tx.nVersion != NAMECOIN_TX_VERSION)
-        return;
-
-    CCoins coins;
-    if (pcoinsTip->GetCoins(tx.GetHash(), coins)) // try to ignore coins that are in blockchain
-        return;
-
-    if (tx.vout.size() < 1)
-    {
-        error("AddToPendingNames() : no output in tx %s\n", tx.ToString());
-        return;
-    }
-
-    NameTxInfo nti;
-    if (!DecodeNameTx(tx, nti))
-    {
-        error("AddToPendingNames() : could not decode name script in tx %s", tx.ToString());
-        return;
-    }
-
-    mapNamePending[nti.name].insert(tx.GetHash());
-    LogPrintf("AddToPendingNames(): added %s %s from tx %s", stringFromOp(nti.op), stringFromNameVal(nti.name), tx.ToString());
-}
-
 // Checks name tx and save name data to vName if valid
 // returns true if: (tx is valid name tx) OR (tx is not a name tx)
 // returns false if tx is invalid name tx
 bool CNamecoinHooks::CheckInputs(const CTransaction& tx, const CBlockIndex* pindexBlock, std::vector<nameTempProxy> &vName, const CDiskTxPos& pos, const CAmount& txFee)
+{
+    bool fDBError = false;
+    return CheckNameInputs(tx, pindexBlock, vName, pos, txFee, fDBError);
+}
+
+// fDBError tells a name DB failure apart from a rejected name op
+static bool CheckNameInputs(const CTransaction& tx, const CBlockIndex* pindexBlock, std::vector<nameTempProxy> &vName, const CDiskTxPos& pos, const CAmount& txFee, bool& fDBError)
 {
     if (tx.nVersion != NAMECOIN_TX_VERSION)
         return true;
@@ -1418,25 +2068,25 @@ bool CNamecoinHooks::CheckInputs(const CTransaction& tx, const CBlockIndex* pind
         sName % tx.GetHash().GetHex() % pindexBlock->nHeight % stringFromNameVal(nti.value));
 
 //check if last known tx on this name matches any of inputs of this tx
-    CNameDB dbName("r");
+    CNameDB& dbName = *pnameDB;
     CNameRecord nameRec;
     if (dbName.ExistsName(name) && !dbName.ReadName(name, nameRec))
+    {
+        fDBError = true;
         return error("CheckInputsHook() : failed to read from name DB for %s", info);
+    }
 
+    // the record is keyed by name, so the last known tx is always an op on this same name
     bool found = false;
-    NameTxInfo prev_nti;
+    int prevOp = -1;
     if (!nameRec.vtxPos.empty() && !nameRec.deleted())
     {
-        CTransaction lastKnownNameTx;
-        if (!lastKnownNameTx.ReadFromDisk(nameRec.vtxPos.back().txPos))
-            return error("CheckInputsHook() : failed to read from name DB for %s", info);
-        uint256 lasthash = lastKnownNameTx.GetHash();
-        if (!DecodeNameTx(lastKnownNameTx, prev_nti))
-            return error("CheckInputsHook() : Failed to decode existing previous name tx for %s. Your blockchain or nameindex.dat may be corrupt.", info);
+        const CNameIndex& lastKnown = nameRec.vtxPos.back();
+        prevOp = lastKnown.op;
 
         for (unsigned int i = 0; i < tx.vin.size(); i++) //this scans all scripts of tx.vin
         {
-            if (tx.vin[i].prevout.hash != lasthash)
+            if (tx.vin[i].prevout.hash != lastKnown.txHash)
                 continue;
             found = true;
             break;
@@ -1490,24 +2140,18 @@ bool CNamecoinHooks::CheckInputs(const CTransaction& tx, const CBlockIndex* pind
                 return false;
             }
 
-            if (!found || (prev_nti.op != OP_NAME_NEW && prev_nti.op != OP_NAME_UPDATE))
+            if (!found || (prevOp != OP_NAME_NEW && prevOp != OP_NAME_UPDATE))
                 return error("name_update without previous new or update tx for %s", info);
 
-            if (prev_nti.name != name)
-                return error("CheckInputsHook() : name_update name mismatch for %s", info);
-
             if (!NameActive(dbName, name, pindexBlock->nHeight))
                 return error("CheckInputsHook() : name_update on an unexpired name for %s", info);
             break;
         }
         case OP_NAME_DELETE:
         {
-            if (!found || (prev_nti.op != OP_NAME_NEW && prev_nti.op != OP_NAME_UPDATE))
+            if (!found || (prevOp != OP_NAME_NEW && prevOp != OP_NAME_UPDATE))
                 return error("name_delete without previous new or update tx, for %s", info);
 
-            if (prev_nti.name != name)
-                return error("CheckInputsHook() : name_delete name mismatch for %s", info);
-
             if (!NameActive(dbName, name, pindexBlock->nHeight))
                 return error("CheckInputsHook() : name_delete on expired name for %s", info);
             break;
@@ -1519,8 +2163,13 @@ bool CNamecoinHooks::CheckInputs(const CTransaction& tx, const CBlockIndex* pind
     // all checks passed - record tx information to vName. It will be sorted by nTime and writen to nameindex.dat at the end of ConnectBlock
     CNameIndex txPos2;
     txPos2.nHeight = pindexBlock->nHeight;
+    txPos2.op = nti.op;
     txPos2.value = nti.value;
     txPos2.txPos = pos;
+    txPos2.txHash = tx.GetHash();
+    txPos2.strAddress = NameOutputAddress(tx.vout[nti.nOut]);
+    txPos2.nRentalDays = nti.nRentalDays;
+    txPos2.nTime = tx.nLockTime;
 
     nameTempProxy tmp;
     tmp.nTime = tx.nLockTime;
@@ -1543,27 +2192,36 @@ bool CNamecoinHooks::DisconnectInputs(const CTransaction& tx)
         return error("DisconnectInputsHook() : could not decode namecoin tx");
 
     {
-        CNameDB dbName("cr+");
-        dbName.TxnBegin();
+        // a rejected op of a name that was never registered left nothing to undo
+        if (!pnameDB->ExistsName(nti.name))
+            return true;
 
         CNameRecord nameRec;
-        if (!dbName.ReadName(nti.name, nameRec))
+        if (!pnameDB->ReadName(nti.name, nameRec))
             return error("DisconnectInputsHook() : failed to read from name DB");
 
         // vtxPos might be empty if we pruned expired transactions.  However, it should normally still not
         // be empty, since a reorg cannot go that far back.  Be safe anyway and do not try to pop if empty.
         if (nameRec.vtxPos.size() > 0)
         {
-            // check if tx matches last tx in nameindex.dat
-            CTransaction lastTx;
-            lastTx.ReadFromDisk(nameRec.vtxPos.back().txPos);
-            assert(lastTx.GetHash() == tx.GetHash());
+            // blocks are disconnected in reverse order, so an applied tx is always the last one in the index.
+            // Rejected and duplicate name ops were never added and are left alone.
+            if (nameRec.vtxPos.back().txHash != tx.GetHash())
+            {
+                LogPrint("names", "DisconnectInputsHook() : %s was not applied to %s, nothing to undo\n",
+                    tx.GetHash().ToString(), stringFromNameVal(nti.name));
+                return true;
+            }
 
             // remove tx
             nameRec.vtxPos.pop_back();
 
             if (nameRec.vtxPos.size() == 0) // delete empty record
-                return dbName.EraseName(nti.name);
+            {
+                nameCache.Erase(nti.name);
+                pnameDB->EraseName(nti.name);
+                return true;
+            }
 
             // if we have deleted name_new - recalculate Last Active Chain Index
             if (nti.op == OP_NAME_NEW || nti.op == OP_NAME_MULTISIG)
@@ -1575,19 +2233,34 @@ bool CNamecoinHooks::DisconnectInputs(const CTransaction& tx)
                     }
         }
         else
-            return dbName.EraseName(nti.name); // delete empty record
+        {
+            nameCache.Erase(nti.name);
+            pnameDB->EraseName(nti.name); // delete empty record
+            return true;
+        }
 
         if (!CalculateExpiresAt(nameRec))
             return error("DisconnectInputsHook() : failed to calculate expiration time before writing to name DB");
-        if (!dbName.WriteName(nti.name, nameRec))
-            return error("DisconnectInputsHook() : failed to write to name DB");
-
-        dbName.TxnCommit();
+        pnameDB->WriteName(nti.name, nameRec);
+        nameCache.Update(nti.name, nameRec);
     }
 
     return true;
 }
 
+bool CNamecoinHooks::DisconnectBlock(const CBlockIndex* pindex)
+{
+    if (!pnameDB)
+        return true;
+    pnameDB->SetBestBlock(pindex->pprev->GetBlockHash());
+    return true;
+}
+
+bool CNamecoinHooks::FlushNames()
+{
+    return !pnameDB || pnameDB->FlushNames();
+}
+
 std::string stringFromOp(int op)
 {
     switch (op)
@@ -1620,21 +2293,24 @@ bool CNamecoinHooks::ExtractAddress(const CScript& script, std::string& address)
 // NOTE: the block should already be written to blockchain by now - otherwise this may fail.
 bool CNamecoinHooks::ConnectBlock(CBlockIndex* pindex, const std::vector<nameTempProxy> &vName)
 {
+    // the name index is opened after the genesis block got connected, it catches up by itself
+    if (!pnameDB)
+        return true;
+
+    // the name ops of this block are written together with its hash when the chainstate is flushed
+    pnameDB->SetBestBlock(pindex->GetBlockHash());
     if (vName.empty())
         return true;
 
-    // All of these name ops should succed. If there is an error - nameindex.dat is probably corrupt.
-    CNameDB dbName("r+");
+    // All of these name ops should succed. If there is an error - the name index is probably corrupt.
     std::set<CNameVal> sNameNew;
 
     BOOST_FOREACH(const nameTempProxy& i, vName)
     {
         CNameRecord nameRec;
-        if (dbName.ExistsName(i.name) && !dbName.ReadName(i.name, nameRec))
+        if (pnameDB->ExistsName(i.name) && !pnameDB->ReadName(i.name, nameRec))
             return error("ConnectBlockHook() : failed to read from name DB");
 
-        dbName.TxnBegin();
-
         // only first name_new for same name in same block will get written
         if  ((i.op == OP_NAME_NEW || i.op == OP_NAME_MULTISIG) && sNameNew.count(i.name))
             continue;
@@ -1664,25 +2340,19 @@ bool CNamecoinHooks::ConnectBlock(CBlockIndex* pindex, const std::vector<nameTem
 
         if (!CalculateExpiresAt(nameRec))
             return error("ConnectBlockHook() : failed to calculate expiration time before writing to name DB for %s", i.hash.GetHex());
-        if (!dbName.WriteName(i.name, nameRec))
-            return error("ConnectBlockHook() : failed to write to name DB");
+        pnameDB->WriteName(i.name, nameRec);
         if  (i.op == OP_NAME_NEW || i.op == OP_NAME_MULTISIG)
             sNameNew.insert(i.name);
-        LogPrintf("ConnectBlockHook(): writing %s %s in block %d to ddns.dat\n", stringFromOp(i.op), stringFromNameVal(i.name), pindex->nHeight);
+        LogPrintf("ConnectBlockHook(): writing %s %s in block %d to the name index\n", stringFromOp(i.op), stringFromNameVal(i.name), pindex->nHeight);
+        nameCache.Update(i.name, nameRec);
+        nameBloom.Insert(i.name);
+    }
 
-        {
-            // remove from pending names list
-            LOCK(cs_main);
-            std::map<CNameVal, std::set<uint256> >::iterator mi = mapNamePending.find(i.name);
-            if (mi != mapNamePending.end())
-            {
-                mi->second.erase(i.hash);
-                if (mi->second.empty())
-                    mapNamePending.erase(i.name);
-            }
-        }
-        if (!dbName.TxnCommit())
-            return error("ConnectBlockHook(): failed to write %s to name DB", stringFromNameVal(i.name));
+    // the false positive rate grows with every new name, resize once it is far off the target
+    if (nameBloom.IsOverfull())
+    {
+        extern bool fillNameBloom();
+        fillNameBloom();
     }
 
     return true;
@@ -1696,44 +2366,45 @@ bool CNamecoinHooks::IsNameScript(CScript scr)
 
 bool CNamecoinHooks::getNameValue(const std::string& sName, std::string& sValue)
 {
-    CNameVal name = nameValFromString(sName);
-    CNameDB dbName("r");
-    if (!dbName.ExistsName(name))
-        return false;
-
-    CTransaction tx;
-    NameTxInfo nti;
-    if (!(GetLastTxOfName(dbName, name, tx) && DecodeNameTx(tx, nti, true)))
-        return false;
-
-    if (!NameActive(dbName, name))
+    CNameVal value;
+    if (!GetNameValue(nameValFromString(sName), value))
         return false;
 
-    sValue = stringFromNameVal(nti.value);
-
+    sValue = stringFromNameVal(value);
     return true;
 }
 
 bool GetNameValue(const CNameVal& name, CNameVal& value)
 {
-    CNameDB dbName("r");
-    CNameRecord nameRec;
+    CNameVal cachedValue;
+    int nExpiresAt;
+    if (!nameCache.Get(name, cachedValue, nExpiresAt))
+    {
+        if (nameCache.IsComplete())
+            return false; // every name is cached, this one doesn't exist
+        if (!nameBloom.MayContain(name))
+            return false; // never registered
 
-    if (!NameActive(name))
-        return false;
-    if (!dbName.ReadName(name, nameRec))
-        return false;
-    if (nameRec.vtxPos.empty())
+        CNameRecord nameRec;
+        if (!pnameDB->ReadName(name, nameRec))
+            return false;
+        nameCache.Update(name, nameRec, true);
+        if (nameRec.deleted())
+            return false;
+        cachedValue = nameRec.vtxPos.back().value;
+        nExpiresAt = nameRec.nExpiresAt;
+    }
+
+    if (nExpiresAt < 0 || chainActive.Height() > nExpiresAt)
         return false;
 
-    value = nameRec.vtxPos.back().value;
+    value = cachedValue;
     return true;
 }
 
 bool CNamecoinHooks::DumpToTextFile()
 {
-    CNameDB dbName("r");
-    return dbName.DumpToTextFile();
+    return pnameDB->DumpToTextFile();
 }
 
 
@@ -1743,52 +2414,34 @@ bool CNameDB::DumpToTextFile()
     if (!myfile.is_open())
         return false;
 
-    Dbc* pcursor = GetCursor();
-    if (!pcursor)
-        return false;
-
-    CNameVal name;
-    unsigned int fFlags = DB_SET_RANGE;
-    while (true)
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(CNameKey("namer", CNameVal()));
+    for (; pcursor->Valid(); pcursor->Next())
     {
-        // Read next record
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        if (fFlags == DB_SET_RANGE)
-            ssKey << std::make_pair(std::string("namei"), name);
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
-        fFlags = DB_NEXT;
-        if (ret == DB_NOTFOUND)
+        CNameKey key;
+        if (!pcursor->GetKey(key) || key.strType != "namer")
             break;
-        else if (ret != 0)
+
+        const CNameVal& name2 = key.name;
+        CNameRecord val;
+        if (!pcursor->GetValue(val))
             return false;
+        if (val.vtxPos.empty())
+            continue;
 
-        // Unserialize
-        std::string strType;
-        ssKey >> strType;
-        if (strType == "namei")
+        myfile << "name =  " << stringFromNameVal(name2) << "\n";
+        myfile << "nExpiresAt " << val.nExpiresAt << "\n";
+        myfile << "nLastActiveChainIndex " << val.nLastActiveChainIndex << "\n";
+        myfile << "vtxPos:\n";
+        for (unsigned int i = 0; i < val.vtxPos.size(); i++)
         {
-            CNameVal name2;
-            ssKey >> name2;
-            CNameRecord val;
-            ssValue >> val;
-            if (val.vtxPos.empty())
-                continue;
-
-            myfile << "name =  " << stringFromNameVal(name2) << "\n";
-            myfile << "nExpiresAt " << val.nExpiresAt << "\n";
-            myfile << "nLastActiveChainIndex " << val.nLastActiveChainIndex << "\n";
-            myfile << "vtxPos:\n";
-            for (unsigned int i = 0; i < val.vtxPos.size(); i++)
-            {
-                myfile << "    nHeight = " << val.vtxPos[i].nHeight << "\n";
-                myfile << "    op = " << val.vtxPos[i].op << "\n";
-                myfile << "    value = " << stringFromNameVal(val.vtxPos[i].value) << "\n";
-            }
-            myfile << "\n\n";
+            myfile << "    nHeight = " << val.vtxPos[i].nHeight << "\n";
+            myfile << "    op = " << val.vtxPos[i].op << "\n";
+            myfile << "    value = " << stringFromNameVal(val.vtxPos[i].value) << "\n";
+            myfile << "    txid = " << val.vtxPos[i].txHash.GetHex() << "\n";
         }
+        myfile << "\n\n";
     }
-    pcursor->close();
     myfile.close();
     return true;
 }
@@ -1823,7 +2476,7 @@ std::string MultiSigGetPubKeyFromAddress(const std::string& strAddress)
     CNameVal nameVal;
     unsigned int nMax = 500;
     
-    CNameDB dbName("r");
+    CNameDB& dbName = *pnameDB;
 
     std::vector<std::pair<CNameVal, std::pair<CNameIndex,int> > > nameScan;
     if (!dbName.ScanNames(nameVal, nMax, nameScan))
@@ -9,16 +9,36 @@
 #define DNS_H
 
 #include "base58.h"
+#include "dbwrapper.h"
 #include "wallet/db.h"
 #include "hooks.h"
 #include "keystore.h"
 #include "validation.h"
 #include "rpcprotocol.h"
+#include "sync.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
 
 class CTxMemPool;
+class CNameCache;
+class CNameBloom;
 
 static const unsigned int NAMEINDEX_CHAIN_SIZE = 1000;
 static const int RELEASE_HEIGHT = 1<<16;
+static const unsigned int DEFAULT_NAME_CACHE_SIZE = 100000;
+//! blocks prepared in parallel per step of a name index rebuild, and blocks per flush of the rebuilt index
+static const int NAMEINDEX_REBUILD_WINDOW = 1000;
+static const int NAMEINDEX_REBUILD_FLUSH = 10000;
+static const int MAX_NAMEINDEX_THREADS = 16;
+//! default false positive rate and max. size (MiB) of the filter over registered names, 0 MiB disables it
+static const double DEFAULT_NAME_BLOOM_FPRATE = 0.001;
+static const unsigned int DEFAULT_NAME_BLOOM_MAXMEM = 16;
+// name index format, version 2 orders the records by name (see CNameKey). Older indexes are rebuilt.
+static const int NAMEINDEX_VERSION = 2;
+//! max. -dbcache (MiB) used for the name index database
+static const int64_t nMaxNameDBCache = 16;
 static const unsigned int NAME_REGISTRATION_DAILY_FEE = 1000000; // Current set to 0.3 DYN per month or 3.65 DYN per year.
 
 class CNameIndex
@@ -28,11 +48,16 @@ public:
     int nHeight;
     int op;
     CNameVal value;
+    // decoded from the name tx when it gets indexed, so that readers never go back to the block files
+    uint256 txHash;
+    std::string strAddress;
+    int nRentalDays;
+    uint32_t nTime;
 
-    CNameIndex() : nHeight(0), op(0) {}
+    CNameIndex() : nHeight(0), op(0), nRentalDays(0), nTime(0) {}
 
     CNameIndex(CDiskTxPos txPos, int nHeight, CNameVal value) :
-        txPos(txPos), nHeight(nHeight), value(value) {}
+        txPos(txPos), nHeight(nHeight), op(0), value(value), nRentalDays(0), nTime(0) {}
 
     ADD_SERIALIZE_METHODS;
 
@@ -42,6 +67,10 @@ public:
         READWRITE(nHeight);
         READWRITE(op);
         READWRITE(value);
+        READWRITE(txHash);
+        READWRITE(strAddress);
+        READWRITE(nRentalDays);
+        READWRITE(nTime);
     }
 };
 
@@ -54,7 +83,7 @@ public:
     int nLastActiveChainIndex;  // position in vtxPos of first tx in last active chain of name_new -> name_update -> name_update -> ....
 
     CNameRecord() : nExpiresAt(0), nLastActiveChainIndex(0) {}
-    bool deleted()
+    bool deleted() const
     {
         if (!vtxPos.empty())
             return vtxPos.back().op == OP_NAME_DELETE;
@@ -71,28 +100,72 @@ public:
     }
 };
 
-class CNameDB : public CDB
+// Key of a name record in the name index. The name is written last and without a length prefix,
+// so that records are ordered by name and names sharing a prefix are stored next to each other.
+struct CNameKey
 {
-public:
-    CNameDB(const char* pszMode="r+") : CDB("ddns.dat", pszMode) {}
+    std::string strType;
+    CNameVal name;
 
-    bool WriteName(const CNameVal& name, const CNameRecord& rec)
-    {
-        return Write(make_pair(std::string("namei"), name), rec);
+    CNameKey() {}
+    CNameKey(const std::string& strTypeIn, const CNameVal& nameIn) : strType(strTypeIn), name(nameIn) {}
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return ::GetSerializeSize(strType, nType, nVersion) + name.size();
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ::Serialize(s, strType, nType, nVersion);
+        if (!name.empty())
+            s.write((const char*)&name[0], name.size());
     }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        ::Unserialize(s, strType, nType, nVersion);
+        name.resize(s.size());
+        if (!name.empty())
+            s.read((char*)&name[0], name.size());
+    }
+};
 
+// Name index database (<datadir>/ddns). Name ops of connected and disconnected blocks are kept in
+// memory and written in one batch with the best block when the chainstate is flushed, so that the
+// index on disk always belongs to a single block. InitNameIndex catches it up with the chainstate tip.
+class CNameDB : public CDBWrapper
+{
+private:
+    mutable CCriticalSection cs;
+    // records changed since the last flush, an empty record stands for an erased name
+    std::map<CNameVal, CNameRecord> mapDirty;
+    uint256 hashBestBlock;
+    // set once a corrupt record was read, keeps the best block out of the index until it is rebuilt
+    bool fCorrupt;
+
+public:
+    CNameDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    void WriteName(const CNameVal& name, const CNameRecord& rec);
     bool ReadName(const CNameVal& name, CNameRecord& rec);
+    bool ExistsName(const CNameVal& name);
+    void EraseName(const CNameVal& name);
+
+    void SetBestBlock(const uint256& hash);
+    uint256 GetBestBlock();
+    bool FlushNames();
 
-    bool ExistsName(const CNameVal& name)
+    bool ReadVersion(int& nVersion)
     {
-        return Exists(make_pair(std::string("namei"), name));
+        return Read(std::string("dbversion"), nVersion);
     }
 
-    bool EraseName(const CNameVal& name)
+    bool WriteVersion(int nVersion)
     {
-        return Erase(make_pair(std::string("namei"), name));
+        return Write(std::string("dbversion"), nVersion, true);
     }
 
+    // copies the records not flushed yet for the names from nameStart on that begin with prefix
+    void GetDirtyNames(const CNameVal& nameStart, const CNameVal& prefix, std::map<CNameVal, CNameRecord>& mapNames);
+
     bool ScanNames(const CNameVal& name, unsigned int nMax,
             std::vector<
                 std::pair<
@@ -102,9 +175,120 @@ public:
             > &nameScan
             );
     bool DumpToTextFile();
+    bool FillNameCache(CNameCache& cache);
+    bool FillNameBloom(CNameBloom& bloom, double nFPRate, size_t nMaxBytes);
+};
+
+// Walks the names of the name index in name order, from a start name on and restricted to the names
+// that begin with a prefix. Records not flushed yet take precedence over the ones on disk, deleted
+// names are skipped. Nothing is read ahead, so stopping early is cheap.
+class CNameIterator
+{
+private:
+    CNameVal prefix;
+    std::unique_ptr<CDBIterator> pcursor;
+    bool fCursorValid;
+    CNameVal cursorName;
+    std::map<CNameVal, CNameRecord> mapDirty;
+    std::map<CNameVal, CNameRecord>::const_iterator itDirty;
+    bool fValid;
+    CNameVal name;
+    CNameRecord rec;
+
+    void LoadKey();
+
+public:
+    CNameIterator(CNameDB& db, const CNameVal& nameStart, const CNameVal& prefix = CNameVal());
+
+    bool Valid() const { return fValid; }
+    void Next();
+    const CNameVal& GetName() const { return name; }
+    const CNameRecord& GetRecord() const { return rec; }
+};
+
+// Returns the literal text every match of an anchored regex starts with, empty if there is none
+std::string GetRegexLiteralPrefix(const std::string& strRegexp);
+
+// Bloom filter over every name in the name index. A name that is not in it doesn't exist, so lookups
+// of made up names (e.g. random subdomain floods against -dyndns) are answered without reading the
+// name index. Names are only ever added; deleted names cost a name index read until the next rebuild.
+class CNameBloom
+{
+private:
+    mutable CCriticalSection cs;
+    std::vector<unsigned char> vData;
+    unsigned int nHashFuncs;
+    uint32_t nTweak;
+    size_t nCapacity; // names the filter was sized for
+    size_t nElements; // names inserted since the last reset
+    std::atomic<uint64_t> nQueries;
+    std::atomic<uint64_t> nRejected;
+
+public:
+    CNameBloom() : nHashFuncs(0), nTweak(0), nCapacity(0), nElements(0), nQueries(0), nRejected(0) {}
+
+    // Sized for nNames names at nFPRate, but no larger than nMaxBytes. Disabled if nMaxBytes is 0.
+    void Reset(size_t nNames, double nFPRate, size_t nMaxBytes);
+    // exchanges the filter contents in one step, the query counters stay
+    void Swap(CNameBloom& other);
+    void Insert(const CNameVal& name);
+    // false only if the name certainly isn't in the name index; always true while disabled
+    bool MayContain(const CNameVal& name);
+
+    bool IsEnabled() const;
+    // true once so many names were added that the false positive rate went well above the target
+    bool IsOverfull() const;
+    size_t GetBytes() const;
+    size_t GetElements() const;
+    double GetFPRate() const; // estimated for the current number of names
+    UniValue GetInfo() const;
+};
+
+// Keeps the current value and expiration height of names in memory, so that resolving
+// a name does not need to read the name index or the name tx from a block file.
+// Filled at startup and kept current by ConnectBlock and DisconnectInputs.
+class CNameCache
+{
+private:
+    struct CNameCacheEntry
+    {
+        CNameVal value;
+        int nExpiresAt;
+        std::list<CNameVal>::iterator itLRU;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<CNameVal, CNameCacheEntry> mapNames;
+    std::list<CNameVal> listLRU; // most recently used names first
+    size_t nMaxSize;
+    // true while every name in the name index is cached, a miss then means that the name doesn't exist
+    bool fComplete;
+    // changes whenever a name changes, answers derived from names are stale once it moved on
+    std::atomic<uint32_t> nGeneration;
+
+    void Insert(const CNameVal& name, const CNameVal& value, int nExpiresAt);
+
+public:
+    CNameCache() : nMaxSize(DEFAULT_NAME_CACHE_SIZE), fComplete(false), nGeneration(0) {}
+
+    void SetMaxSize(size_t nMaxSizeIn);
+    void SetComplete(bool fCompleteIn);
+    bool IsComplete() const;
+    size_t GetSize() const;
+    uint32_t GetGeneration() const { return nGeneration; }
+    void Clear();
+
+    // Record the latest state of a name, called after the record was written to the name index
+    void Update(const CNameVal& name, const CNameRecord& nameRec, bool fOnlyIfMissing = false);
+    void Erase(const CNameVal& name);
+
+    // Returns false if the name is not cached. nExpiresAt is -1 for deleted names.
+    bool Get(const CNameVal& name, CNameVal& value, int& nExpiresAt);
 };
 
-extern std::map<CNameVal, std::set<uint256> > mapNamePending;
+extern CNameCache nameCache;
+extern CNameBloom nameBloom;
+extern CNameDB* pnameDB;
 
 int IndexOfNameOutput(const CTransaction& tx);
 bool GetNameCurrentAddress(const CNameVal& name, CDynamicAddress& address, std::string& error);
@@ -114,8 +298,10 @@ std::string stringFromOp(int op);
 CAmount GetNameOpFee(const unsigned int& nRentalDays, const int& op);
 
 bool DecodeNameTx(const CTransaction& tx, NameTxInfo& nti, bool checkAddressAndIfIsMine = false);
+bool createNameScript(CScript& nameScript, const CNameVal& name, const CNameVal& value, int nRentalDays, int op, std::string& err_msg);
 void GetNameList(const CNameVal& nameUniq, std::map<CNameVal, NameTxInfo>& mapNames, std::map<CNameVal, NameTxInfo>& mapPending);
 bool GetNameValue(const CNameVal& name, CNameVal& value);
+bool InitNameIndex(size_t nCacheSize, bool fWipe = false);
 bool SignNameSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
 std::string MultiSigGetPubKeyFromAddress(const std::string& strAddress);
 
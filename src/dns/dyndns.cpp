@@ -33,6 +33,8 @@
 #include "util.h"
 
 #include <ctype.h>
+#include <functional>
+#include <new>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,16 +47,28 @@
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+// Linux can receive and send a batch of datagrams with one syscall
+#if defined(HAVE_DECL_RECVMMSG) && HAVE_DECL_RECVMMSG && defined(HAVE_DECL_SENDMMSG) && HAVE_DECL_SENDMMSG
+#define DYNDNS_BATCHED_IO
 #endif
 
 /*---------------------------------------------------*/
 
-#define BUF_SIZE (512 + 512)
-#define MAX_OUT  512  // Old DNS restricts UDP to 512 bytes
+#define MAX_OUT      512   // Old DNS restricts UDP to 512 bytes
+#define MAX_OUT_EDNS 4096  // Max UDP answer to EDNS0 clients, also our advertised payload size
+#define MAX_OUT_TCP  16384 // Max answer over TCP
+// Room behind the answer limit for the record that crossed it, before it is rolled back
+#define UDP_BUF_SIZE (MAX_OUT_EDNS + 512)
+#define BUF_SIZE     (MAX_OUT_TCP + 512)
+#define OPT_RR_SIZE  11    // EDNS0 OPT record without options
 #define MAX_TOK  64 // Maximal TokenQty in the vsl_list, like A=IP1,..,IPn
 #define MAX_DOM  20  // Maximal domain level; min 10 is needed for NAPTR E164
 
 #define VAL_SIZE (MAX_VALUE_LENGTH + 16)
+#define BATCH_BUF_SIZE (UDP_BUF_SIZE + 2)
 #define DNS_PREFIX "dns"
 #define REDEF_SYM  '~'
 
@@ -107,13 +121,19 @@ char *strsep(char **s, const char *ct)
 /*---------------------------------------------------*/
 
 DynDns::DynDns(const char *bind_ip, uint16_t port_no,
-   const char *gw_suffix, const char *allowed_suff, const char *local_fname, const char *enums, const char *tollfree, uint8_t verbose) 
-    : m_status(-1), m_thread(StatRun, this) {
+   const char *gw_suffix, const char *allowed_suff, const char *local_fname, const char *enums, const char *tollfree, uint8_t verbose, uint8_t threads, bool tcp) 
+    : m_status(-1), m_sock_owner(true), m_dap_owner(true), m_cache_owner(true), m_tcp(false), m_stopping(false),
+      m_cache(new DNSAnswerCacheShard[DYNDNS_CACHESHARDS]), m_value_len(0), m_batch(NULL), m_thread(StatRun, this) {
 
     // Clear vars [m_hdr..m_verbose)
     memset(&m_hdr, 0, &m_verbose - (uint8_t *)&m_hdr); // Clear previous state
     m_verbose = verbose;
 
+    if(threads < 1)
+      threads = 1;
+    if(threads > DYNDNS_MAXTHREADS)
+      threads = DYNDNS_MAXTHREADS;
+
     // Create and socket
     int ret = socket(PF_INET, SOCK_DGRAM, 0);
     if(ret < 0) {
@@ -122,6 +142,15 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
       m_sockfd = ret;
     }
 
+#ifdef SO_REUSEPORT
+    // Let every resolver thread bind its own socket to the same port,
+    // kernel spreads incoming queries between them
+    if(threads > 1) {
+      int one = 1;
+      setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEPORT, (const char *)&one, sizeof(one));
+    }
+#endif
+
     m_address.sin_family = AF_INET;
     m_address.sin_port = htons(port_no);
 
@@ -134,6 +163,10 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
       throw std::runtime_error(buf);
     }
 
+    // With port 0 the system picks a free port, the workers bind to the same one
+    socklen_t addr_len = sizeof(m_address);
+    getsockname(m_sockfd, (struct sockaddr *) &m_address, &addr_len);
+
     // Create temporary local buf on stack
     int local_len = 0;
     char local_tmp[1 << 15]; // max 32Kb
@@ -170,15 +203,22 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
 
     // Activate DAP only on the public gateways, with some suffixes, like .emergate.net
     // If no memory, DAP inactive - this is not critical problem
-    m_dap_ht  = (allowed_len && m_gw_suf_len)? (DNSAP*)calloc(DYNDNS_DAPSIZE, sizeof(DNSAP)) : NULL; 
+    m_dap_ht  = (allowed_len && m_gw_suf_len)? new (std::nothrow) DNSAP[DYNDNS_DAPSIZE]() : NULL; 
     m_daprand = GetRand(0xffffffff) | 1; 
 
-    m_value  = (char *)malloc(VAL_SIZE + BUF_SIZE + 2 + 
-      m_gw_suf_len + allowed_len + local_len + 4);
+    m_value_len = VAL_SIZE + BUF_SIZE + 2 + BUF_SIZE +
+      m_gw_suf_len + allowed_len + local_len + 4;
+    m_value  = (char *)malloc(m_value_len);
  
     if(m_value == NULL) 
       throw std::runtime_error("DynDns::DynDns: Cannot allocate buffer");
 
+#ifdef DYNDNS_BATCHED_IO
+    m_batch = (uint8_t *)malloc(DYNDNS_BATCH * BATCH_BUF_SIZE);
+    if(m_batch == NULL) 
+      throw std::runtime_error("DynDns::DynDns: Cannot allocate buffer");
+#endif
+
     // Temporary use m_value for parse enum-verifiers and toll-free lists, if exist
     if(enums && *enums) {
       char *str = strcpy(m_value, enums);
@@ -194,7 +234,8 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
     // Assign data buffers inside m_value hyper-array
     m_buf    = (uint8_t *)(m_value + VAL_SIZE);
     m_bufend = m_buf + MAX_OUT;
-    char *varbufs = m_value + VAL_SIZE + BUF_SIZE + 2;
+    m_key    = m_buf + BUF_SIZE + 2;
+    char *varbufs = m_value + VAL_SIZE + BUF_SIZE + 2 + BUF_SIZE;
 
     m_gw_suffix = m_gw_suf_len?
       strcpy(varbufs, gw_suffix) : NULL;
@@ -266,7 +307,7 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
     if(m_verbose > 0)
    LogPrintf("DynDns::DynDns: Created/Attached: %s:%u; Qty=%u:%u\n", 
      m_address.sin_addr.s_addr == INADDR_ANY? "INADDR_ANY" : bind_ip, 
-     port_no, m_allowed_qty, local_qty);
+     GetPort(), m_allowed_qty, local_qty);
 
     // Hack - pass TF file list through m_value to HandlePacket()
 
@@ -277,6 +318,91 @@ DynDns::DynDns(const char *bind_ip, uint16_t port_no,
     } else
       m_value[0] = 0;
 
+    // Start additional resolver threads, each gets its own copy of the
+    // configuration and packet buffers
+    for(uint8_t i = 1; i < threads; i++)
+      m_workers.push_back(new DynDns(this));
+
+    // TCP clients get answers of any size, for records which do not fit into UDP
+    if(tcp)
+      m_workers.push_back(new DynDns(this, true));
+
+    if(m_verbose > 0 && threads > 1)
+      LogPrintf("DynDns::DynDns: Started %u resolver threads\n", threads);
+
+    m_status = 1; // Active, and maybe download
+} // DynDns::DynDns
+
+/*---------------------------------------------------*/
+
+DynDns::DynDns(const DynDns *master, bool tcp)
+    : m_status(-1), m_sock_owner(true), m_dap_owner(false), m_cache_owner(false), m_tcp(tcp), m_stopping(false),
+      m_cache(master->m_cache), m_value_len(master->m_value_len), m_batch(NULL), m_thread(StatRun, this) {
+
+    // Copy configuration vars [m_hdr..m_verbose], DAP hashtable is shared
+    memcpy(&m_hdr, &master->m_hdr, &m_verbose - (uint8_t *)&m_hdr + 1);
+    m_verifiers = master->m_verifiers;
+
+    m_value = (char *)malloc(m_value_len);
+    if(m_value == NULL) 
+      throw std::runtime_error("DynDns::DynDns: Cannot allocate buffer");
+    // Includes suffixes, local names and the deferred toll-free list
+    memcpy(m_value, master->m_value, m_value_len);
+
+#ifdef DYNDNS_BATCHED_IO
+    m_batch = (uint8_t *)malloc(DYNDNS_BATCH * BATCH_BUF_SIZE);
+    if(m_batch == NULL) 
+      throw std::runtime_error("DynDns::DynDns: Cannot allocate buffer");
+#endif
+
+    // Rebase pointers into our own copy of the hyper-array
+    m_buf    = (uint8_t *)m_value + ((char *)master->m_buf - master->m_value);
+    m_bufend = m_buf + MAX_OUT;
+    m_key    = (uint8_t *)m_value + ((char *)master->m_key - master->m_value);
+    if(master->m_gw_suffix)
+      m_gw_suffix = m_value + (master->m_gw_suffix - master->m_value);
+    if(master->m_allowed_base)
+      m_allowed_base = m_value + (master->m_allowed_base - master->m_value);
+    if(master->m_local_base)
+      m_local_base = m_value + (master->m_local_base - master->m_value);
+    m_hdr = NULL;
+    m_snd = m_rcv = m_rcvend = NULL;
+
+    m_sockfd = INVALID_SOCKET;
+    if(m_tcp) {
+      // Listen on the master's address; all clients are served by RunTCP
+      m_sockfd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+      if(m_sockfd != INVALID_SOCKET) {
+        int one = 1;
+        setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+        if(::bind(m_sockfd, (struct sockaddr *) &m_address, sizeof (struct sockaddr_in)) < 0 ||
+           listen(m_sockfd, SOMAXCONN) < 0 || !SetSocketNonBlocking(m_sockfd, true))
+          CloseSocket(m_sockfd);
+      }
+      if(m_sockfd == INVALID_SOCKET)
+        LogPrintf("DynDns::DynDns: Cannot listen on TCP port %u, answering over UDP only\n", ntohs(m_address.sin_port));
+      m_status = 1;
+      return;
+    }
+
+#ifdef SO_REUSEPORT
+    int ret = socket(PF_INET, SOCK_DGRAM, 0);
+    if(ret >= 0) {
+      int one = 1;
+      m_sockfd = ret;
+      if(setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEPORT, (const char *)&one, sizeof(one)) < 0 ||
+         ::bind(m_sockfd, (struct sockaddr *) &m_address, sizeof (struct sockaddr_in)) < 0) {
+        CloseSocket(m_sockfd);
+        m_sockfd = INVALID_SOCKET;
+      }
+    }
+#endif
+    if(m_sockfd == INVALID_SOCKET) {
+      // No SO_REUSEPORT - read from the master socket, kernel wakes one reader per packet
+      m_sockfd = master->m_sockfd;
+      m_sock_owner = false;
+    }
+
     m_status = 1; // Active, and maybe download
 } // DynDns::DynDns
 
@@ -308,19 +434,46 @@ void DynDns::AddTF(char *tf_tok) {
 /*---------------------------------------------------*/
 
 DynDns::~DynDns() {
-    // reset current object to initial state
+    // Stop every resolver thread before freeing anything they share;
+    // workers use our DAP and answer cache, and maybe our socket
+    Stop();
+    for(std::vector<DynDns*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+      (*it)->Stop();
+    for(std::vector<DynDns*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+      delete *it;
+    m_workers.clear();
+    m_thread.join();
+
 #ifndef WIN32
-    shutdown(m_sockfd, SHUT_RDWR);
+    if(m_sock_owner)
+      CloseSocket(m_sockfd);
 #endif
-    CloseSocket(m_sockfd);
-    MilliSleep(100); // Allow 0.1s my thread to exit
-    // m_thread.join();
     free(m_value);
-    free(m_dap_ht);
+    free(m_batch);
+    if(m_dap_owner)
+      delete[] m_dap_ht;
+    if(m_cache_owner)
+      delete[] m_cache;
     if(m_verbose > 0)
    LogPrintf("DynDns::~DynDns: Destroyed OK\n");
 } // DynDns::~DynDns
 
+/*---------------------------------------------------*/
+// Make the resolver thread exit. shutdown() wakes up a thread blocked
+// in recvfrom() or select(), on Windows only closing the socket does.
+void DynDns::Stop() {
+    if(m_stopping.exchange(true))
+      return;
+    if(m_sockfd == INVALID_SOCKET)
+      return;
+#ifdef WIN32
+    if(m_sock_owner)
+      closesocket(m_sockfd);
+#else
+    shutdown(m_sockfd, SHUT_RDWR);
+#endif
+} // DynDns::Stop
+
 
 /*---------------------------------------------------*/
 
@@ -337,24 +490,34 @@ void DynDns::Run() {
   while(m_status < 0) // not initied yet
     MilliSleep(133);
 
+  if(m_tcp) {
+    RunTCP();
+    return;
+  }
+
+#ifdef DYNDNS_BATCHED_IO
+  RunBatched();
+  return;
+#endif
+
   for( ; ; ) {
     m_addrLen = sizeof(m_clientAddress);
-    m_rcvlen  = recvfrom(m_sockfd, (char *)m_buf, BUF_SIZE, 0,
+    m_rcvlen  = recvfrom(m_sockfd, (char *)m_buf, UDP_BUF_SIZE, 0,
               (struct sockaddr *) &m_clientAddress, &m_addrLen);
-    if(m_rcvlen <= 0)
+    if(m_rcvlen <= 0 || m_stopping)
   break;
 
     DNSAP *dap = NULL;
 
     if(m_dap_ht == NULL || (dap = CheckDAP(m_clientAddress.sin_addr.s_addr)) != NULL) {
-      m_buf[BUF_SIZE] = 0; // Set terminal for infinity QNAME
+      m_buf[UDP_BUF_SIZE] = 0; // Set terminal for infinity QNAME
       HandlePacket();
 
       sendto(m_sockfd, (const char *)m_buf, m_snd - m_buf, MSG_NOSIGNAL,
                (struct sockaddr *) &m_clientAddress, m_addrLen);
 
       if(dap != NULL)
-        dap->ed_size += (m_snd - m_buf) >> 6;
+        UpdateDAP(dap, m_snd - m_buf);
     } // dap check
   } // for
 
@@ -362,6 +525,203 @@ void DynDns::Run() {
 
 } //  DynDns::Run
 
+/*---------------------------------------------------*/
+// Receive all queued packets (up to DYNDNS_BATCH) with one recvmmsg,
+// answer them in place and send all answers back with one sendmmsg
+void DynDns::RunBatched() {
+#ifdef DYNDNS_BATCHED_IO
+  struct mmsghdr     rcv_msgs[DYNDNS_BATCH], snd_msgs[DYNDNS_BATCH];
+  struct iovec       rcv_iov[DYNDNS_BATCH], snd_iov[DYNDNS_BATCH];
+  struct sockaddr_in addrs[DYNDNS_BATCH];
+
+  for( ; ; ) {
+    for(int i = 0; i < DYNDNS_BATCH; i++) {
+      rcv_iov[i].iov_base = m_batch + i * BATCH_BUF_SIZE;
+      rcv_iov[i].iov_len  = UDP_BUF_SIZE;
+      memset(&rcv_msgs[i], 0, sizeof(rcv_msgs[i]));
+      rcv_msgs[i].msg_hdr.msg_name    = &addrs[i];
+      rcv_msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+      rcv_msgs[i].msg_hdr.msg_iov     = &rcv_iov[i];
+      rcv_msgs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    // Block until the 1st packet arrives, then take whatever is queued already
+    int rcv_qty = recvmmsg(m_sockfd, rcv_msgs, DYNDNS_BATCH, MSG_WAITFORONE, NULL);
+    if(rcv_qty <= 0 || m_stopping) {
+      m_rcvlen = rcv_qty;
+      break;
+    }
+
+    int snd_qty = 0;
+    for(int i = 0; i < rcv_qty; i++) {
+      m_rcvlen = rcv_msgs[i].msg_len;
+      if(m_rcvlen <= 0)
+        continue;
+
+      DNSAP *dap = NULL;
+      if(m_dap_ht != NULL && (dap = CheckDAP(addrs[i].sin_addr.s_addr)) == NULL)
+        continue;
+
+      m_buf    = (uint8_t *)rcv_iov[i].iov_base;
+      m_buf[UDP_BUF_SIZE] = 0; // Set terminal for infinity QNAME
+      HandlePacket();
+
+      snd_iov[snd_qty].iov_base = m_buf;
+      snd_iov[snd_qty].iov_len  = m_snd - m_buf;
+      memset(&snd_msgs[snd_qty], 0, sizeof(snd_msgs[snd_qty]));
+      snd_msgs[snd_qty].msg_hdr.msg_name    = &addrs[i];
+      snd_msgs[snd_qty].msg_hdr.msg_namelen = rcv_msgs[i].msg_hdr.msg_namelen;
+      snd_msgs[snd_qty].msg_hdr.msg_iov     = &snd_iov[snd_qty];
+      snd_msgs[snd_qty].msg_hdr.msg_iovlen  = 1;
+      snd_qty++;
+
+      if(dap != NULL)
+        UpdateDAP(dap, m_snd - m_buf);
+    } // for rcv
+
+    // sendmmsg can send less than requested, continue with the rest
+    for(int sent = 0; sent < snd_qty; ) {
+      int ret = sendmmsg(m_sockfd, snd_msgs + sent, snd_qty - sent, MSG_NOSIGNAL);
+      if(ret <= 0)
+        break;
+      sent += ret;
+    }
+  } // for
+
+  if(m_verbose > 2) LogPrintf("DynDns::RunBatched: Received Exit packet_len=%d\n", m_rcvlen);
+#endif
+} //  DynDns::RunBatched
+
+/*---------------------------------------------------*/
+// TCP client; messages in both directions are prefixed with 2-byte length (RFC 1035 4.2.2)
+struct DNSTCPClient {
+  SOCKET      sock;
+  uint32_t    ip;     // client address, for DAP and the per-address limit
+  time_t      last;   // last activity, idle clients are dropped
+  std::string in;     // received bytes, not yet a complete message
+  std::string out;    // answers not sent yet
+};
+
+// Serve all TCP clients from one thread, multiplexed with select()
+void DynDns::RunTCP() {
+  std::vector<DNSTCPClient> clients;
+  char rcvbuf[4096];
+
+  while(m_sockfd != INVALID_SOCKET) {
+    fd_set rd, wr;
+    FD_ZERO(&rd);
+    FD_ZERO(&wr);
+    SOCKET maxfd = m_sockfd;
+    if(clients.size() < DYNDNS_TCPMAXCONN)
+      FD_SET(m_sockfd, &rd);
+    for(std::vector<DNSTCPClient>::iterator it = clients.begin(); it != clients.end(); ++it) {
+      if(it->out.size() < MAX_OUT_TCP * 4) // stop reading from clients that do not read answers
+        FD_SET(it->sock, &rd);
+      if(!it->out.empty())
+        FD_SET(it->sock, &wr);
+      maxfd = std::max(maxfd, it->sock);
+    }
+
+    struct timeval tv;
+    tv.tv_sec  = 1;
+    tv.tv_usec = 0;
+    int ret = select(maxfd + 1, &rd, &wr, NULL, &tv);
+    if(m_stopping)
+      break;
+    if(ret < 0) {
+      if(WSAGetLastError() == WSAEINTR)
+        continue;
+      break;
+    }
+
+    if(FD_ISSET(m_sockfd, &rd)) {
+      struct sockaddr_in addr;
+      socklen_t addr_len = sizeof(addr);
+      SOCKET sock = accept(m_sockfd, (struct sockaddr *) &addr, &addr_len);
+      if(sock != INVALID_SOCKET) {
+        uint32_t ip = addr.sin_addr.s_addr;
+        int conns = 0;
+        for(std::vector<DNSTCPClient>::const_iterator it = clients.begin(); it != clients.end(); ++it)
+          conns += it->ip == ip;
+        // A client that exceeds DAP or holds too many connections cannot take all TCP slots
+        if(conns >= DYNDNS_TCPMAXPERIP || (m_dap_ht != NULL && CheckDAP(ip) == NULL)
+            || !IsSelectableSocket(sock) || !SetSocketNonBlocking(sock, true))
+          CloseSocket(sock);
+        else {
+          DNSTCPClient client;
+          client.sock = sock;
+          client.ip   = ip;
+          client.last = time(NULL);
+          clients.push_back(client);
+        }
+      }
+    }
+
+    time_t now = time(NULL);
+    for(std::vector<DNSTCPClient>::iterator it = clients.begin(); it != clients.end(); ) {
+      bool keep = true;
+      if(FD_ISSET(it->sock, &rd)) {
+        int len = recv(it->sock, rcvbuf, sizeof(rcvbuf), 0);
+        if(len > 0) {
+          it->in.append(rcvbuf, len);
+          it->last = now;
+        } else
+          keep = len < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+      }
+
+      // Answer all complete messages
+      while(keep && it->in.size() >= 2) {
+        size_t len = ((uint8_t)it->in[0] << 8) | (uint8_t)it->in[1];
+        if(len < sizeof(DNSHeader) || len > UDP_BUF_SIZE) {
+          keep = false; // garbage, not DNS
+          break;
+        }
+        if(it->in.size() < len + 2)
+          break;
+        DNSAP *dap = NULL;
+        if(m_dap_ht != NULL && (dap = CheckDAP(it->ip)) == NULL) {
+          keep = false; // over DAP limit, drop the connection as UDP drops the packet
+          break;
+        }
+        memcpy(m_buf, it->in.data() + 2, len);
+        it->in.erase(0, len + 2);
+        m_rcvlen = len;
+        m_buf[BUF_SIZE] = 0; // Set terminal for infinity QNAME
+        HandlePacket();
+        uint16_t out_len = m_snd - m_buf;
+        it->out += (char)(out_len >> 8);
+        it->out += (char)out_len;
+        it->out.append((const char *)m_buf, out_len);
+        if(dap != NULL)
+          UpdateDAP(dap, out_len);
+      }
+
+      if(keep && FD_ISSET(it->sock, &wr)) {
+        int len = send(it->sock, it->out.data(), it->out.size(), MSG_NOSIGNAL);
+        if(len > 0) {
+          it->out.erase(0, len);
+          it->last = now;
+        } else
+          keep = len < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+      }
+
+      if(keep && now - it->last > DYNDNS_TCPTIMEOUT)
+        keep = false;
+
+      if(keep)
+        ++it;
+      else {
+        CloseSocket(it->sock);
+        it = clients.erase(it);
+      }
+    } // for clients
+  } // while
+
+  for(std::vector<DNSTCPClient>::iterator it = clients.begin(); it != clients.end(); ++it)
+    CloseSocket(it->sock);
+  if(m_verbose > 2) LogPrintf("DynDns::RunTCP: exit\n");
+} //  DynDns::RunTCP
+
 /*---------------------------------------------------*/
 
 void DynDns::HandlePacket() {
@@ -386,11 +746,34 @@ void DynDns::HandlePacket() {
 //*  uint16_t zCount = m_hdr->ANCount | m_hdr->NSCount | m_hdr->ARCount | (m_hdr->Bits & (m_hdr->QR_MASK | m_hdr->TC_MASK));
   uint16_t zCount = m_hdr->ANCount | m_hdr->NSCount | (m_hdr->Bits & (m_hdr->QR_MASK | m_hdr->TC_MASK));
 
+  // EDNS0 clients can take larger UDP answers; over TCP the size is limited by our buffer only
+  int edns = zCount? -1 : ParseEDNS();
+  int max_out = m_tcp? MAX_OUT_TCP : MAX_OUT;
+  if(!m_tcp && edns > max_out)
+    max_out = std::min(edns, MAX_OUT_EDNS);
+  m_bufend = m_buf + max_out - (edns == -1? 0 : OPT_RR_SIZE); // keep room for our OPT record
+
   // Clear answer counters - maybe contains junk from client
   //* m_hdr->ANCount = m_hdr->NSCount = m_hdr->ARCount = 0;
   m_hdr->ANCount = m_hdr->NSCount = m_hdr->ARCount = 0;
   m_hdr->Bits   |= m_hdr->QR_MASK; // Change Q->R
 
+  // Standard query with a single question - maybe answered recently.
+  // Answers depend on the size limit and on EDNS0, both are part of the key.
+  std::string question;
+  uint32_t generation = nameCache.GetGeneration();
+  bool cacheable = m_status == 0 && zCount == 0 && edns != -2 && m_hdr->QDCount == 1 &&
+    (m_hdr->Bits & m_hdr->OPCODE_MASK) == 0 && GetQuestion(question);
+  if(cacheable) {
+    question += (char)(max_out >> 8);
+    question += (char)max_out;
+    question += (char)(edns != -1);
+    if(CacheLookup(question, generation)) {
+      m_hdr->Transcode();
+      return;
+    }
+  }
+
   do {
     // check flags QR=0 and TC=0
     if(m_hdr->QDCount == 0 || zCount != 0) {
@@ -405,6 +788,9 @@ void DynDns::HandlePacket() {
       break;
     }
 
+    if(edns == -2)
+      break; // BADVERS, returned in our OPT record
+
     if(m_status) {
       if((m_status = IsInitialBlockDownload())) {
         m_hdr->Bits |= 2; // Server failure - not available valid nameindex DB yet
@@ -462,16 +848,140 @@ void DynDns::HandlePacket() {
   // Truncate answer, if needed
   if(m_snd >= m_bufend) {
     m_hdr->Bits |= m_hdr->TC_MASK;
-    m_snd = m_buf + MAX_OUT;
+    m_snd = m_bufend;
   }
+
+  // EDNS0 request - answer with our OPT record: root name, type, payload size, ext. RCODE/version/flags, empty RDATA
+  if(edns != -1) {
+    *m_snd++ = 0;
+    Out2(41);
+    Out2(MAX_OUT_EDNS);
+    Out4(edns == -2? 1 << 24 : 0); // BADVERS is RCODE 16, upper 8 bits go here
+    Out2(0);
+    m_hdr->ARCount++;
+  }
+
+  // Keep answers and NXDOMAIN; errors can be transient
+  uint16_t rcode = m_hdr->Bits & m_hdr->RCODE_MASK;
+  if(cacheable && (rcode == 0 || rcode == 3))
+    CacheStore(question, generation);
+
   // Encode output header into network format
   m_hdr->Transcode();
 } // DynDns::HandlePacket
 
+/*---------------------------------------------------*/
+// Returns pointer past the domain name at p, or past end if it is malformed
+static const uint8_t *SkipName(const uint8_t *p, const uint8_t *end) {
+  while(p < end) {
+    if(*p == 0)
+      return p + 1;
+    if((*p & 0xc0) == 0xc0)
+      return p + 2; // compressed
+    p += *p + 1;
+  }
+  return end + 1;
+} // SkipName
+
+/*---------------------------------------------------*/
+// Look for the OPT record in the additional section of the request.
+// Returns -1 if there is none, -2 if its EDNS version is not supported,
+// otherwise the UDP payload size the client can receive.
+int DynDns::ParseEDNS() {
+  if(m_hdr->ARCount == 0)
+    return -1;
+
+  const uint8_t *p = m_buf + sizeof(DNSHeader);
+  for(uint16_t qno = 0; qno < m_hdr->QDCount; qno++)
+    p = SkipName(p, m_rcvend) + 4; // QTYPE, QCLASS
+
+  for(uint16_t arno = 0; arno < m_hdr->ARCount; arno++) {
+    p = SkipName(p, m_rcvend);
+    if(p + 10 > m_rcvend)
+      return -1;
+    uint16_t type = (p[0] << 8) | p[1];
+    if(type == 41) {
+      if(m_verbose > 3)
+        LogPrintf("\tDynDns::ParseEDNS: payload=%u version=%u\n", (p[2] << 8) | p[3], p[5]);
+      return p[5]? -2 : (p[2] << 8) | p[3];
+    }
+    p += 10 + ((p[8] << 8) | p[9]); // TYPE, CLASS, TTL, RDLENGTH, RDATA
+  }
+  return -1;
+} // DynDns::ParseEDNS
+
+/*---------------------------------------------------*/
+// Copy question section of the request, false if malformed.
+// Names are case-insensitive, so the copy has the qname in lower case.
+bool DynDns::GetQuestion(std::string &question) {
+  const uint8_t *p = m_buf + sizeof(DNSHeader);
+  while(p < m_rcvend && *p != 0) {
+    if(*p & 0xc0)
+      return false;
+    p += *p + 1;
+  }
+  p += 5; // terminating zero, QTYPE, QCLASS
+  if(p > m_rcvend)
+    return false;
+  question.assign((const char *)m_buf + sizeof(DNSHeader), p - m_buf - sizeof(DNSHeader));
+  for(size_t i = 0; i + 5 < question.size(); i += (uint8_t)question[i] + 1)
+    for(size_t j = i + 1; j <= i + (uint8_t)question[i]; j++)
+      question[j] = tolower((uint8_t)question[j]);
+  return true;
+} // DynDns::GetQuestion
+
+/*---------------------------------------------------*/
+// Copy cached answer behind the header, patch the header counters and bits
+bool DynDns::CacheLookup(const std::string &question, uint32_t generation) {
+  DNSAnswerCacheShard &shard = m_cache[std::hash<std::string>()(question) % DYNDNS_CACHESHARDS];
+  boost::mutex::scoped_lock lock(shard.mutex);
+  std::map<std::string, DNSCachedAnswer>::iterator it = shard.answers.find(question);
+  if(it == shard.answers.end())
+    return false;
+
+  const DNSCachedAnswer &answer = it->second;
+  if(answer.generation != generation || answer.expires < time(NULL)) {
+    // a name changed on-chain, or the answer is too old
+    shard.answers.erase(it);
+    return false;
+  }
+
+  // the request's question stays in front, the reply keeps the case of its qname
+  size_t qlen = SkipName(m_buf + sizeof(DNSHeader), m_rcvend) + 4 - m_buf - sizeof(DNSHeader);
+  memcpy(m_buf + sizeof(DNSHeader) + qlen, answer.body.data() + qlen, answer.body.size() - qlen);
+  m_snd = m_buf + sizeof(DNSHeader) + answer.body.size();
+  m_hdr->Bits   |= answer.bits;
+  m_hdr->ANCount = answer.ANCount;
+  m_hdr->NSCount = answer.NSCount;
+  m_hdr->ARCount = answer.ARCount;
+  if(m_verbose > 3)
+    LogPrintf("\tDynDns::CacheLookup: answered from cache, len=%u\n", (unsigned)(m_snd - m_buf));
+  return true;
+} // DynDns::CacheLookup
+
+/*---------------------------------------------------*/
+
+void DynDns::CacheStore(const std::string &question, uint32_t generation) {
+  DNSCachedAnswer answer;
+  answer.bits       = m_hdr->Bits & (m_hdr->RCODE_MASK | m_hdr->TC_MASK);
+  answer.ANCount    = m_hdr->ANCount;
+  answer.NSCount    = m_hdr->NSCount;
+  answer.ARCount    = m_hdr->ARCount;
+  answer.generation = generation;
+  answer.expires    = time(NULL) + DYNDNS_CACHETTL;
+  answer.body.assign((const char *)m_buf + sizeof(DNSHeader), m_snd - m_buf - sizeof(DNSHeader));
+
+  DNSAnswerCacheShard &shard = m_cache[std::hash<std::string>()(question) % DYNDNS_CACHESHARDS];
+  boost::mutex::scoped_lock lock(shard.mutex);
+  if(shard.answers.size() >= DYNDNS_CACHESIZE && !shard.answers.count(question))
+    shard.answers.erase(shard.answers.begin());
+  shard.answers[question] = answer;
+} // DynDns::CacheStore
+
 /*---------------------------------------------------*/
 uint16_t DynDns::HandleQuery() {
   // Decode qname
-  uint8_t key[BUF_SIZE];        // Key, transformed to dot-separated LC
+  uint8_t *key = m_key;         // Key, transformed to dot-separated LC
   uint8_t *key_end = key;
   uint8_t *domain_ndx[MAX_DOM];       // indexes to domains
   uint8_t **domain_ndx_p = domain_ndx;     // Ptr to the end
@@ -738,6 +1248,8 @@ void DynDns::Answer_ALL(uint16_t qtype, char *buf) {
   for(int tok_no = 0; tok_no < tokQty; tok_no++) {
       if(m_verbose > 1) 
   LogPrintf("\tDynDns::Answer_ALL: Token:%u=[%s]\n", tok_no, tokens[tok_no]);
+      uint8_t *rr_start = m_snd;
+      m_hdr->ANCount++;
       Out2(m_label_ref);
       Out2(qtype); // A record, or maybe something else
       Out2(1); //  INET
@@ -752,8 +1264,14 @@ void DynDns::Answer_ALL(uint16_t qtype, char *buf) {
   case 16: Fill_RD_DName(tokens[tok_no], 0, 1); break; // TXT
   default: break;
       } // swithc
+      if(m_snd >= m_bufend) {
+        // Record does not fit - drop it and the rest, client retries over TCP
+        m_snd = rr_start;
+        m_hdr->ANCount--;
+        m_hdr->Bits |= m_hdr->TC_MASK;
+        break;
+      }
   } // for
-  m_hdr->ANCount += tokQty;
 } // DynDns::Answer_ALL 
 
 /*---------------------------------------------------*/
@@ -855,12 +1373,28 @@ DNSAP *DynDns::CheckDAP(uint32_t ip_addr) {
   hash += hash >> 8;
   DNSAP *dap = m_dap_ht + (hash & (DYNDNS_DAPSIZE - 1));
   uint16_t timestamp = time(NULL) >> 6; // time in 64s ticks
-  uint16_t dt = timestamp - dap->timestamp;
-  dap->ed_size = (dt > 15? 0 : dap->ed_size >> dt) + 1;
-  dap->timestamp = timestamp;
-  return (dap->ed_size <= DYNDNS_DAPTRESHOLD)? dap : NULL;
+  uint32_t old_state = dap->state.load(std::memory_order_relaxed), new_state;
+  uint16_t ed_size;
+  do {
+    uint16_t dt = timestamp - (old_state >> 16);
+    ed_size = (dt > 15? 0 : (old_state & 0xffff) >> dt) + 1;
+    new_state = ((uint32_t)timestamp << 16) | ed_size;
+  } while(!dap->state.compare_exchange_weak(old_state, new_state, std::memory_order_relaxed));
+  return (ed_size <= DYNDNS_DAPTRESHOLD)? dap : NULL;
 } // DynDns::CheckDAP 
 
+/*---------------------------------------------------*/
+// Account answer size, other threads may update the same entry concurrently
+void DynDns::UpdateDAP(DNSAP *dap, int packet_len) { 
+  uint32_t old_state = dap->state.load(std::memory_order_relaxed), new_state;
+  do {
+    uint32_t ed_size = (old_state & 0xffff) + (packet_len >> 6);
+    if(ed_size > 0xffff)
+      ed_size = 0xffff;
+    new_state = (old_state & 0xffff0000) | ed_size;
+  } while(!dap->state.compare_exchange_weak(old_state, new_state, std::memory_order_relaxed));
+} // DynDns::UpdateDAP 
+
 
 /*---------------------------------------------------*/
 // Handle Special function - phone number in the E.164 format
@@ -1060,19 +1594,13 @@ bool DynDns::CheckEnumSig(const char *q_str, char *sig_str) {
   return false; // Already unable to fetch
 
       do {
-        NameTxInfo nti;
         CNameRecord nameRec;
-        CTransaction tx;
         LOCK(cs_main);
-        CNameDB dbName("r");
-        if(!dbName.ReadName(CNameVal(it->first.c_str(), it->first.c_str() + it->first.size()), nameRec))
+        if(!pnameDB->ReadName(CNameVal(it->first.c_str(), it->first.c_str() + it->first.size()), nameRec))
     break; // failed to read from name DB
         if(nameRec.vtxPos.size() < 1)
     break; // no result returned
-        if(!tx.ReadFromDisk(nameRec.vtxPos.back().txPos))
-          break; // failed to read from from disk
-        if(!DecodeNameTx(tx, nti, true))
-          break; // failed to decode name
+        const CNameIndex &nti = nameRec.vtxPos.back();
   CDynamicAddress addr(nti.strAddress);
         if(!addr.IsValid())
           break; // Invalid address
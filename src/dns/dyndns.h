@@ -11,14 +11,24 @@
 #include "netbase.h"
 #include "pubkey.h"
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/thread.hpp>
 #include <boost/xpressive/xpressive_dynamic.hpp>
 
 #define DYNDNS_DAPSIZE     (8 * 1024)
 #define DYNDNS_DAPTRESHOLD 3000 // 200K/min limit answer
+#define DYNDNS_BATCH       32   // Max packets received/sent by one recvmmsg/sendmmsg call
+#define DYNDNS_MAXTHREADS  64
+#define DYNDNS_CACHESHARDS 16   // Answer cache shards, each with its own lock
+#define DYNDNS_CACHESIZE   4096 // Max cached answers per shard
+#define DYNDNS_CACHETTL    60   // Seconds a cached answer is reused; bounds round-robin order and name expiry
+#define DYNDNS_TCPMAXCONN  64   // Max simultaneous TCP clients
+#define DYNDNS_TCPMAXPERIP 4    // Max simultaneous TCP clients from one address
+#define DYNDNS_TCPTIMEOUT  10   // Seconds an idle TCP client is kept
 
 #define VERMASK_NEW  -1
 #define VERMASK_BLOCKED -2
@@ -48,9 +58,28 @@ struct DNSHeader {
 
 
 struct DNSAP {    // DNS Amplifier Protector ExpDecay structure
-  uint16_t timestamp; // Time in 64s ticks
-  uint16_t ed_size; // ExpDecay output size in 64-byte units
-} __attribute__((packed));
+  // Shared by all resolver threads, so both fields are packed into one word
+  // and updated with compare-and-swap:
+  //   bits 31..16 - timestamp, time in 64s ticks
+  //   bits 15..0  - ed_size, ExpDecay output size in 64-byte units
+  std::atomic<uint32_t> state;
+};
+
+// Ready-to-send answer; for a repeated question only msgID and the query bits are taken from the request
+struct DNSCachedAnswer {
+  uint16_t    bits;       // RCODE and TC bits of the answer
+  uint16_t    ANCount;
+  uint16_t    NSCount;
+  uint16_t    ARCount;
+  uint32_t    generation; // name cache generation the answer was built with
+  time_t      expires;
+  std::string body;       // packet after the header, starts with the question
+};
+
+struct DNSAnswerCacheShard {
+  boost::mutex mutex;
+  std::map<std::string, DNSCachedAnswer> answers; // keyed by the question section as received
+};
 
 struct Verifier {
     Verifier() : mask(VERMASK_NEW) {}  // -1 == uninited, neg != -1 == cant fetch
@@ -73,14 +102,23 @@ class DynDns {
      DynDns(const char *bind_ip, uint16_t port_no,
      const char *gw_suffix, const char *allowed_suff,
      const char *local_fname, const char *enums, const char *tollfree, 
-     uint8_t verbose);
+     uint8_t verbose, uint8_t threads = 1, bool tcp = true);
     ~DynDns();
 
     void Run();
+    uint16_t GetPort() const { return ntohs(m_address.sin_port); }
 
   private:
+    // Worker thread, shares configuration and DAP with the master.
+    // TCP worker serves all TCP clients on the master's address.
+    DynDns(const DynDns *master, bool tcp = false);
+
     static void StatRun(void *p);
+    void Stop();
+    void RunBatched();
+    void RunTCP();
     void HandlePacket();
+    int  ParseEDNS();
     uint16_t HandleQuery();
     int  Search(uint8_t *key);
     int  LocalSearch(const uint8_t *key, uint8_t pos, uint8_t step);
@@ -90,6 +128,11 @@ class DynDns {
     void Fill_RD_DName(char *txt, uint8_t mxsz, int8_t txtcor);
     int  TryMakeref(uint16_t label_ref);
 
+    // Answer cache, shared by all resolver threads
+    bool GetQuestion(std::string &question);
+    bool CacheLookup(const std::string &question, uint32_t generation);
+    void CacheStore(const std::string &question, uint32_t generation);
+
     // Handle Special function - phone number in the E.164 format
     // to support ENUM service
     int SpfunENUM(uint8_t len, uint8_t **domain_start, uint8_t **domain_end);
@@ -101,6 +144,7 @@ class DynDns {
 
     // Returns x = hash index to update size; x==NULL = disable;
     DNSAP  *CheckDAP(uint32_t ip_addr);
+    void    UpdateDAP(DNSAP *dap, int packet_len);
 
     inline void Out2(uint16_t x) { x = htons(x); memcpy(m_snd, &x, 2); m_snd += 2; }
     inline void Out4(uint32_t x) { x = htonl(x); memcpy(m_snd, &x, 4); m_snd += 4; }
@@ -111,6 +155,7 @@ class DynDns {
     char     *m_value;
     const char *m_gw_suffix;
     uint8_t  *m_buf, *m_bufend, *m_snd, *m_rcv, *m_rcvend;
+    uint8_t  *m_key;  // qname of the query being answered, BUF_SIZE bytes in m_value
     SOCKET    m_sockfd;
     int       m_rcvlen;
     uint32_t  m_daprand;  // DAP random value for universal hashing
@@ -128,6 +173,15 @@ class DynDns {
     uint8_t   m_verbose;  // LAST bzero element
         
     int8_t    m_status;
+    bool      m_sock_owner; // false if the socket is shared with the master
+    bool      m_dap_owner;
+    bool      m_cache_owner;
+    bool      m_tcp;        // serves TCP clients, answers are not limited by UDP payload size
+    std::atomic<bool> m_stopping; // set by Stop(), the resolver thread exits
+    DNSAnswerCacheShard *m_cache;
+    size_t    m_value_len;
+    uint8_t  *m_batch;      // per-thread packet buffers for batched I/O
+    std::vector<DynDns*> m_workers; // additional resolver threads, master only
     boost::thread m_thread;
     std::map<std::string, Verifier> m_verifiers;
     std::vector<TollFree>      m_tollfree;
@@ -25,13 +25,14 @@ public:
     virtual bool IsNameFeeEnough(const CTransaction& tx, const CAmount& txFee) = 0;
     virtual bool CheckInputs(const CTransaction& tx, const CBlockIndex* pindexBlock, std::vector<nameTempProxy> &vName, const CDiskTxPos& pos, const CAmount& txFee) = 0;
     virtual bool DisconnectInputs(const CTransaction& tx) = 0;
+    virtual bool DisconnectBlock(const CBlockIndex* pindex) = 0;
     virtual bool ConnectBlock(CBlockIndex* pindex, const std::vector<nameTempProxy> &vName) = 0;
     virtual bool ExtractAddress(const CScript& script, std::string& address) = 0;
-    virtual void AddToPendingNames(const CTransaction& tx) = 0;
     virtual bool RemoveNameScriptPrefix(const CScript& scriptIn, CScript& scriptOut) = 0;
     virtual bool IsNameScript(CScript scr) = 0;
     virtual bool getNameValue(const std::string& sName, std::string& sValue) = 0;
     virtual bool DumpToTextFile() = 0;
+    virtual bool FlushNames() = 0;
 };
 
 extern CHooks* InitHook();
@@ -32,6 +32,10 @@ void CDynodeSync::Reset()
     nTimeAssetSyncStarted = GetTime();
     nTimeLastBumped = GetTime();
     nTimeLastFailure = 0;
+    mapAssets.clear();
+    for(int nAsset = DYNODE_SYNC_LIST; nAsset <= DYNODE_SYNC_GOVERNANCE; ++nAsset) {
+        mapAssets[nAsset] = CDynodeSyncAsset();
+    }
 }
 
 void CDynodeSync::BumpAssetLastTime(std::string strFuncName)
@@ -41,9 +45,33 @@ void CDynodeSync::BumpAssetLastTime(std::string strFuncName)
     LogPrint("dnsync", "CDynodeSync::BumpAssetLastTime -- %s\n", strFuncName);
 }
 
+void CDynodeSync::BumpAssetLastTime(int nAsset, std::string strFuncName)
+{
+    if(IsSynced() || IsFailed()) return;
+
+    if(!IsAssetActive(nAsset)) {
+        // not syncing this asset right now, treat it as a generic activity
+        BumpAssetLastTime(strFuncName);
+        return;
+    }
+
+    CDynodeSyncAsset& asset = mapAssets[nAsset];
+    int64_t nNow = GetTime();
+    // Data keeps coming but with long pauses (slow peers, large lists),
+    // give this asset more time before we consider it synced
+    asset.nTimeout = std::min<int64_t>(DYNODE_SYNC_TIMEOUT_MAX_SECONDS, std::max<int64_t>(asset.nTimeout, 2 * (nNow - asset.nTimeLastBumped)));
+    asset.nTimeLastBumped = nNow;
+    LogPrint("dnsync", "CDynodeSync::BumpAssetLastTime -- %s %s, timeout %d\n", GetAssetName(nAsset), strFuncName, asset.nTimeout);
+}
+
 std::string CDynodeSync::GetAssetName()
 {
-    switch(nRequestedDynodeAssets)
+    return GetAssetName(nRequestedDynodeAssets);
+}
+
+std::string CDynodeSync::GetAssetName(int nAsset)
+{
+    switch(nAsset)
     {
         case(DYNODE_SYNC_INITIAL):      return "DYNODE_SYNC_INITIAL";
         case(DYNODE_SYNC_WAITING):      return "DYNODE_SYNC_WAITING";
@@ -56,6 +84,81 @@ std::string CDynodeSync::GetAssetName()
     }
 }
 
+bool CDynodeSync::IsAssetReady(int nAsset)
+{
+    if(IsFailed() || !IsBlockchainSynced()) return false;
+
+    switch(nAsset)
+    {
+        case(DYNODE_SYNC_LIST):
+            return true;
+        // Payment votes and governance objects are validated against the Dynode list,
+        // they are queued until the list is synced but don't wait for each other
+        case(DYNODE_SYNC_DNW):
+        case(DYNODE_SYNC_GOVERNANCE):
+            return mapAssets[DYNODE_SYNC_LIST].fFinished;
+        default:
+            return false;
+    }
+}
+
+bool CDynodeSync::IsAssetActive(int nAsset)
+{
+    std::map<int, CDynodeSyncAsset>::iterator it = mapAssets.find(nAsset);
+    if(it == mapAssets.end()) return false;
+    return it->second.fStarted && !it->second.fFinished;
+}
+
+void CDynodeSync::StartAsset(int nAsset)
+{
+    CDynodeSyncAsset& asset = mapAssets[nAsset];
+    asset.fStarted = true;
+    asset.nAttempt = 0;
+    asset.nTimeStarted = GetTime();
+    asset.nTimeLastBumped = GetTime();
+    asset.nTimeout = DYNODE_SYNC_TIMEOUT_SECONDS;
+    LogPrintf("CDynodeSync::StartAsset -- Starting %s\n", GetAssetName(nAsset));
+}
+
+void CDynodeSync::FinishAsset(int nAsset, CConnman& connman)
+{
+    CDynodeSyncAsset& asset = mapAssets[nAsset];
+    if(asset.fFinished) return;
+    asset.fFinished = true;
+    LogPrintf("CDynodeSync::FinishAsset -- Completed %s in %llds\n", GetAssetName(nAsset), asset.fStarted ? GetTime() - asset.nTimeStarted : 0);
+    UpdateAssetState(connman);
+}
+
+void CDynodeSync::UpdateAssetState(CConnman& connman)
+{
+    if(IsFailed() || IsSynced() || !IsBlockchainSynced()) return;
+
+    // Report the first asset which is not synced yet, so that IsDynodeListSynced()
+    // and IsWinnersListSynced() keep their meaning while assets sync in parallel
+    for(int nAsset = DYNODE_SYNC_LIST; nAsset <= DYNODE_SYNC_GOVERNANCE; ++nAsset) {
+        if(!mapAssets[nAsset].fFinished) {
+            nRequestedDynodeAssets = nAsset;
+            nRequestedDynodeAttempt = mapAssets[nAsset].nAttempt;
+            return;
+        }
+    }
+
+    nRequestedDynodeAssets = DYNODE_SYNC_FINISHED;
+    nRequestedDynodeAttempt = 0;
+    uiInterface.NotifyAdditionalDataSyncProgressChanged(1);
+    //try to activate our dynode if possible
+    activeDynode.ManageState(connman);
+
+    // TODO: Find out whether we can just use LOCK instead of:
+    // TRY_LOCK(cs_vNodes, lockRecv);
+    // if(lockRecv) { ... }
+
+    connman.ForEachNode(CConnman::AllNodes, [](CNode* pnode) {
+        netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
+    });
+    LogPrintf("CDynodeSync::UpdateAssetState -- Sync has finished\n");
+}
+
 void CDynodeSync::SwitchToNextAsset(CConnman& connman)
 {
     switch(nRequestedDynodeAssets)
@@ -66,43 +169,23 @@ void CDynodeSync::SwitchToNextAsset(CConnman& connman)
         case(DYNODE_SYNC_INITIAL):
             ClearFulfilledRequests(connman);
             nRequestedDynodeAssets = DYNODE_SYNC_WAITING;
+            nRequestedDynodeAttempt = 0;
             LogPrintf("CDynodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
             break;
         case(DYNODE_SYNC_WAITING):
             ClearFulfilledRequests(connman);
             LogPrintf("CDynodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
             nRequestedDynodeAssets = DYNODE_SYNC_LIST;
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
+            nRequestedDynodeAttempt = 0;
+            StartAsset(DYNODE_SYNC_LIST);
             break;
         case(DYNODE_SYNC_LIST):
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedDynodeAssets = DYNODE_SYNC_DNW;
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
         case(DYNODE_SYNC_DNW):
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedDynodeAssets = DYNODE_SYNC_GOVERNANCE;
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Starting %s\n", GetAssetName());
-            break;
         case(DYNODE_SYNC_GOVERNANCE):
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Completed %s in %llds\n", GetAssetName(), GetTime() - nTimeAssetSyncStarted);
-            nRequestedDynodeAssets = DYNODE_SYNC_FINISHED;
-            uiInterface.NotifyAdditionalDataSyncProgressChanged(1);
-            //try to activate our dynode if possible
-            activeDynode.ManageState(connman);
-
-            // TODO: Find out whether we can just use LOCK instead of:
-            // TRY_LOCK(cs_vNodes, lockRecv);
-            // if(lockRecv) { ... }
-
-            connman.ForEachNode(CConnman::AllNodes, [](CNode* pnode) {
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
-            });
-            LogPrintf("CDynodeSync::SwitchToNextAsset -- Sync has finished\n");
-
+            // force the first asset which is not synced yet to complete
+            FinishAsset(nRequestedDynodeAssets, connman);
             break;
     }
-    nRequestedDynodeAttempt = 0;
     nTimeAssetSyncStarted = GetTime();
     BumpAssetLastTime("CDynodeSync::SwitchToNextAsset");
 }
@@ -186,11 +269,67 @@ void CDynodeSync::ProcessTick(CConnman& connman)
         return;
     }
 
+    // Start assets as soon as the assets they depend on are synced and check running ones for timeouts
+    for(int nAsset = DYNODE_SYNC_LIST; nAsset <= DYNODE_SYNC_GOVERNANCE; ++nAsset) {
+        CDynodeSyncAsset& asset = mapAssets[nAsset];
+        if(asset.fFinished || !IsAssetReady(nAsset)) continue;
+        if(!asset.fStarted) {
+            StartAsset(nAsset);
+            continue;
+        }
+
+        LogPrint("dnsync", "CDynodeSync::ProcessTick -- nTick %d asset %s nAttempt %d nTimeLastBumped %lld GetTime() %lld diff %lld timeout %lld\n",
+                    nTick, GetAssetName(nAsset), asset.nAttempt, asset.nTimeLastBumped, GetTime(), GetTime() - asset.nTimeLastBumped, asset.nTimeout);
+
+        // check for timeout first
+        // This might take a lot longer than DYNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
+        // but that should be OK and it should timeout eventually.
+        if(GetTime() - asset.nTimeLastBumped > asset.nTimeout) {
+            LogPrintf("CDynodeSync::ProcessTick -- nTick %d asset %s -- timeout\n", nTick, GetAssetName(nAsset));
+            if(asset.nAttempt == 0) {
+                if(nAsset == DYNODE_SYNC_GOVERNANCE) {
+                    LogPrintf("CDynodeSync::ProcessTick -- WARNING: failed to sync %s\n", GetAssetName(nAsset));
+                    // it's kind of ok to skip this for now, hopefully we'll catch up later?
+                } else {
+                    LogPrintf("CDynodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName(nAsset));
+                    // there is no way we can continue without Dynode list or winner list, fail here and try later
+                    Fail();
+                    return;
+                }
+            }
+            FinishAsset(nAsset, connman);
+            continue;
+        }
+
+        // check for data
+        // if dnpayments already has enough blocks and votes, we are done with payments
+        // try to fetch data from at least two peers though
+        if(nAsset == DYNODE_SYNC_DNW && asset.nAttempt > 1 && dnpayments.IsEnoughData()) {
+            LogPrintf("CDynodeSync::ProcessTick -- nTick %d asset %s -- found enough data\n", nTick, GetAssetName(nAsset));
+            FinishAsset(nAsset, connman);
+        }
+    }
+
+    if(IsSynced()) return;
+    UpdateAssetState(connman);
+
     // Calculate "progress" for LOG reporting / GUI notification
-    double nSyncProgress = double(nRequestedDynodeAttempt + (nRequestedDynodeAssets - 1) * 8) / (8*4);
+    double nSyncProgress = 0;
+    if(nRequestedDynodeAssets >= DYNODE_SYNC_LIST) {
+        for(int nAsset = DYNODE_SYNC_LIST; nAsset <= DYNODE_SYNC_GOVERNANCE; ++nAsset) {
+            const CDynodeSyncAsset& asset = mapAssets[nAsset];
+            nSyncProgress += asset.fFinished ? 1 : std::min(asset.nAttempt, 8) / 8.0;
+        }
+        nSyncProgress /= 3;
+    } else {
+        nSyncProgress = double(std::min(nRequestedDynodeAttempt, 8)) / (8*4);
+    }
     LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d nRequestedDynodeAttempt %d nSyncProgress %f\n", nTick, nRequestedDynodeAssets, nRequestedDynodeAttempt, nSyncProgress);
     uiInterface.NotifyAdditionalDataSyncProgressChanged(nSyncProgress);
 
+    // Ask a few peers for every running asset in each tick instead of one peer per tick
+    std::map<int, int> mapAskedThisTick;
+
     std::vector<CNode*> vNodesCopy = connman.CopyNodeVector();
 
     BOOST_FOREACH(CNode* pnode, vNodesCopy)    {
@@ -252,105 +391,47 @@ void CDynodeSync::ProcessTick(CConnman& connman)
                     // We must be at the tip already, let's move to the next asset.
                     SwitchToNextAsset(connman);
                 }
+                continue;
             }
 
             // DNLIST : SYNC DYNODE LIST FROM OTHER CONNECTED CLIENTS
 
-            if(nRequestedDynodeAssets == DYNODE_SYNC_LIST) {
-                LogPrint("dynode", "CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedDynodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                if(GetTime() - nTimeLastBumped > DYNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d -- timeout\n", nTick, nRequestedDynodeAssets);
-                    if (nRequestedDynodeAttempt == 0) {
-                        LogPrintf("CDynodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // there is no way we can continue without Dynode list, fail here and try later
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-
+            if(IsAssetActive(DYNODE_SYNC_LIST) && mapAskedThisTick[DYNODE_SYNC_LIST] < DYNODE_SYNC_PARALLEL_PEERS &&
+                    !netfulfilledman.HasFulfilledRequest(pnode->addr, "dynode-list-sync")) {
                 // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "dynode-list-sync")) continue;
                 netfulfilledman.AddFulfilledRequest(pnode->addr, "dynode-list-sync");
 
-                if (pnode->nVersion < dnpayments.GetMinDynodePaymentsProto()) continue;
-                nRequestedDynodeAttempt++;
+                if (pnode->nVersion >= dnpayments.GetMinDynodePaymentsProto()) {
+                    mapAssets[DYNODE_SYNC_LIST].nAttempt++;
+                    mapAskedThisTick[DYNODE_SYNC_LIST]++;
 
-                dnodeman.PsegUpdate(pnode, connman);
-
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+                    dnodeman.PsegUpdate(pnode, connman);
+                }
             }
 
             // DNW : SYNC DYNODE PAYMENT VOTES FROM OTHER CONNECTED CLIENTS
 
-            if(nRequestedDynodeAssets == DYNODE_SYNC_DNW) {
-                LogPrint("dnpayments", "CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedDynodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-                // check for timeout first
-                // This might take a lot longer than DYNODE_SYNC_TIMEOUT_SECONDS due to new blocks,
-                // but that should be OK and it should timeout eventually.
-                if(GetTime() - nTimeLastBumped > DYNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d -- timeout\n", nTick, nRequestedDynodeAssets);
-                    if (nRequestedDynodeAttempt == 0) {
-                        LogPrintf("CDynodeSync::ProcessTick -- ERROR: failed to sync %s\n", GetAssetName());
-                        // probably not a good idea to proceed without winner list
-                        Fail();
-                        connman.ReleaseNodeVector(vNodesCopy);
-                        return;
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-                // check for data
-                // if dnpayments already has enough blocks and votes, switch to the next asset
-                // try to fetch data from at least two peers though
-                if(nRequestedDynodeAttempt > 1 && dnpayments.IsEnoughData()) {
-                    LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d -- found enough data\n", nTick, nRequestedDynodeAssets);
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
-
+            if(IsAssetActive(DYNODE_SYNC_DNW) && mapAskedThisTick[DYNODE_SYNC_DNW] < DYNODE_SYNC_PARALLEL_PEERS &&
+                    !netfulfilledman.HasFulfilledRequest(pnode->addr, "dynode-payment-sync")) {
                 // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "dynode-payment-sync")) continue;
                 netfulfilledman.AddFulfilledRequest(pnode->addr, "dynode-payment-sync");
 
-                if(pnode->nVersion < dnpayments.GetMinDynodePaymentsProto()) continue;
-                nRequestedDynodeAttempt++;
-
-                // ask node for all payment votes it has (new nodes will only return votes for future payments)
-                connman.PushMessage(pnode, NetMsgType::DYNODEPAYMENTSYNC, dnpayments.GetStorageLimit());
-                // ask node for missing pieces only (old nodes will not be asked)
-                dnpayments.RequestLowDataPaymentBlocks(pnode, connman);
+                if(pnode->nVersion >= dnpayments.GetMinDynodePaymentsProto()) {
+                    mapAssets[DYNODE_SYNC_DNW].nAttempt++;
+                    mapAskedThisTick[DYNODE_SYNC_DNW]++;
 
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+                    // ask node for all payment votes it has (new nodes will only return votes for future payments)
+                    connman.PushMessage(pnode, NetMsgType::DYNODEPAYMENTSYNC, dnpayments.GetStorageLimit());
+                    // ask node for missing pieces only (old nodes will not be asked)
+                    dnpayments.RequestLowDataPaymentBlocks(pnode, connman);
+                }
             }
 
             // GOVOBJ : SYNC GOVERNANCE ITEMS FROM OUR PEERS
 
-            if(nRequestedDynodeAssets == DYNODE_SYNC_GOVERNANCE) {
-                LogPrint("gobject", "CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d nTimeLastBumped %lld GetTime() %lld diff %lld\n", nTick, nRequestedDynodeAssets, nTimeLastBumped, GetTime(), GetTime() - nTimeLastBumped);
-
-                // check for timeout first
-                if(GetTime() - nTimeLastBumped > DYNODE_SYNC_TIMEOUT_SECONDS) {
-                    LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d -- timeout\n", nTick, nRequestedDynodeAssets);
-                    if(nRequestedDynodeAttempt == 0) {
-                        LogPrintf("CDynodeSync::ProcessTick -- WARNING: failed to sync %s\n", GetAssetName());
-                        // it's kind of ok to skip this for now, hopefully we'll catch up later?
-                    }
-                    SwitchToNextAsset(connman);
-                    connman.ReleaseNodeVector(vNodesCopy);
-                    return;
-                }
+            if(IsAssetActive(DYNODE_SYNC_GOVERNANCE)) {
                 // only request obj sync once from each peer, then request votes on per-obj basis
                 if(netfulfilledman.HasFulfilledRequest(pnode->addr, "governance-sync")) {
-                    governance.RequestGovernanceObjectVotes(pnode, connman);
                     int nObjsLeftToAsk = governance.RequestGovernanceObjectVotes(pnode, connman);
                     static int64_t nTimeNoObjectsLeft = 0;
                     // check for data
@@ -374,30 +455,31 @@ void CDynodeSync::ProcessTick(CConnman& connman)
                             LogPrintf("CDynodeSync::ProcessTick -- nTick %d nRequestedDynodeAssets %d -- asked for all objects, nothing to do\n", nTick, nRequestedDynodeAssets);
                             // reset nTimeNoObjectsLeft to be able to use the same condition on resync
                             nTimeNoObjectsLeft = 0;
-                            SwitchToNextAsset(connman);
-                            connman.ReleaseNodeVector(vNodesCopy);
-                            return;
+                            FinishAsset(DYNODE_SYNC_GOVERNANCE, connman);
+                            if(IsSynced()) break;
+                            continue;
                         }
 
                         nLastTick = nTick;
                         nLastVotes = governance.GetVoteCount();
                     }
-                 }
+                } else if(mapAskedThisTick[DYNODE_SYNC_GOVERNANCE] < DYNODE_SYNC_PARALLEL_PEERS) {
+                    netfulfilledman.AddFulfilledRequest(pnode->addr, "governance-sync");
 
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "governance-sync");
+                    if (pnode->nVersion >= MIN_GOVERNANCE_PEER_PROTO_VERSION) {
+                        mapAssets[DYNODE_SYNC_GOVERNANCE].nAttempt++;
+                        mapAskedThisTick[DYNODE_SYNC_GOVERNANCE]++;
 
-                if (pnode->nVersion < MIN_GOVERNANCE_PEER_PROTO_VERSION) continue;
-                nRequestedDynodeAttempt++;
-
-                SendGovernanceSyncRequest(pnode, connman);
-
-                connman.ReleaseNodeVector(vNodesCopy);
-                return; //this will cause each peer to get one request each six seconds for the various assets we need
+                        SendGovernanceSyncRequest(pnode, connman);
+                    }
+                }
             }
         }
     }
     // looped through all nodes, release them
     connman.ReleaseNodeVector(vNodesCopy);
+
+    UpdateAssetState(connman);
 }
 
 void CDynodeSync::SendGovernanceSyncRequest(CNode* pnode, CConnman& connman)
@@ -407,6 +489,9 @@ void CDynodeSync::SendGovernanceSyncRequest(CNode* pnode, CConnman& connman)
         filter.clear();
 
         connman.PushMessage(pnode, NetMsgType::DNGOVERNANCESYNC, uint256(), filter);
+        // Ask for vote set digests as well so that objects we already have
+        // all votes for are not requested again. Older peers ignore this.
+        connman.PushMessage(pnode, NetMsgType::DNGOVERNANCESYNCDIGESTS);
     }
     else {
         connman.PushMessage(pnode, NetMsgType::DNGOVERNANCESYNC, uint256());
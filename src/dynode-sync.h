@@ -25,23 +25,55 @@ static const int DYNODE_SYNC_FINISHED        = 999;
 
 static const int DYNODE_SYNC_TICK_SECONDS    = 6;
 static const int DYNODE_SYNC_TIMEOUT_SECONDS = 10; // our blocks are 64 seconds, this needs to be fast
+static const int DYNODE_SYNC_TIMEOUT_MAX_SECONDS = 60; // adaptive per-asset timeouts never grow beyond this
+static const int DYNODE_SYNC_PARALLEL_PEERS  = 3; // max peers asked for the same asset in a single tick
 
 static const int DYNODE_SYNC_ENOUGH_PEERS    = 10;
 
 extern CDynodeSync dynodeSync;
 
 //
-// CDynodeSync : Sync Dynode assets in stages
+// CDynodeSyncAsset : Sync progress of a single Dynode asset
+//
+
+struct CDynodeSyncAsset
+{
+    bool fStarted;
+    bool fFinished;
+    // Count peers we've requested the asset from
+    int nAttempt;
+    // Time when the asset sync started
+    int64_t nTimeStarted;
+    // ... last bumped
+    int64_t nTimeLastBumped;
+    // Current timeout, stretched when data for this asset arrives slowly
+    int64_t nTimeout;
+
+    CDynodeSyncAsset()
+        : fStarted(false),
+          fFinished(false),
+          nAttempt(0),
+          nTimeStarted(0),
+          nTimeLastBumped(0),
+          nTimeout(DYNODE_SYNC_TIMEOUT_SECONDS)
+        {}
+};
+
+//
+// CDynodeSync : Sync Dynode assets, every asset starts as soon as the assets it depends on are synced
 //
 
 class CDynodeSync
 {
 private:
-    // Keep track of current asset
+    // Keep track of the first asset which is not synced yet
     int nRequestedDynodeAssets;
-    // Count peers we've requested the asset from
+    // Count peers we've requested that asset from
     int nRequestedDynodeAttempt;
 
+    // Progress of DYNODE_SYNC_LIST, DYNODE_SYNC_DNW and DYNODE_SYNC_GOVERNANCE
+    std::map<int, CDynodeSyncAsset> mapAssets;
+
     // Time when current Dynode asset sync started
     int64_t nTimeAssetSyncStarted;
 
@@ -54,6 +86,12 @@ private:
     void Fail();
     void ClearFulfilledRequests(CConnman& connman);
 
+    bool IsAssetReady(int nAsset);
+    bool IsAssetActive(int nAsset);
+    void StartAsset(int nAsset);
+    void FinishAsset(int nAsset, CConnman& connman);
+    void UpdateAssetState(CConnman& connman);
+
 public:
     CDynodeSync() { Reset(); }
 
@@ -69,7 +107,9 @@ public:
     int GetAttempt() { return nRequestedDynodeAttempt; }
 
     void BumpAssetLastTime(std::string strFuncName);
+    void BumpAssetLastTime(int nAsset, std::string strFuncName);
     std::string GetAssetName();
+    std::string GetAssetName(int nAsset);
     std::string GetSyncStatus();
 
     void Reset();
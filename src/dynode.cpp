@@ -506,7 +506,7 @@ bool CDynodeBroadcast::Update(CDynode* pdn, int& nDos, CConnman& connman)
             pdn->Check();
             Relay(connman);
         }
-        dynodeSync.BumpAssetLastTime("CDynodeBroadcast::Update");
+        dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodeBroadcast::Update");
     }
 
     return true;
@@ -773,7 +773,7 @@ bool CDynodePing::SimpleCheck(int& nDos)
     if(!dynodeSync.IsDynodeListSynced() && !pdn->IsPingedWithin(DYNODE_EXPIRATION_SECONDS/2)) {
         // let's bump sync timeout
         LogPrint("Dynode", "CDynodePing::CheckAndUpdate -- bumping sync timeout, dynode=%s\n", vin.prevout.ToStringShort());
-        dynodeSync.BumpAssetLastTime("CDynodePing::CheckAndUpdate");
+        dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodePing::CheckAndUpdate");
     }
 
     // let's store this ping as the last one
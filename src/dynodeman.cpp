@@ -1356,12 +1356,12 @@ void CDynodeMan::UpdateDynodeList(CDynodeBroadcast dnb, CConnman& connman)
     CDynode* pdn = Find(dnb.vin.prevout);
     if(pdn == NULL) {
         if(Add(dnb)) {
-            dynodeSync.BumpAssetLastTime("CDynodeMan::UpdateDynodeList - new");
+            dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodeMan::UpdateDynodeList - new");
         }
     } else {
         CDynodeBroadcast dnbOld = mapSeenDynodeBroadcast[CDynodeBroadcast(*pdn).GetHash()].second;
         if(pdn->UpdateFromNewBroadcast(dnb, connman)) {
-            dynodeSync.BumpAssetLastTime("CDynodeMan::UpdateDynodeList - seen");
+            dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodeMan::UpdateDynodeList - seen");
             mapSeenDynodeBroadcast.erase(dnbOld.GetHash());
         }
     }
@@ -1384,7 +1384,7 @@ bool CDynodeMan::CheckDnbAndUpdateDynodeList(CNode* pfrom, CDynodeBroadcast dnb,
             if(GetTime() - mapSeenDynodeBroadcast[hash].first > DYNODE_NEW_START_REQUIRED_SECONDS - DYNODE_MIN_DNP_SECONDS * 2) {
                 LogPrint("dynode", "CDynodeMan::CheckDnbAndUpdateDynodeList -- dynode=%s seen update\n", dnb.vin.prevout.ToStringShort());
                 mapSeenDynodeBroadcast[hash].first = GetTime();
-                dynodeSync.BumpAssetLastTime("CDynodeMan::CheckDnbAndUpdateDynodeList - seen");
+                dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodeMan::CheckDnbAndUpdateDynodeList - seen");
             }
             // did we ask this node for it?
             if(pfrom && IsDnbRecoveryRequested(hash) && GetTime() < mDnbRecoveryRequests[hash].first) {
@@ -1435,7 +1435,7 @@ bool CDynodeMan::CheckDnbAndUpdateDynodeList(CNode* pfrom, CDynodeBroadcast dnb,
 
     if(dnb.CheckOutpoint(nDos)) {
         Add(dnb);
-        dynodeSync.BumpAssetLastTime("CDynodeMan::CheckDnbAndUpdateDynodeList - new");
+        dynodeSync.BumpAssetLastTime(DYNODE_SYNC_LIST, "CDynodeMan::CheckDnbAndUpdateDynodeList - new");
         // if it matches our Dynode privkey...
         if(fDyNode && dnb.pubKeyDynode == activeDynode.pubKeyDynode) {
             dnb.nPoSeBanScore = -DYNODE_POSE_BAN_MAX_SCORE;
@@ -7,21 +7,25 @@
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile()
     : nMemoryVotes(0),
       listVotes(),
-      mapVoteIndex()
+      mapVoteIndex(),
+      nVoteDigest()
 {}
 
 CGovernanceObjectVoteFile::CGovernanceObjectVoteFile(const CGovernanceObjectVoteFile& other)
     : nMemoryVotes(other.nMemoryVotes),
       listVotes(other.listVotes),
-      mapVoteIndex()
+      mapVoteIndex(),
+      nVoteDigest()
 {
     RebuildIndex();
 }
 
 void CGovernanceObjectVoteFile::AddVote(const CGovernanceVote& vote)
 {
+    uint256 nHash = vote.GetHash();
     listVotes.push_front(vote);
-    mapVoteIndex[vote.GetHash()] = listVotes.begin();
+    mapVoteIndex[nHash] = listVotes.begin();
+    nVoteDigest ^= UintToArith256(nHash);
     ++nMemoryVotes;
 }
 
@@ -58,8 +62,10 @@ void CGovernanceObjectVoteFile::RemoveVotesFromDynode(const COutPoint& outpointD
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
         if(it->GetDynodeOutpoint() == outpointDynode) {
+            uint256 nHash = it->GetHash();
             --nMemoryVotes;
-            mapVoteIndex.erase(it->GetHash());
+            mapVoteIndex.erase(nHash);
+            nVoteDigest ^= UintToArith256(nHash);
             listVotes.erase(it++);
         }
         else {
@@ -79,6 +85,7 @@ CGovernanceObjectVoteFile& CGovernanceObjectVoteFile::operator=(const CGovernanc
 void CGovernanceObjectVoteFile::RebuildIndex()
 {
     mapVoteIndex.clear();
+    nVoteDigest = arith_uint256();
     nMemoryVotes = 0;
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
@@ -86,6 +93,7 @@ void CGovernanceObjectVoteFile::RebuildIndex()
         uint256 nHash = vote.GetHash();
         if(mapVoteIndex.find(nHash) == mapVoteIndex.end()) {
             mapVoteIndex[nHash] = it;
+            nVoteDigest ^= UintToArith256(nHash);
             ++nMemoryVotes;
             ++it;
         }
@@ -8,6 +8,7 @@
 #include <list>
 #include <map>
 
+#include "arith_uint256.h"
 #include "governance-vote.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -44,6 +45,9 @@ private:
 
     vote_m_t mapVoteIndex;
 
+    // XOR of the hashes of all votes in the file, kept up to date incrementally
+    arith_uint256 nVoteDigest;
+
 public:
     CGovernanceObjectVoteFile();
 
@@ -64,10 +68,18 @@ public:
      */
     bool GetVote(const uint256& nHash, CGovernanceVote& vote) const;
 
-    int GetVoteCount() {
+    int GetVoteCount() const {
         return nMemoryVotes;
     }
 
+    /**
+     * Order independent digest of the vote set, two files holding the same
+     * votes always return the same digest
+     */
+    uint256 GetVoteDigest() const {
+        return ArithToUint256(nVoteDigest);
+    }
+
     std::vector<CGovernanceVote> GetVotes() const;
 
     CGovernanceObjectVoteFile& operator=(const CGovernanceObjectVoteFile& other);
@@ -144,6 +144,44 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
 
     }
 
+    // PEER WANTS TO KNOW WHICH VOTES WE HAVE BEFORE ASKING FOR THEM
+    else if (strCommand == NetMsgType::DNGOVERNANCESYNCDIGESTS)
+    {
+        // Same as above, don't advertise a partial vote set
+        if (!dynodeSync.IsSynced()) return;
+
+        if(netfulfilledman.HasFulfilledRequest(pfrom->addr, NetMsgType::DNGOVERNANCESYNCDIGESTS)) {
+            LogPrint("gobject", "DNGOVERNANCESYNCDIGESTS -- peer already asked me for vote digests\n");
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+        netfulfilledman.AddFulfilledRequest(pfrom->addr, NetMsgType::DNGOVERNANCESYNCDIGESTS);
+
+        SyncVoteDigests(pfrom, connman);
+    }
+
+    // PEER TELLS US WHICH VOTES IT HAS
+    else if (strCommand == NetMsgType::DNGOVERNANCEDIGESTS)
+    {
+        std::vector<CGovernanceVoteDigest> vecDigests;
+        vRecv >> vecDigests;
+
+        if(vecDigests.size() > MAX_PEER_DIGESTS) {
+            LogPrint("gobject", "DNGOVERNANCEDIGESTS -- too many digests: %d, peer=%d\n", vecDigests.size(), pfrom->id);
+            Misbehaving(pfrom->GetId(), 20);
+            return;
+        }
+
+        LOCK(cs);
+        time_digest_pair_t& entry = mapPeerVoteDigests[pfrom->addr];
+        entry.first = GetTime() + PEER_DIGEST_EXPIRATION_TIME;
+        entry.second.clear();
+        BOOST_FOREACH(const CGovernanceVoteDigest& digest, vecDigests) {
+            entry.second[digest.nObjectHash] = digest;
+        }
+        LogPrint("gobject", "DNGOVERNANCEDIGESTS -- received %d digests, peer=%d\n", vecDigests.size(), pfrom->id);
+    }
+
     // A NEW GOVERNANCE OBJECT HAS ARRIVED
     else if (strCommand == NetMsgType::DNGOVERNANCEOBJECT)
     {
@@ -258,7 +296,7 @@ void CGovernanceManager::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         CGovernanceException exception;
         if(ProcessVote(pfrom, vote, exception, connman)) {
             LogPrint("gobject", "DNGOVERNANCEOBJECTVOTE -- %s new\n", strHash);
-            dynodeSync.BumpAssetLastTime("DNGOVERNANCEOBJECTVOTE");
+            dynodeSync.BumpAssetLastTime(DYNODE_SYNC_GOVERNANCE, "DNGOVERNANCEOBJECTVOTE");
             vote.Relay(connman);
         }
         else {
@@ -379,7 +417,7 @@ void CGovernanceManager::AddGovernanceObject(CGovernanceObject& govobj, CConnman
     // Update the rate buffer
     DynodeRateUpdate(govobj);
 
-    dynodeSync.BumpAssetLastTime("CGovernanceManager::AddGovernanceObject");
+    dynodeSync.BumpAssetLastTime(DYNODE_SYNC_GOVERNANCE, "CGovernanceManager::AddGovernanceObject");
 
     // WE MIGHT HAVE PENDING/ORPHAN VOTES FOR THIS OBJECT
 
@@ -545,6 +583,15 @@ void CGovernanceManager::UpdateCachesAndClean()
         }
     }
 
+    // forget about vote digests our peers sent a while ago
+    peer_digest_m_it pd_it = mapPeerVoteDigests.begin();
+    while(pd_it != mapPeerVoteDigests.end()) {
+        if(pd_it->second.first < GetTime())
+            mapPeerVoteDigests.erase(pd_it++);
+        else
+            ++pd_it;
+    }
+
     // forget about expired deleted objects
     hash_time_m_it s_it = mapErasedGovernanceObjects.begin();
     while(s_it != mapErasedGovernanceObjects.end()) {
@@ -678,8 +725,8 @@ void CGovernanceManager::DoMaintenance(CConnman& connman)
 
 bool CGovernanceManager::ConfirmInventoryRequest(const CInv& inv)
 {
-    // do not request objects until it's time to sync
-    if(!dynodeSync.IsWinnersListSynced()) return false;
+    // do not request objects until it's time to sync, objects only depend on the Dynode list
+    if(!dynodeSync.IsDynodeListSynced()) return false;
 
     LOCK(cs);
 
@@ -1098,6 +1145,44 @@ void CGovernanceManager::CheckPostponedObjects(CConnman& connman)
     }
 }
 
+void CGovernanceManager::SyncVoteDigests(CNode* pfrom, CConnman& connman)
+{
+    std::vector<CGovernanceVoteDigest> vecDigests;
+
+    {
+        LOCK(cs);
+
+        for(object_m_it it = mapObjects.begin(); it != mapObjects.end(); ++it) {
+            CGovernanceObject& govobj = it->second;
+            if(govobj.IsSetCachedDelete() || govobj.IsSetExpired()) continue;
+            CGovernanceObjectVoteFile& fileVotes = govobj.GetVoteFile();
+            vecDigests.push_back(CGovernanceVoteDigest(it->first, fileVotes.GetVoteDigest(), fileVotes.GetVoteCount()));
+            if(vecDigests.size() >= MAX_PEER_DIGESTS) break;
+        }
+    }
+
+    connman.PushMessage(pfrom, NetMsgType::DNGOVERNANCEDIGESTS, vecDigests);
+    LogPrint("gobject", "CGovernanceManager::SyncVoteDigests -- sent %d digests to peer=%d\n", vecDigests.size(), pfrom->id);
+}
+
+bool CGovernanceManager::IsVoteSetInSync(const CService& addr, const uint256& nHash)
+{
+    AssertLockHeld(cs);
+
+    peer_digest_m_it it = mapPeerVoteDigests.find(addr);
+    if(it == mapPeerVoteDigests.end()) return false;
+
+    digest_m_t::const_iterator it2 = it->second.second.find(nHash);
+    if(it2 == it->second.second.end()) return false;
+
+    object_m_it itObj = mapObjects.find(nHash);
+    if(itObj == mapObjects.end()) return false;
+
+    CGovernanceObjectVoteFile& fileVotes = itObj->second.GetVoteFile();
+    return it2->second.nVoteCount == fileVotes.GetVoteCount() &&
+           it2->second.nVoteDigest == fileVotes.GetVoteDigest();
+}
+
 void CGovernanceManager::RequestGovernanceObject(CNode* pfrom, const uint256& nHash, CConnman& connman, bool fUseFilter)
 {
     if(!pfrom) {
@@ -1222,6 +1307,15 @@ int CGovernanceManager::RequestGovernanceObjectVotes(const std::vector<CNode*>&
             if(nProjectedSize > SETASKFOR_MAX_SZ/2) continue;
             // to early to ask the same node
             if(mapAskedRecently[nHashGovobj].count(pnode->addr)) continue;
+            // peer has exactly the votes we have already, nothing to ask for
+            {
+                LOCK(cs);
+                if(IsVoteSetInSync(pnode->addr, nHashGovobj)) {
+                    LogPrint("gobject", "CGovernanceManager::RequestGovernanceObjectVotes -- votes for %s already in sync with peer=%d\n", nHashGovobj.ToString(), pnode->id);
+                    mapAskedRecently[nHashGovobj][pnode->addr] = nNow + nTimeout;
+                    continue;
+                }
+            }
 
             RequestGovernanceObject(pnode, nHashGovobj, connman, true);
             mapAskedRecently[nHashGovobj][pnode->addr] = nNow + nTimeout;
@@ -141,6 +141,40 @@ public:
     }
 };
 
+/**
+ * Summary of the vote set a peer holds for a single governance object.
+ * Exchanged during sync so that objects whose votes already match ours
+ * can be skipped instead of being requested again.
+ */
+class CGovernanceVoteDigest {
+public:
+    uint256 nObjectHash;
+    uint256 nVoteDigest;
+    int nVoteCount;
+
+    CGovernanceVoteDigest()
+        : nObjectHash(),
+          nVoteDigest(),
+          nVoteCount(0)
+        {}
+
+    CGovernanceVoteDigest(const uint256& nObjectHashIn, const uint256& nVoteDigestIn, int nVoteCountIn)
+        : nObjectHash(nObjectHashIn),
+          nVoteDigest(nVoteDigestIn),
+          nVoteCount(nVoteCountIn)
+        {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nObjectHash);
+        READWRITE(nVoteDigest);
+        READWRITE(nVoteCount);
+    }
+};
+
 //
 // Governance Manager : Contains all proposals for the budget
 //
@@ -218,7 +252,19 @@ public: // Types
 
     typedef hash_time_m_t::const_iterator hash_time_m_cit;
 
+    typedef std::map<uint256, CGovernanceVoteDigest> digest_m_t;
+
+    typedef std::pair<int64_t, digest_m_t> time_digest_pair_t;
+
+    typedef std::map<CService, time_digest_pair_t> peer_digest_m_t;
+
+    typedef peer_digest_m_t::iterator peer_digest_m_it;
+
 private:
+    static const size_t MAX_PEER_DIGESTS = 10000;
+
+    static const int PEER_DIGEST_EXPIRATION_TIME = 60 * 60;
+
     static const int MAX_CACHE_SIZE = 1000000;
 
     static const std::string SERIALIZATION_VERSION_STRING;
@@ -263,6 +309,9 @@ private:
 
     hash_s_t setRequestedVotes;
 
+    // vote set digests announced by our peers, used to skip objects we already have all votes for
+    peer_digest_m_t mapPeerVoteDigests;
+
     bool fRateChecksEnabled;
 
     class ScopedLockBool
@@ -301,6 +350,8 @@ public:
 
     void Sync(CNode* node, const uint256& nProp, const CBloomFilter& filter, CConnman& connman);
 
+    void SyncVoteDigests(CNode* pnode, CConnman& connman);
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 
     void DoMaintenance(CConnman& connman);
@@ -334,6 +385,7 @@ public:
         mapInvalidVotes.Clear();
         mapOrphanVotes.Clear();
         mapLastDynodeObject.clear();
+        mapPeerVoteDigests.clear();
     }
 
     std::string ToString() const;
@@ -426,6 +478,9 @@ public:
 private:
     void RequestGovernanceObject(CNode* pfrom, const uint256& nHash, CConnman& connman, bool fUseFilter = false);
 
+    /// Returns true if the peer told us it has exactly the same votes for this object as we do
+    bool IsVoteSetInSync(const CService& addr, const uint256& nHash);
+
     void AddInvalidVote(const CGovernanceVote& vote)
     {
         mapInvalidVotes.Insert(vote.GetHash(), vote);
@@ -0,0 +1,357 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "chainparams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+/** Log the progress of a builder that is catching up every this many blocks */
+static const int INDEXBUILDER_PROGRESS_INTERVAL = 10000;
+/** How long queries wait for a synced builder to index the latest block, in milliseconds */
+static const int64_t INDEXBUILDER_SYNC_TIMEOUT = 2000;
+
+static const char* const pszIndexNames[] = { "addressindex", "spentindex", "timestampindex" };
+static const int nIndexes = sizeof(pszIndexNames) / sizeof(pszIndexNames[0]);
+
+static CIndexBuilder* pIndexBuilders[nIndexes] = { NULL, NULL, NULL };
+
+// Returns the type of a P2SH (2) or P2PKH (1) script and its hash, 0 for any other script
+static int GetAddressType(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        return 1;
+    }
+    hashBytes.SetNull();
+    return 0;
+}
+
+CIndexBuilder::CIndexBuilder(Index indexIn) :
+    index(indexIn),
+    strName(pszIndexNames[indexIn]),
+    pindexBest(NULL),
+    nHeight(-1),
+    fSynced(false),
+    fNotified(false),
+    nProgress(0)
+{
+}
+
+void CIndexBuilder::Start(boost::thread_group& threadGroup)
+{
+    boost::function<void()> fn = boost::bind(&CIndexBuilder::ThreadBuild, this);
+    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, strName.c_str(), fn));
+}
+
+void CIndexBuilder::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fNotified = true;
+    cond.notify_one();
+}
+
+bool CIndexBuilder::IsAtTip() const
+{
+    LOCK(cs_main);
+    return pindexBest == chainActive.Tip();
+}
+
+void CIndexBuilder::NotifyProgress()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nProgress++;
+    condProgress.notify_all();
+}
+
+bool CIndexBuilder::WaitForTip(int64_t nTimeout)
+{
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(nTimeout);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        // Progress made after the check below wakes us up, none can be missed
+        uint64_t nSeen = nProgress;
+        lock.unlock();
+        if (fSynced && IsAtTip())
+            return true;
+        lock.lock();
+        while (nProgress == nSeen) {
+            if (!condProgress.timed_wait(lock, deadline))
+                return false;
+        }
+    }
+}
+
+bool CIndexBuilder::Init()
+{
+    // Timestamp indexes written before the time buckets existed are rebuilt with them
+    bool fUsable = true;
+    if (index == TIMESTAMP_INDEX && !(pblocktree->ReadFlag("timestampbuckets", fUsable) && fUsable)) {
+        fUsable = false;
+        LogPrintf("%s: %s has no time buckets, rebuilding\n", __func__, strName);
+    }
+
+    CBlockLocator locator;
+    if (fUsable && pblocktree->ReadIndexLocator(strName, locator) && !locator.IsNull()) {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(locator.vHave[0]);
+        if (mi != mapBlockIndex.end()) {
+            // If a reorg removed it meanwhile, ThreadBuild disconnects it first
+            pindexBest = mi->second;
+        } else {
+            // The builder runs ahead of the block index, which is flushed lazily, so after a crash its
+            // last blocks can be unknown. Resume at the last one the active chain has. Blocks past it
+            // are written again when they are connected, the index entries and totals allow that.
+            pindexBest = FindForkInGlobalIndex(chainActive, locator);
+            if (pindexBest)
+                LogPrintf("%s: %s ends at unknown block %s, resuming at height %d\n", __func__, strName,
+                    locator.vHave[0].ToString(), pindexBest->nHeight);
+        }
+    }
+
+    if (pindexBest == NULL) {
+        // Without a usable locator nothing on disk can be trusted, start over after the genesis block
+        LogPrintf("%s: building %s from scratch\n", __func__, strName);
+        if (!pblocktree->WipeIndex(strName) || !pblocktree->WriteFlag(strName, false))
+            return error("%s: failed to clear %s", __func__, strName);
+        if (index == TIMESTAMP_INDEX && !pblocktree->WriteFlag("timestampbuckets", true))
+            return error("%s: failed to write %s flag", __func__, strName);
+        LOCK(cs_main);
+        pindexBest = chainActive.Genesis();
+        if (pindexBest == NULL)
+            return error("%s: no genesis block", __func__);
+    }
+
+    nHeight = pindexBest->nHeight;
+    LogPrintf("%s: %s is at height %d\n", __func__, strName, nHeight);
+    return true;
+}
+
+void CIndexBuilder::ThreadBuild()
+{
+    if (!Init())
+        return;
+
+    int nLastLogged = nHeight;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex = NULL;
+        bool fDisconnect = false;
+        bool fWasSynced = fSynced;
+        {
+            LOCK(cs_main);
+            if (chainActive.Contains(pindexBest)) {
+                pindex = chainActive.Next(pindexBest);
+            } else if (pindexBest->GetAncestor(chainActive.Height()) != chainActive.Tip()) {
+                // Our best block was reorganized away, undo it first
+                pindex = pindexBest;
+                fDisconnect = true;
+            }
+            // Otherwise the active chain is still being rebuilt and has not reached us yet
+            fSynced = pindex == NULL && chainActive.Tip() == pindexBest;
+        }
+
+        if (pindex == NULL) {
+            if (fSynced && !fWasSynced) {
+                LogPrintf("%s: %s is synced at height %d\n", __func__, strName, nHeight);
+                NotifyProgress();
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (!fNotified)
+                cond.timed_wait(lock, boost::posix_time::seconds(1));
+            fNotified = false;
+            continue;
+        }
+
+        if (!ProcessBlock(pindex, fDisconnect)) {
+            LogPrintf("%s: failed to %s block %s, %s is no longer updated\n", __func__,
+                fDisconnect ? "disconnect" : "connect", pindex->GetBlockHash().ToString(), strName);
+            return;
+        }
+
+        if (!fSynced && nHeight - nLastLogged >= INDEXBUILDER_PROGRESS_INTERVAL) {
+            LogPrintf("%s: %s is at height %d\n", __func__, strName, nHeight);
+            nLastLogged = nHeight;
+        }
+    }
+}
+
+bool CIndexBuilder::ProcessBlock(const CBlockIndex* pindex, bool fDisconnect)
+{
+    CBlock block;
+    CBlockUndo blockUndo;
+    if (index != TIMESTAMP_INDEX) {
+        // Spent outputs come from the undo data, so the coins view is never touched
+        CDiskBlockPos pos, posUndo;
+        {
+            LOCK(cs_main);
+            pos = pindex->GetBlockPos();
+            posUndo = pindex->GetUndoPos();
+        }
+        if (!ReadBlockFromDisk(block, pos, Params().GetConsensus()))
+            return error("%s: failed to read block", __func__);
+        if (posUndo.IsNull() || !UndoReadFromDisk(blockUndo, posUndo, pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data", __func__);
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: block and undo data inconsistent", __func__);
+    }
+
+    CIndexBlockUpdate update;
+    GetBlockUpdate(block, blockUndo, pindex, fDisconnect, update);
+
+    const CBlockIndex* pindexNew = fDisconnect ? pindex->pprev : pindex;
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindexNew);
+    }
+    if (!pblocktree->WriteIndexBlock(strName, update, fDisconnect, locator))
+        return error("%s: failed to write %s", __func__, strName);
+
+    {
+        LOCK(cs_main);
+        pindexBest = pindexNew;
+    }
+    nHeight = pindexNew->nHeight;
+    NotifyProgress();
+    return true;
+}
+
+void CIndexBuilder::GetBlockUpdate(const CBlock& block, const CBlockUndo& blockUndo, const CBlockIndex* pindex, bool fDisconnect, CIndexBlockUpdate& update) const
+{
+    if (index == TIMESTAMP_INDEX) {
+        update.timestampIndex.push_back(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+        update.nHeight = pindex->nHeight;
+        return;
+    }
+
+    // Disconnecting walks the block backwards, so that outputs created and spent
+    // within the block are restored before they are removed again
+    for (unsigned int n = 0; n < block.vtx.size(); n++) {
+        const unsigned int i = fDisconnect ? block.vtx.size() - 1 - n : n;
+        const CTransaction &tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+
+        if (index == ADDRESS_INDEX && fDisconnect) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                int addressType = GetAddressType(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+                update.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), tx.vout[k].nValue));
+                update.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue()));
+            }
+        }
+
+        if (i > 0) {
+            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint &prevout = tx.vin[j].prevout;
+                const CTxOut &spent = txundo.vprevout[j].txout;
+                uint160 hashBytes;
+                int addressType = GetAddressType(spent.scriptPubKey, hashBytes);
+
+                if (index == ADDRESS_INDEX && addressType > 0) {
+                    update.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), spent.nValue * -1));
+                    update.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, prevout.hash, prevout.n),
+                        fDisconnect ? CAddressUnspentValue(spent.nValue, spent.scriptPubKey, txundo.vprevout[j].nHeight) : CAddressUnspentValue()));
+                }
+
+                if (index == SPENT_INDEX) {
+                    update.spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n),
+                        fDisconnect ? CSpentIndexValue() : CSpentIndexValue(txhash, j, pindex->nHeight, spent.nValue, addressType, hashBytes)));
+                }
+            }
+        }
+
+        if (index == ADDRESS_INDEX && !fDisconnect) {
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                uint160 hashBytes;
+                int addressType = GetAddressType(tx.vout[k].scriptPubKey, hashBytes);
+                if (addressType == 0)
+                    continue;
+                update.addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, k, false), tx.vout[k].nValue));
+                update.addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k),
+                    CAddressUnspentValue(tx.vout[k].nValue, tx.vout[k].scriptPubKey, pindex->nHeight)));
+            }
+        }
+    }
+}
+
+void MigrateInlineIndexes(const CBlockIndex* pindexTip)
+{
+    for (int i = 0; i < nIndexes; i++) {
+        bool fInline = false;
+        if (!pblocktree->ReadFlag(pszIndexNames[i], fInline) || !fInline)
+            continue;
+        CBlockLocator locator;
+        if (!pblocktree->ReadIndexLocator(pszIndexNames[i], locator)) {
+            // An inline index can be ahead of the chainstate tip after a crash. Its builder then
+            // connects those blocks again, which leaves entries, summaries and buckets as they are.
+            LogPrintf("%s: %s was maintained inline up to height %d\n", __func__, pszIndexNames[i], pindexTip->nHeight);
+            pblocktree->WriteIndexBlock(pszIndexNames[i], CIndexBlockUpdate(), false, chainActive.GetLocator(pindexTip));
+        }
+        pblocktree->WriteFlag(pszIndexNames[i], false);
+    }
+}
+
+void StartIndexBuilders(boost::thread_group& threadGroup)
+{
+    const bool fEnabled[nIndexes] = { fAddressIndex, fSpentIndex, fTimestampIndex };
+    for (int i = 0; i < nIndexes; i++) {
+        if (!fEnabled[i] || pIndexBuilders[i])
+            continue;
+        pIndexBuilders[i] = new CIndexBuilder((CIndexBuilder::Index)i);
+        RegisterValidationInterface(pIndexBuilders[i]);
+        pIndexBuilders[i]->Start(threadGroup);
+    }
+}
+
+void StopIndexBuilders()
+{
+    for (int i = 0; i < nIndexes; i++) {
+        if (!pIndexBuilders[i])
+            continue;
+        UnregisterValidationInterface(pIndexBuilders[i]);
+        delete pIndexBuilders[i];
+        pIndexBuilders[i] = NULL;
+    }
+}
+
+const CIndexBuilder* GetIndexBuilder(CIndexBuilder::Index index)
+{
+    return pIndexBuilders[index];
+}
+
+void SyncWithIndexBuilders()
+{
+    int64_t nStop = GetTimeMillis() + INDEXBUILDER_SYNC_TIMEOUT;
+    for (int i = 0; i < nIndexes; i++) {
+        CIndexBuilder* pbuilder = pIndexBuilders[i];
+        if (!pbuilder || !pbuilder->IsSynced())
+            continue;
+        pbuilder->WaitForTip(std::max(nStop - GetTimeMillis(), (int64_t)0));
+    }
+}
+
+bool WaitForIndexBuilders(int64_t nTimeout)
+{
+    int64_t nStop = GetTimeMillis() + nTimeout;
+    for (int i = 0; i < nIndexes; i++) {
+        if (pIndexBuilders[i] && !pIndexBuilders[i]->WaitForTip(std::max(nStop - GetTimeMillis(), (int64_t)0)))
+            return false;
+    }
+    return true;
+}
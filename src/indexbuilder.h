@@ -0,0 +1,95 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DYNAMIC_INDEXBUILDER_H
+#define DYNAMIC_INDEXBUILDER_H
+
+#include "validationinterface.h"
+
+#include <atomic>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+struct CIndexBlockUpdate;
+
+namespace boost {
+    class thread_group;
+} // namespace boost
+
+/**
+ * Maintains one of the optional indexes (-addressindex, -spentindex, -timestampindex)
+ * in a thread of its own. The builder keeps a locator of the last block it indexed,
+ * catches up from the block and undo files and then follows the active chain,
+ * woken by tip updates, so enabling an index never requires a reindex and never
+ * slows down block connection.
+ */
+class CIndexBuilder : public CValidationInterface
+{
+public:
+    enum Index {
+        ADDRESS_INDEX,
+        SPENT_INDEX,
+        TIMESTAMP_INDEX
+    };
+
+    CIndexBuilder(Index indexIn);
+    virtual ~CIndexBuilder() = default;
+
+    const std::string& GetName() const { return strName; }
+    /** Height of the last block in the index, -1 if none */
+    int GetHeight() const { return nHeight; }
+    /** Whether the index has caught up with the active chain */
+    bool IsSynced() const { return fSynced; }
+    /** Whether the last indexed block is the tip of the active chain */
+    bool IsAtTip() const;
+    /** Wait until the builder has indexed the tip of the active chain, false on timeout. Must not be called with cs_main held */
+    bool WaitForTip(int64_t nTimeout);
+
+    void Start(boost::thread_group& threadGroup);
+
+protected:
+    // CValidationInterface
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+
+private:
+    Index index;
+    std::string strName;
+    const CBlockIndex* pindexBest; //! protected by cs_main
+    std::atomic<int> nHeight;
+    std::atomic<bool> fSynced;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fNotified;
+    //! counts indexed blocks and arrivals at the tip, protected by mutex
+    boost::condition_variable condProgress;
+    uint64_t nProgress;
+
+    void NotifyProgress();
+
+    bool Init();
+    void ThreadBuild();
+    bool ProcessBlock(const CBlockIndex* pindex, bool fDisconnect);
+    void GetBlockUpdate(const CBlock& block, const CBlockUndo& blockUndo, const CBlockIndex* pindex, bool fDisconnect, CIndexBlockUpdate& update) const;
+};
+
+/** Hands indexes written inline by older versions over to their builders, at the chainstate tip they match */
+void MigrateInlineIndexes(const CBlockIndex* pindexTip);
+/** Start a builder for every enabled index */
+void StartIndexBuilders(boost::thread_group& threadGroup);
+/** Release the builders, their threads must have been joined already */
+void StopIndexBuilders();
+/** The builder of an index, NULL if the index is not enabled */
+const CIndexBuilder* GetIndexBuilder(CIndexBuilder::Index index);
+/** Wait a moment for builders that follow the tip to index the latest block, must not be called with cs_main held */
+void SyncWithIndexBuilders();
+/** Wait until every builder has indexed the tip of the active chain, false on timeout. Must not be called with cs_main held */
+bool WaitForIndexBuilders(int64_t nTimeout);
+
+#endif // DYNAMIC_INDEXBUILDER_H
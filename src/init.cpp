@@ -17,6 +17,7 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "dns/dns.h"
 #include "dns/dyndns.h"
 #include "dynode-payments.h"
 #include "dynode-sync.h"
@@ -28,6 +29,7 @@
 #include "dns/hooks.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #include "validation.h"
 #include "messagesigner.h"
@@ -273,8 +275,11 @@ void PrepareShutdown()
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        StopIndexBuilders();
         delete pblocktree;
         pblocktree = NULL;
+        delete pnameDB;
+        pnameDB = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -396,6 +401,8 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbopt=<db>:<option>=<n>", strprintf(_("Tune the LevelDB database <db> (chainstate, blockindex, ddns). Options: maxopenfiles (16-%d), blocksize (bytes), compression (0 or 1), writebuffer (bytes, default: a quarter of its cache, at most half of it), blockcache (percent of its cache, default: 50), bloombits (default: 10). Can be specified multiple times"), MAX_DB_OPEN_FILES));
+    strUsage += HelpMessageOpt("-dbcachewatermark=<n>", strprintf(_("Write modified coins to disk once the in-memory UTXO set cache is <n> percent full (10 to 100, default: %u)"), DEFAULT_COINS_CACHE_WATERMARK));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
@@ -415,9 +422,9 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
 
-    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
-    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
-    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses. Built in the background when first enabled (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps. Built in the background when first enabled (default: %u)"), DEFAULT_TIMESTAMPINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint. Built in the background when first enabled (default: %u)"), DEFAULT_SPENTINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -588,6 +595,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-instantsenddepth=<n>", strprintf(_("Show N confirmations for a successfully locked transaction (0-9999, default: %u)"), DEFAULT_INSTANTSEND_DEPTH));
     strUsage += HelpMessageOpt("-instantsendnotify=<cmd>", _("Execute command when a wallet InstantSend transaction is successfully locked (%s in cmd is replaced by TxID)"));
 
+    strUsage += HelpMessageGroup(_("Name and DynDNS options:"));
+    strUsage += HelpMessageOpt("-namecachesize=<n>", strprintf(_("Keep at most <n> names in memory, the others are read from the name index (default: %u)"), DEFAULT_NAME_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-namebloomfprate=<n>", strprintf(_("False positive rate of the in-memory filter over registered names (0 to 1, default: %g)"), DEFAULT_NAME_BLOOM_FPRATE));
+    strUsage += HelpMessageOpt("-namebloommaxmem=<n>", strprintf(_("Use at most <n> megabytes for the filter over registered names (0 to 512, 0 = disable, default: %u)"), DEFAULT_NAME_BLOOM_MAXMEM));
+    strUsage += HelpMessageOpt("-rebuildnameindex", strprintf(_("Rebuild the name index from the blk*.dat files on disk, without a -reindex (default: %u)"), 0));
+    strUsage += HelpMessageOpt("-nameindexthreads=<n>", strprintf(_("Set the number of threads that read blocks while the name index is rebuilt (1 to %d, default: number of cores)"), MAX_NAMEINDEX_THREADS));
+    strUsage += HelpMessageOpt("-dyndnsthreads=<n>", strprintf(_("Set the number of threads that answer DNS queries with -dyndns (1 to %d, default: %u)"), DYNDNS_MAXTHREADS, 1));
+    strUsage += HelpMessageOpt("-dyndnstcp", strprintf(_("Answer DNS queries over TCP as well as UDP with -dyndns (default: %u)"), 1));
+
 
     strUsage += HelpMessageGroup(_("Node relay options:"));
     if (showDebug)
@@ -1006,10 +1022,17 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // also see: InitParameterInteraction()
 
+    // The optional indexes are built in the background and may be switched on at any time
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+
     // if using block pruning, then disable txindex
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (fAddressIndex || fSpentIndex)
+            return InitError(_("Prune mode is incompatible with -addressindex and -spentindex."));
 #ifdef ENABLE_WALLET
         if (GetBoolArg("-rescan", false)) {
             return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
@@ -1024,12 +1047,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     int nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    // LevelDB files kept open beyond the defaults (-dbopt maxopenfiles) come out of the connection budget
+    int nCoreFileDescriptors = MIN_CORE_FILEDESCRIPTORS + GetDBExtraFileDescriptors();
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - nCoreFileDescriptors)), 0);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nCoreFileDescriptors);
+    if (nFD < nCoreFileDescriptors)
         return InitError(_("Not enough file descriptors available."));
-    nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS, nMaxConnections);
+    nMaxConnections = std::min(nFD - nCoreFileDescriptors, nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
@@ -1262,8 +1288,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
     }
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
@@ -1503,6 +1531,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    std::string strDBOptError;
+    if (!CheckDBOptions(strDBOptError))
+        return InitError(strDBOptError);
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
@@ -1510,16 +1542,22 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nNameDBCache = std::min(nTotalCache / 16, nMaxNameDBCache << 20);
+    nTotalCache -= nNameDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    nCoinCacheWatermark = std::max(10, std::min(100, (int)GetArg("-dbcachewatermark", DEFAULT_COINS_CACHE_WATERMARK)));
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
-    LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for name index database\n", nNameDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for in-memory UTXO set, written to disk at %u%%\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nCoinCacheWatermark);
 
     bool fLoaded = false;
+    // a reindex that is resumed after a restart keeps the chainstate, and so the name index
+    bool fChainStateWiped = false;
     while (!fLoaded) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1536,7 +1574,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                fChainStateWiped = fReindex || fReindexChainState;
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fChainStateWiped);
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1637,15 +1680,24 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
-    // Dynamic: check in nameindex need to be created or recreated
+    // Dynamic: open the name index, it is imported, created or recreated if needed
     // we should have block index fully loaded by now
-    extern bool createNameIndexFile();
-    if (!boost::filesystem::exists(GetDataDir() / "ddns.dat") && !createNameIndexFile())
+    if (!InitNameIndex(nNameDBCache, fChainStateWiped))
     {
-        LogPrintf("Fatal error: Failed to create nameindex (ddns.dat) file.\n");
+        LogPrintf("Fatal error: Failed to create the name index.\n");
         return false;
     }
 
+    // Dynamic: keep current name values in memory so that resolving names doesn't touch the disk
+    extern bool fillNameCache();
+    if (!fillNameCache())
+        LogPrintf("Warning: Failed to fill the name cache, names will be read from the name index.\n");
+
+    // Dynamic: lookups of names that were never registered are answered without reading the name index
+    extern bool fillNameBloom();
+    if (!fillNameBloom())
+        LogPrintf("Warning: Failed to fill the name filter, lookups of unknown names will read the name index.\n");
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1884,6 +1936,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     uiInterface.NotifyBlockTip.disconnect(BlockNotifyGenesisWait);
     }
+
+    StartIndexBuilders(threadGroup);
     
     // ********************************************************* Step 11a: setup PrivateSend
     fDyNode = GetBoolArg("-dynode", false);
@@ -2097,8 +2151,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         std::string localcf = GetArg("-dyndnslocalcf", "");
         std::string enums   = GetArg("-enumtrust", "");
         std::string tf      = GetArg("-enumtollfree", "");
+        int threads = std::max(1, std::min((int)GetArg("-dyndnsthreads", 1), DYNDNS_MAXTHREADS));
         dyndns = new DynDns(bind_ip.c_str(), port,
-        suffix.c_str(), allowed.c_str(), localcf.c_str(), enums.c_str(), tf.c_str(), verbose);
+        suffix.c_str(), allowed.c_str(), localcf.c_str(), enums.c_str(), tf.c_str(), verbose, threads,
+        GetBoolArg("-dyndnstcp", true));
         LogPrintf("dDNS server started\n");
     }
 
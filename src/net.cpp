@@ -805,24 +805,26 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendMessage>::iterator it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        const CSendMessage &msg = *it;
+        assert(msg.size() > pnode->nSendOffset);
+        size_t nChunk;
+        const char* pch = msg.GetData(pnode->nSendOffset, nChunk);
+        int nBytes = send(pnode->hSocket, pch, nChunk, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            if (pnode->nSendOffset == msg.size()) {
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= msg.size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
                 it++;
-            } else {
+            } else if ((size_t)nBytes < nChunk) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -2792,6 +2794,24 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
     unsigned int nSize = strm.size() - CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(sCommand.c_str()), nSize, pnode->id);
 
+    QueueMessage(pnode, CSendMessage(strm.begin(), strm.end()), sCommand);
+}
+
+void CConnman::PushRawMessage(CNode* pnode, const std::string& sCommand, const CMappedData& payload)
+{
+    // Only the header is built here, the payload is checksummed where it lives
+    CDataStream strm(BeginMessage(pnode, 0, 0, sCommand));
+    WriteLE32((uint8_t*)&strm[CMessageHeader::MESSAGE_SIZE_OFFSET], payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy((char*)&strm[CMessageHeader::CHECKSUM_OFFSET], hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+
+    LogPrint("net", "sending %s (%d bytes, raw) peer=%d\n",  SanitizeString(sCommand.c_str()), payload.size(), pnode->id);
+
+    QueueMessage(pnode, CSendMessage(strm.begin(), strm.end(), payload), sCommand);
+}
+
+void CConnman::QueueMessage(CNode* pnode, CSendMessage&& msg, const std::string& sCommand)
+{
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2799,11 +2819,12 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
             return;
         }
         bool optimisticSend(pnode->vSendMsg.empty());
-        pnode->vSendMsg.emplace_back(strm.begin(), strm.end());
+        size_t nMsgSize = msg.size();
+        pnode->vSendMsg.push_back(std::move(msg));
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[sCommand] += strm.size();
-        pnode->nSendSize += strm.size();
+        pnode->mapSendBytesPerMsgCmd[sCommand] += nMsgSize;
+        pnode->nSendSize += nMsgSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
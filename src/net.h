@@ -8,6 +8,7 @@
 
 #include "addrdb.h"
 #include "addrman.h"
+#include "blockfilemap.h"
 #include "bloom.h"
 #include "compat.h"
 #include "limitedmap.h"
@@ -39,6 +40,7 @@
 class CAddrMan;
 class CScheduler;
 class CNode;
+class CSendMessage;
 
 namespace boost {
     class thread_group;
@@ -206,6 +208,13 @@ public:
         PushMessageWithVersionAndFlag(pnode, 0, 0, sCommand, std::forward<Args>(args)...);
     }
 
+    /**
+     * Queue a message whose payload is already serialized elsewhere, e.g. a block
+     * in a mapped block file. The payload is sent from where it lives, without
+     * being copied into the send queue.
+     */
+    void PushRawMessage(CNode* pnode, const std::string& sCommand, const CMappedData& payload);
+
     template<typename Condition, typename Callable>
     bool ForEachNodeContinueIf(const Condition& cond, Callable&& func)
     {
@@ -436,6 +445,7 @@ private:
 
     CDataStream BeginMessage(CNode* node, int nVersion, int flags, const std::string& sCommand);
     void PushMessage(CNode* pnode, CDataStream& strm, const std::string& sCommand);
+    void QueueMessage(CNode* pnode, CSendMessage&& msg, const std::string& sCommand);
     void EndMessage(CDataStream& strm);
 
     // Network stats
@@ -662,6 +672,33 @@ public:
 };
 
 
+/** A message in a node's send queue: the serialized message, or its header followed by a raw payload */
+class CSendMessage
+{
+public:
+    CSerializeData data;
+    CMappedData payload;
+
+    template<typename Iterator>
+    CSendMessage(Iterator pbegin, Iterator pend) : data(pbegin, pend) {}
+    template<typename Iterator>
+    CSendMessage(Iterator pbegin, Iterator pend, const CMappedData& payloadIn) : data(pbegin, pend), payload(payloadIn) {}
+
+    size_t size() const { return data.size() + payload.size(); }
+
+    /** The contiguous bytes starting at nOffset into the message */
+    const char* GetData(size_t nOffset, size_t& nSizeRet) const
+    {
+        if (nOffset < data.size()) {
+            nSizeRet = data.size() - nOffset;
+            return &data[nOffset];
+        }
+        nSizeRet = size() - nOffset;
+        return (const char*)payload.begin() + (nOffset - data.size());
+    }
+};
+
+
 /** Information about a peer */
 class CNode
 {
@@ -674,7 +711,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendMessage> vSendMsg;
     CCriticalSection cs_vSend;
 
     CCriticalSection cs_vProcessMsg;
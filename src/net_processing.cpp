@@ -8,6 +8,7 @@
 #include "alert.h"
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
@@ -835,11 +836,17 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
+                    // Send block from disk, a full block straight from the mapped
+                    // block file without deserializing or copying it. The block
+                    // index already vouches for the block at this position, so
+                    // only the magic and size in front of it are checked.
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                    CMappedData data;
+                    if (inv.type == MSG_BLOCK && MapBlockFromDisk(data, mi->second->GetBlockPos(), Params().MessageStart()))
+                        connman.PushRawMessage(pfrom, NetMsgType::BLOCK, data);
+                    else if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
                         assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
+                    else if (inv.type == MSG_BLOCK)
                         connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
                     else // MSG_FILTERED_BLOCK)
                     {
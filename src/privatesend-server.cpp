@@ -13,6 +13,8 @@
 #include "util.h"
 #include "utilmoneystr.h"
 
+#include <boost/thread.hpp>
+
 CPrivateSendServer privateSendServer;
 
 void CPrivateSendServer::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
@@ -250,6 +252,12 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         int nTxInIndex = 0;
         int nTxInsCount = (int)vecTxIn.size();
 
+        if(!IsInputScriptSigsValid(vecTxIn)) {
+            LogPrint("privatesend", "PSSIGNFINALTX -- IsInputScriptSigsValid() failed, session: %d\n", nSessionID);
+            RelayStatus(STATUS_REJECTED, connman);
+            return;
+        }
+
         BOOST_FOREACH(const CTxIn txin, vecTxIn) {
             nTxInIndex++;
             if(!AddScriptSig(txin)) {
@@ -268,6 +276,8 @@ void CPrivateSendServer::SetNull()
 {
     // DN side
     vecSessionCollaterals.clear();
+    txFinalUnsigned = CTransaction();
+    mapFinalTxInIndex.clear();
 
     CPrivateSendBase::SetNull();
 }
@@ -283,7 +293,7 @@ void CPrivateSendServer::CheckPool(CConnman& connman)
         // If entries are full, create finalized transaction
         if(nState == POOL_STATE_ACCEPTING_ENTRIES && GetEntriesCount() >= CPrivateSend::GetMaxPoolTransactions()) {
             LogPrint("privatesend", "CPrivateSendServer::CheckPool -- FINALIZE TRANSACTIONS\n");
-            CommitFinalTransaction(connman);
+            CreateFinalTransaction(connman);
             return;
         }
 
@@ -323,6 +333,12 @@ void CPrivateSendServer::CreateFinalTransaction(CConnman& connman)
     finalMutableTransaction = txNew;
     LogPrint("privatesend", "CPrivateSendServer::CreateFinalTransaction -- finalMutableTransaction=%s", txNew.ToString());
 
+    // keep an immutable unsigned copy around, every scriptSig is verified against it
+    txFinalUnsigned = CTransaction(txNew);
+    mapFinalTxInIndex.clear();
+    for(unsigned int i = 0; i < txFinalUnsigned.vin.size(); i++)
+        mapFinalTxInIndex[txFinalUnsigned.vin[i].prevout] = i;
+
     // request signatures from clients
     RelayFinalTransaction(finalMutableTransaction, connman);
     SetState(POOL_STATE_SIGNING);
@@ -545,39 +561,18 @@ void CPrivateSendServer::CheckForCompleteQueue(CConnman& connman)
 // Check to make sure a given input matches an input in the pool and its scriptSig is valid
 bool CPrivateSendServer::IsInputScriptSigValid(const CTxIn& txin)
 {
-    CMutableTransaction txNew;
-    txNew.vin.clear();
-    txNew.vout.clear();
-
-    int i = 0;
-    int nTxInIndex = -1;
-    CScript sigPubKey = CScript();
-
-    BOOST_FOREACH(CPrivateSendEntry& entry, vecEntries) {
-
-        BOOST_FOREACH(const CTxPSOut& txpsout, entry.vecTxPSOut)
-            txNew.vout.push_back(txpsout);
-
-        BOOST_FOREACH(const CTxPSIn& txpsin, entry.vecTxPSIn) {
-            txNew.vin.push_back(txpsin);
-
-            if(txpsin.prevout == txin.prevout) {
-                nTxInIndex = i;
-                sigPubKey = txpsin.prevPubKey;
-            }
-            i++;
-        }
+    std::map<COutPoint, unsigned int>::const_iterator it = mapFinalTxInIndex.find(txin.prevout);
+    if(it == mapFinalTxInIndex.end()) {
+        LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+        return false;
     }
 
-    if(nTxInIndex >= 0) { //might have to do this one input at a time?
-        txNew.vin[nTxInIndex].scriptSig = txin.scriptSig;
-        LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- verifying scriptSig %s\n", ScriptToAsmStr(txin.scriptSig).substr(0,24));
-        if(!VerifyScript(txNew.vin[nTxInIndex].scriptSig, sigPubKey, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, MutableTransactionSignatureChecker(&txNew, nTxInIndex))) {
-            LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- VerifyScript() failed on input %d\n", nTxInIndex);
-            return false;
-        }
-    } else {
-        LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+    // Sighash only depends on the unsigned parts of the final transaction,
+    // so there is no need to rebuild it or copy it for every input
+    unsigned int nTxInIndex = it->second;
+    LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- verifying scriptSig %s\n", ScriptToAsmStr(txin.scriptSig).substr(0,24));
+    if(!VerifyScript(txin.scriptSig, txFinalUnsigned.vin[nTxInIndex].prevPubKey, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, TransactionSignatureChecker(&txFinalUnsigned, nTxInIndex))) {
+        LogPrint("privatesend", "CPrivateSendServer::IsInputScriptSigValid -- VerifyScript() failed on input %d\n", nTxInIndex);
         return false;
     }
 
@@ -585,6 +580,32 @@ bool CPrivateSendServer::IsInputScriptSigValid(const CTxIn& txin)
     return true;
 }
 
+bool CPrivateSendServer::IsInputScriptSigsValid(const std::vector<CTxIn>& vecTxIn)
+{
+    int nTxInsCount = (int)vecTxIn.size();
+    int nThreads = std::min(nScriptCheckThreads, nTxInsCount / PRIVATESEND_SIGCHECK_INPUTS_PER_THREAD);
+
+    if(nThreads <= 1) {
+        BOOST_FOREACH(const CTxIn& txin, vecTxIn)
+            if(!IsInputScriptSigValid(txin)) return false;
+        return true;
+    }
+
+    // txFinalUnsigned and mapFinalTxInIndex are not modified until all threads are joined,
+    // each thread only writes its own slots of vecValid
+    std::vector<char> vecValid(nTxInsCount, 0);
+    boost::thread_group threadGroup;
+    for(int nThread = 0; nThread < nThreads; nThread++) {
+        threadGroup.create_thread([this, &vecTxIn, &vecValid, nThread, nThreads, nTxInsCount]() {
+            for(int i = nThread; i < nTxInsCount; i += nThreads)
+                vecValid[i] = IsInputScriptSigValid(vecTxIn[i]);
+        });
+    }
+    threadGroup.join_all();
+
+    return std::find(vecValid.begin(), vecValid.end(), 0) == vecValid.end();
+}
+
 //
 // Add a clients transaction to the pool
 //
@@ -647,11 +668,6 @@ bool CPrivateSendServer::AddScriptSig(const CTxIn& txinNew)
         }
     }
 
-    if(!IsInputScriptSigValid(txinNew)) {
-        LogPrint("privatesend", "CPrivateSendServer::AddScriptSig -- Invalid scriptSig\n");
-        return false;
-    }
-
     LogPrint("privatesend", "CPrivateSendServer::AddScriptSig -- scriptSig=%s new\n", ScriptToAsmStr(txinNew.scriptSig).substr(0,24));
 
     BOOST_FOREACH(CTxIn& txin, finalMutableTransaction.vin) {
@@ -10,6 +10,9 @@
 
 class CPrivateSendServer;
 
+//! minimum number of signed inputs given to each thread when verifying final tx signatures
+static const int PRIVATESEND_SIGCHECK_INPUTS_PER_THREAD = 3;
+
 // The main object for accessing mixing
 extern CPrivateSendServer privateSendServer;
 
@@ -24,11 +27,16 @@ private:
     // to behave honestly. If they don't it takes their money.
     std::vector<CTransaction> vecSessionCollaterals;
 
+    // The unsigned final transaction and the position of each of its inputs,
+    // built once in CreateFinalTransaction and shared by all signature checks
+    CTransaction txFinalUnsigned;
+    std::map<COutPoint, unsigned int> mapFinalTxInIndex;
+
     bool fUnitTest;
 
     /// Add a clients entry to the pool
     bool AddEntry(const CPrivateSendEntry& entryNew, PoolMessage& nMessageIDRet);
-    /// Add signature to a txin
+    /// Add signature to a txin (scriptSig must be verified by the caller)
     bool AddScriptSig(const CTxIn& txin);
 
     /// Charge fees to bad actors (Charge clients a fee if they're abusive)
@@ -53,6 +61,8 @@ private:
     bool IsSignaturesComplete();
     /// Check to make sure a given input matches an input in the pool and its scriptSig is valid
     bool IsInputScriptSigValid(const CTxIn& txin);
+    /// Same as above for a batch of inputs, verified in parallel when possible
+    bool IsInputScriptSigsValid(const std::vector<CTxIn>& vecTxIn);
     /// Are these outputs compatible with other client in the pool?
     bool IsOutputsCompatibleWithSessionDenom(const std::vector<CTxPSOut>& vecTxPSOut);
 
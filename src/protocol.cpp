@@ -61,6 +61,8 @@ const char *SYNCSTATUSCOUNT="ssc";
 const char *DNGOVERNANCESYNC="govsync";
 const char *DNGOVERNANCEOBJECT="govobj";
 const char *DNGOVERNANCEOBJECTVOTE="govobjvote";
+const char *DNGOVERNANCESYNCDIGESTS="govdgstsync";
+const char *DNGOVERNANCEDIGESTS="govdigests";
 const char *DNVERIFY="dnv";
 };
 
@@ -136,6 +138,8 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::DNGOVERNANCESYNC,
     NetMsgType::DNGOVERNANCEOBJECT,
     NetMsgType::DNGOVERNANCEOBJECTVOTE,
+    NetMsgType::DNGOVERNANCESYNCDIGESTS,
+    NetMsgType::DNGOVERNANCEDIGESTS,
     NetMsgType::DNVERIFY,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
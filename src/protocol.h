@@ -245,6 +245,8 @@ extern const char *SYNCSTATUSCOUNT;
 extern const char *DNGOVERNANCESYNC;
 extern const char *DNGOVERNANCEOBJECT;
 extern const char *DNGOVERNANCEOBJECTVOTE;
+extern const char *DNGOVERNANCESYNCDIGESTS;
+extern const char *DNGOVERNANCEDIGESTS;
 extern const char *DNVERIFY;
 };
 
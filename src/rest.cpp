@@ -6,6 +6,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/block.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "validation.h"
@@ -215,6 +216,8 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CMappedData data;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -224,13 +227,18 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        // Binary and hex replies are the stored bytes, serve them from the mapped block file
+        if (rf == RF_BINARY || rf == RF_HEX) {
+            if (MapBlockFromDisk(data, pblockindex, Params().MessageStart()))
+                ssBlock.write((const char*)data.begin(), data.size());
+        }
+        if (ssBlock.empty()) {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            ssBlock << block;
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
         std::string binaryBlock = ssBlock.str();
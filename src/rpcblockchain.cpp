@@ -6,10 +6,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
+#include "indexbuilder.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "rpcserver.h"
@@ -20,11 +22,14 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include "consensus/validation.h"
+#include "dbwrapper.h"
 
 #include <univalue.h>
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
@@ -273,35 +278,169 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+// Queries of an index that is still being built would return partial results
+void EnsureIndexSynced(const CIndexBuilder* pbuilder)
+{
+    if (pbuilder && !pbuilder->IsSynced())
+        throw JSONRPCError(RPC_IN_WARMUP, strprintf("%s is being built, at height %d", pbuilder->GetName(), pbuilder->GetHeight()));
+}
+
+/** Upper bound for the "limit" of a getblockhashes query */
+static const size_t MAX_BLOCKHASHES_PAGE_SIZE = 10000;
+
 UniValue getblockhashes(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 2)
+    if (fHelp || params.size() < 2 || params.size() > 3)
         throw std::runtime_error(
-            "getblockhashes timestamp\n"
+            "getblockhashes high low ( options )\n"
             "\nReturns array of hashes of blocks within the timestamp range provided.\n"
             "\nArguments:\n"
             "1. high         (numeric, required) The newer block timestamp\n"
             "2. low          (numeric, required) The older block timestamp\n"
+            "3. options      (object, optional) Page through the blocks in timestamp order\n"
+            "    {\n"
+            "      \"limit\"   (numeric, optional) At most this many hashes, up to " + strprintf("%u", MAX_BLOCKHASHES_PAGE_SIZE) + "\n"
+            "      \"offset\"  (numeric, optional, default=0) Skip this many blocks first\n"
+            "      \"cursor\"  (string, optional) The cursor returned by the previous page, \"\" for the first page\n"
+            "    }\n"
             "\nResult:\n"
             "[\n"
             "  \"hash\"         (string) The block hash\n"
             "]\n"
+            "\nResult (with cursor):\n"
+            "{\n"
+            "  \"hashes\"  (array) The block hashes of this page\n"
+            "  \"cursor\"  (string) Pass this to fetch the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblockhashes", "1231614698 1231024505")
+            + HelpExampleCli("getblockhashes", "1231614698 1231024505 '{\"limit\": 100, \"offset\": 200}'")
+            + HelpExampleCli("getblockhashes", "1231614698 1231024505 '{\"limit\": 100, \"cursor\": \"\"}'")
             + HelpExampleRpc("getblockhashes", "1231614698, 1231024505")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::TIMESTAMP_INDEX));
+
     unsigned int high = params[0].get_int();
     unsigned int low = params[1].get_int();
+    size_t nOffset = 0;
+    size_t nLimit = 0;
+    bool fCursor = false;
+    CTimestampIndexKey after;
+    if (params.size() > 2) {
+        UniValue limitValue = find_value(params[2].get_obj(), "limit");
+        UniValue offsetValue = find_value(params[2].get_obj(), "offset");
+        UniValue cursorValue = find_value(params[2].get_obj(), "cursor");
+        if (!limitValue.isNull()) {
+            int64_t n = limitValue.get_int64();
+            if (n < 1 || n > (int64_t)MAX_BLOCKHASHES_PAGE_SIZE)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Limit must be between 1 and %u", MAX_BLOCKHASHES_PAGE_SIZE));
+            nLimit = n;
+        }
+        if (!offsetValue.isNull()) {
+            int64_t n = offsetValue.get_int64();
+            if (n < 0)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Offset must not be negative");
+            nOffset = n;
+        }
+        if (!cursorValue.isNull()) {
+            // A cursor is the hex encoded index key of the last block returned on the previous page
+            std::string strCursor = cursorValue.get_str();
+            fCursor = true;
+            if (!strCursor.empty()) {
+                std::vector<unsigned char> data(ParseHex(strCursor));
+                if (!IsHex(strCursor) || data.size() != after.GetSerializeSize(SER_DISK, CLIENT_VERSION))
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+                CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+                ss >> after;
+            }
+        }
+    }
     std::vector<uint256> blockHashes;
+    std::vector<CTimestampIndexKey> keys;
 
-    if (!GetTimestampIndex(high, low, blockHashes)) {
+    // one block more than asked for tells whether there is a next page
+    bool fAfter = fCursor && !after.blockHash.IsNull();
+    if (!GetTimestampIndex(high, low, blockHashes, nOffset, (fCursor && nLimit) ? nLimit + 1 : nLimit,
+                           fAfter ? &after : NULL, fCursor ? &keys : NULL)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
 
-    UniValue result(UniValue::VARR);
+    bool fMore = fCursor && nLimit && blockHashes.size() > nLimit;
+    if (fMore)
+        blockHashes.resize(nLimit);
+
+    UniValue hashes(UniValue::VARR);
     for (std::vector<uint256>::const_iterator it=blockHashes.begin(); it!=blockHashes.end(); it++) {
-        result.push_back(it->GetHex());
+        hashes.push_back(it->GetHex());
+    }
+
+    if (!fCursor)
+        return hashes;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hashes", hashes));
+    if (fMore) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << keys[nLimit - 1];
+        result.push_back(Pair("cursor", HexStr(ss.begin(), ss.end())));
+    }
+    return result;
+}
+
+UniValue gettimestampbuckets(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw std::runtime_error(
+            "gettimestampbuckets high low ( \"span\" )\n"
+            "\nReturns the number of blocks and their height range per hour or day, from the timestamp index.\n"
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp\n"
+            "2. low          (numeric, required) The older block timestamp, its whole bucket is included\n"
+            "3. \"span\"       (string, optional, default=\"day\") The bucket width, \"hour\" or \"day\"\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"start\": n,         (numeric) The first timestamp of the bucket\n"
+            "    \"blocks\": n,        (numeric) The number of blocks with a timestamp in the bucket\n"
+            "    \"firstheight\": n,   (numeric) The lowest height among them\n"
+            "    \"lastheight\": n     (numeric) The highest height among them\n"
+            "  }\n"
+            "]\n"
+            "\nBuckets without blocks are left out.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettimestampbuckets", "1231614698 1231024505 \"hour\"")
+            + HelpExampleRpc("gettimestampbuckets", "1231614698, 1231024505, \"hour\"")
+        );
+
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::TIMESTAMP_INDEX));
+
+    unsigned int high = params[0].get_int();
+    unsigned int low = params[1].get_int();
+    unsigned int span = TIMESTAMP_BUCKET_DAY;
+    if (params.size() > 2) {
+        std::string strSpan = params[2].get_str();
+        if (strSpan == "hour")
+            span = TIMESTAMP_BUCKET_HOUR;
+        else if (strSpan != "day")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Span must be \"hour\" or \"day\"");
+    }
+    std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > buckets;
+
+    if (!GetTimestampBuckets(span, high, low, buckets)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for time buckets");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> >::const_iterator it=buckets.begin(); it!=buckets.end(); it++) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("start", (int64_t)it->first.start));
+        obj.push_back(Pair("blocks", it->second.count));
+        obj.push_back(Pair("firstheight", it->second.firstHeight));
+        obj.push_back(Pair("lastheight", it->second.lastHeight));
+        result.push_back(obj);
     }
 
     return result;
@@ -535,6 +674,14 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    if (!fVerbose)
+    {
+        // The stored block is already serialized, hex encode it in place when mapped
+        CMappedData data;
+        if (MapBlockFromDisk(data, pblockindex, Params().MessageStart()))
+            return HexStr(data.begin(), data.end());
+    }
+
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -587,6 +734,77 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static void DBStatsToJSON(const CDBWrapper& db, const std::string& strName, bool fVerbose, UniValue& ret)
+{
+    if (!strName.empty() && db.GetName() != strName)
+        return;
+    const CDBProfile& profile = db.GetProfile();
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("maxopenfiles", profile.nMaxOpenFiles));
+    options.push_back(Pair("blocksize", (uint64_t)profile.nBlockSize));
+    options.push_back(Pair("compression", profile.fCompression));
+    options.push_back(Pair("writebuffer", (uint64_t)db.GetWriteBufferSize()));
+    options.push_back(Pair("blockcache", profile.nBlockCachePercent));
+    options.push_back(Pair("bloombits", profile.nBloomBits));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("options", options));
+    obj.push_back(Pair("approximatesize", db.GetApproximateSize()));
+    int64_t nMemUsage = 0;
+    ParseInt64(db.GetProperty("approximate-memory-usage"), &nMemUsage);
+    obj.push_back(Pair("memoryusage", nMemUsage));
+    UniValue levels(UniValue::VARR);
+    for (int nLevel = 0; ; nLevel++) {
+        std::string strFiles = db.GetProperty(strprintf("num-files-at-level%d", nLevel));
+        if (strFiles.empty())
+            break;
+        levels.push_back(atoi(strFiles));
+    }
+    obj.push_back(Pair("filesatlevel", levels));
+    obj.push_back(Pair("stats", db.GetProperty("stats")));
+    if (fVerbose)
+        obj.push_back(Pair("sstables", db.GetProperty("sstables")));
+    ret.push_back(Pair(db.GetName(), obj));
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw std::runtime_error(
+            "getdbstats ( \"name\" verbose )\n"
+            "\nReturns LevelDB statistics of the node's databases, to help tuning them with -dbopt.\n"
+            "\nArguments:\n"
+            "1. \"name\"      (string, optional) Only report this database (chainstate, blockindex, ddns)\n"
+            "2. verbose       (boolean, optional, default=false) Also list the table files of every level\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (object) one entry per database\n"
+            "    \"options\": { ... },      (object) the profile the database was opened with\n"
+            "    \"approximatesize\": n,    (numeric) approximate size of the database files in bytes\n"
+            "    \"memoryusage\": n,        (numeric) approximate bytes used by the memtables and the block cache\n"
+            "    \"filesatlevel\": [n,...], (array) number of table files at each level\n"
+            "    \"stats\": \"...\",          (string) LevelDB compaction statistics\n"
+            "    \"sstables\": \"...\"        (string, verbose only) table files of every level\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleCli("getdbstats", "\"chainstate\" true")
+            + HelpExampleRpc("getdbstats", "\"chainstate\"")
+        );
+
+    std::string strName;
+    if (params.size() > 0)
+        strName = params[0].get_str();
+    bool fVerbose = params.size() > 1 && params[1].get_bool();
+
+    UniValue ret(UniValue::VOBJ);
+    ForEachDBWrapper(boost::bind(&DBStatsToJSON, _1, boost::cref(strName), fVerbose, boost::ref(ret)));
+    if (!strName.empty() && ret.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database " + strName);
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -757,6 +975,22 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) heighest block available\n"
+            "  \"coinscache\": {           (object) state of the in-memory UTXO set cache\n"
+            "     \"usage\": xxxxx,          (numeric) bytes in use\n"
+            "     \"limit\": xxxxx,          (numeric) bytes it may use (-dbcache)\n"
+            "     \"watermark\": xxxxx,      (numeric) bytes in use at which modified coins are written to disk\n"
+            "     \"entries\": xxxxx,        (numeric) number of cached transactions\n"
+            "     \"flushes\": xxxxx,        (numeric) number of times it was written to disk since startup\n"
+            "     \"lastflushtime\": xxx,    (numeric) duration of the last write in milliseconds\n"
+            "     \"lastflushdropped\": xxx, (numeric) unmodified entries dropped after the last write\n"
+            "     \"hitrate\": x.xxx         (numeric) share of lookups answered from the cache since the last write\n"
+            "  },\n"
+            "  \"indexes\": {              (object) state of the enabled optional indexes\n"
+            "     \"xxxx\": {                (object) addressindex, spentindex or timestampindex\n"
+            "        \"height\": xxxxxx,     (numeric) height of the last indexed block, -1 if none\n"
+            "        \"synced\": xx          (boolean) if the index has caught up with the chain, queries fail until it has\n"
+            "     }, ...\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -795,6 +1029,33 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("chainwork",             chainActive.Tip()->nChainWork.GetHex()));
     obj.push_back(Pair("pruned",                fPruneMode));
 
+    UniValue coinscache(UniValue::VOBJ);
+    uint64_t nHits, nMisses;
+    pcoinsTip->GetCacheHits(nHits, nMisses);
+    nHits -= coinsFlushStats.nHitsAtFlush;
+    nMisses -= coinsFlushStats.nMissesAtFlush;
+    coinscache.push_back(Pair("usage",            (uint64_t)pcoinsTip->DynamicMemoryUsage()));
+    coinscache.push_back(Pair("limit",            (uint64_t)nCoinCacheUsage));
+    coinscache.push_back(Pair("watermark",        (uint64_t)(nCoinCacheUsage / 100 * nCoinCacheWatermark)));
+    coinscache.push_back(Pair("entries",          (uint64_t)pcoinsTip->GetCacheSize()));
+    coinscache.push_back(Pair("flushes",          coinsFlushStats.nFlushes));
+    coinscache.push_back(Pair("lastflushtime",    0.001 * coinsFlushStats.nLastFlushTime));
+    coinscache.push_back(Pair("lastflushdropped", (uint64_t)coinsFlushStats.nLastFlushTrimmed));
+    coinscache.push_back(Pair("hitrate",          nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+    obj.push_back(Pair("coinscache",            coinscache));
+    UniValue indexes(UniValue::VOBJ);
+    const CIndexBuilder::Index vIndexes[] = { CIndexBuilder::ADDRESS_INDEX, CIndexBuilder::SPENT_INDEX, CIndexBuilder::TIMESTAMP_INDEX };
+    BOOST_FOREACH(CIndexBuilder::Index index, vIndexes) {
+        const CIndexBuilder* pbuilder = GetIndexBuilder(index);
+        if (!pbuilder)
+            continue;
+        UniValue builder(UniValue::VOBJ);
+        builder.push_back(Pair("height", pbuilder->GetHeight()));
+        builder.push_back(Pair("synced", pbuilder->IsSynced()));
+        indexes.push_back(Pair(pbuilder->GetName(), builder));
+    }
+    obj.push_back(Pair("indexes",               indexes));
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
     UniValue softforks(UniValue::VARR);
@@ -128,6 +128,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "voteraw", 5 },
     { "getblockhashes", 0 },
     { "getblockhashes", 1 },
+    { "getblockhashes", 2 },
+    { "gettimestampbuckets", 0 },
+    { "gettimestampbuckets", 1 },
+    { "getdbstats", 1 },
     { "getspentinfo", 0},
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
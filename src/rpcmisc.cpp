@@ -10,6 +10,7 @@
 #ifdef ENABLE_WALLET
 #include "dynode-sync.h"
 #endif
+#include "indexbuilder.h"
 #include "init.h"
 #include "validation.h"
 #include "net.h"
@@ -625,6 +626,106 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+/** Upper bound for the "limit" of a paginated address query */
+static const size_t MAX_ADDRESS_PAGE_SIZE = 10000;
+
+// Reads "limit" and "cursor" from the request object, returns false for an unpaginated request
+static bool getPageFromParams(const UniValue& params, size_t &nLimit, std::string &strCursor)
+{
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    nLimit = MAX_ADDRESS_PAGE_SIZE;
+    if (!limitValue.isNull()) {
+        int64_t n = limitValue.get_int64();
+        if (n < 1 || n > (int64_t)MAX_ADDRESS_PAGE_SIZE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Limit must be between 1 and %u", MAX_ADDRESS_PAGE_SIZE));
+        nLimit = n;
+    }
+    if (!cursorValue.isNull())
+        strCursor = cursorValue.get_str();
+    return true;
+}
+
+// A cursor is the hex encoded index key of the last entry returned on the previous page
+template<typename K>
+static std::string encodeAddressCursor(const K &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template<typename K>
+static size_t decodeAddressCursor(const std::string &strCursor, const std::vector<std::pair<uint160, int> > &addresses, K &key)
+{
+    std::vector<unsigned char> data(ParseHex(strCursor));
+    if (!IsHex(strCursor) || data.size() != key.GetSerializeSize(SER_DISK, CLIENT_VERSION))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    ss >> key;
+
+    // Pages walk the addresses in the order they were requested
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (addresses[i].first == key.hashBytes && addresses[i].second == (int)key.type)
+            return i;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not belong to the requested addresses");
+}
+
+// Collects the transactions the addresses before nAddress have between two heights, pages list
+// those under the earlier address already. The entries of a transaction all have its height.
+static void getTxsOfEarlierAddresses(const std::vector<std::pair<uint160, int> > &addresses, size_t nAddress,
+                                     int nStartHeight, int nEndHeight, std::set<uint256> &setTxids)
+{
+    for (size_t i = 0; i < nAddress; i++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(addresses[i].first, addresses[i].second, addressIndex, std::max(nStartHeight, 1), nEndHeight))
+            continue;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++)
+            setTxids.insert(it->first.txhash);
+    }
+}
+
+static UniValue addressUnspentToJSON(const std::pair<CAddressUnspentKey, CAddressUnspentValue> &entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("address", address));
+    output.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    output.push_back(Pair("outputIndex", (int)entry.first.index));
+    output.push_back(Pair("script", HexStr(entry.second.script.begin(), entry.second.script.end())));
+    output.push_back(Pair("satoshis", entry.second.satoshis));
+    output.push_back(Pair("height", entry.second.blockHeight));
+    return output;
+}
+
+static UniValue addressDeltaToJSON(const std::pair<CAddressIndexKey, CAmount> &entry)
+{
+    std::string address;
+    if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+    }
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", entry.second));
+    delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)entry.first.index));
+    delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+    delta.push_back(Pair("height", entry.first.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
 UniValue getaddressmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -709,6 +810,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
             "    ]\n"
+            "  \"limit\" (number, optional) Return at most this many entries and a cursor for the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -721,11 +824,20 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"height\"  (number) The block height\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or cursor)\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs of this page, ordered by address and outpoint\n"
+            "  \"cursor\"  (string) Pass this to fetch the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}'")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::ADDRESS_INDEX));
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
@@ -734,6 +846,36 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
+    size_t nLimit = 0;
+    std::string strCursor;
+    if (getPageFromParams(params, nLimit, strCursor)) {
+        CAddressUnspentKey cursorKey;
+        size_t nFirst = strCursor.empty() ? 0 : decodeAddressCursor(strCursor, addresses, cursorKey);
+
+        // Read one entry past the limit to learn whether another page follows
+        for (size_t i = nFirst; i < addresses.size() && unspentOutputs.size() <= nLimit; i++) {
+            const CAddressUnspentKey *pAfter = (!strCursor.empty() && i == nFirst) ? &cursorKey : NULL;
+            if (!GetAddressUnspent(addresses[i].first, addresses[i].second, unspentOutputs, pAfter, nLimit + 1 - unspentOutputs.size())) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+
+        bool fMore = unspentOutputs.size() > nLimit;
+        if (fMore)
+            unspentOutputs.resize(nLimit);
+
+        UniValue utxos(UniValue::VARR);
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+            utxos.push_back(addressUnspentToJSON(*it));
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("utxos", utxos));
+        if (fMore)
+            result.push_back(Pair("cursor", encodeAddressCursor(unspentOutputs.back().first)));
+        return result;
+    }
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
@@ -745,19 +887,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
-        UniValue output(UniValue::VOBJ);
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        output.push_back(Pair("address", address));
-        output.push_back(Pair("txid", it->first.txhash.GetHex()));
-        output.push_back(Pair("outputIndex", (int)it->first.index));
-        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
-        output.push_back(Pair("satoshis", it->second.satoshis));
-        output.push_back(Pair("height", it->second.blockHeight));
-        result.push_back(output);
+        result.push_back(addressUnspentToJSON(*it));
     }
 
     return result;
@@ -778,6 +908,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many entries and a cursor for the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -790,11 +922,19 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or cursor):\n"
+            "{\n"
+            "  \"deltas\"  (array) The deltas of this page, ordered by address and height\n"
+            "  \"cursor\"  (string) Pass this to fetch the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::ADDRESS_INDEX));
+
 
     UniValue startValue = find_value(params[0].get_obj(), "start");
     UniValue endValue = find_value(params[0].get_obj(), "end");
@@ -818,6 +958,38 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    size_t nLimit = 0;
+    std::string strCursor;
+    if (getPageFromParams(params, nLimit, strCursor)) {
+        CAddressIndexKey cursorKey;
+        size_t nFirst = strCursor.empty() ? 0 : decodeAddressCursor(strCursor, addresses, cursorKey);
+
+        // Read one entry past the limit to learn whether another page follows
+        for (size_t i = nFirst; i < addresses.size() && addressIndex.size() <= nLimit; i++) {
+            const CAddressIndexKey *pAfter = (!strCursor.empty() && i == nFirst) ? &cursorKey : NULL;
+            if (!GetAddressIndex(addresses[i].first, addresses[i].second, addressIndex,
+                                 (start > 0 && end > 0) ? start : 0, (start > 0 && end > 0) ? end : 0,
+                                 pAfter, nLimit + 1 - addressIndex.size())) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+
+        bool fMore = addressIndex.size() > nLimit;
+        if (fMore)
+            addressIndex.resize(nLimit);
+
+        UniValue deltas(UniValue::VARR);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            deltas.push_back(addressDeltaToJSON(*it));
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("deltas", deltas));
+        if (fMore)
+            result.push_back(Pair("cursor", encodeAddressCursor(addressIndex.back().first)));
+        return result;
+    }
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
@@ -833,19 +1005,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        result.push_back(delta);
+        result.push_back(addressDeltaToJSON(*it));
     }
 
     return result;
@@ -869,39 +1029,44 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (number) The number of transactions sending to or spending from the address(es)\n"
+            "  \"utxocount\"  (number) The number of unspent outputs\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}'")
             + HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::ADDRESS_INDEX));
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
+    int64_t txCount = 0;
+    int64_t unspentCount = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressSummary summary;
+        if (!GetAddressSummary((*it).first, (*it).second, summary)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += summary.balance;
+        received += summary.received;
+        txCount += summary.txCount;
+        unspentCount += summary.unspentCount;
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    result.push_back(Pair("txcount", txCount));
+    result.push_back(Pair("utxocount", unspentCount));
 
     return result;
 
@@ -922,17 +1087,27 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many entries and a cursor for the next page\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit or cursor):\n"
+            "{\n"
+            "  \"txids\"  (array) The txids of this page, ordered by address and height, each listed once\n"
+            "  \"cursor\"  (string) Pass this to fetch the next page, absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"D5nRy9Tf7Zsef8gMGL2fhWA9ZslrP4K5tf\"]}")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::ADDRESS_INDEX));
+
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
@@ -952,6 +1127,61 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    size_t nLimit = 0;
+    std::string strCursor;
+    if (getPageFromParams(params, nLimit, strCursor)) {
+        CAddressIndexKey cursorKey;
+        size_t nFirst = strCursor.empty() ? 0 : decodeAddressCursor(strCursor, addresses, cursorKey);
+
+        UniValue txids(UniValue::VARR);
+        bool fMore = false;
+        for (size_t i = nFirst; i < addresses.size() && !fMore; i++) {
+            // A repeated address has nothing to add
+            if (std::find(addresses.begin(), addresses.begin() + i, addresses[i]) != addresses.begin() + i)
+                continue;
+            // The entries of a transaction are adjacent in the index, so a page
+            // always ends behind the last entry of its last transaction
+            bool fAfter = !strCursor.empty() && i == nFirst;
+            CAddressIndexKey after = fAfter ? cursorKey : CAddressIndexKey();
+            uint256 lastTx = after.txhash;
+            while (!fMore) {
+                addressIndex.clear();
+                if (!GetAddressIndex(addresses[i].first, addresses[i].second, addressIndex,
+                                     (start > 0 && end > 0) ? start : 0, (start > 0 && end > 0) ? end : 0,
+                                     fAfter ? &after : NULL, nLimit + 1)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+                // The batch is ordered by height, one lookup per earlier address covers all of it
+                std::set<uint256> setEarlierTxids;
+                if (i > 0 && !addressIndex.empty())
+                    getTxsOfEarlierAddresses(addresses, i, addressIndex.front().first.blockHeight, addressIndex.back().first.blockHeight, setEarlierTxids);
+                for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+                    if (it->first.txhash != lastTx) {
+                        bool fSeen = setEarlierTxids.count(it->first.txhash) > 0;
+                        if (!fSeen && txids.size() == nLimit) {
+                            fMore = true;
+                            break;
+                        }
+                        if (!fSeen)
+                            txids.push_back(it->first.txhash.GetHex());
+                        lastTx = it->first.txhash;
+                    }
+                    after = it->first;
+                    fAfter = true;
+                    cursorKey = it->first;
+                }
+                if (addressIndex.size() <= nLimit)
+                    break;
+            }
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (fMore)
+            result.push_back(Pair("cursor", encodeAddressCursor(cursorKey)));
+        return result;
+    }
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
@@ -1013,6 +1243,9 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
         );
 
+    SyncWithIndexBuilders();
+    EnsureIndexSynced(GetIndexBuilder(CIndexBuilder::SPENT_INDEX));
+
     UniValue txidValue = find_value(params[0].get_obj(), "txid");
     UniValue indexValue = find_value(params[0].get_obj(), "index");
 
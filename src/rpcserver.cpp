@@ -280,6 +280,7 @@ static const CRPCCommand vRPCCommands[] =
     { "Blockchain",         "getblockcount",          &getblockcount,          true  },
     { "Blockchain",         "getblock",               &getblock,               true  },
     { "Blockchain",         "getblockhashes",         &getblockhashes,         true  },
+    { "Blockchain",         "gettimestampbuckets",    &gettimestampbuckets,    true  },
     { "Blockchain",         "getblockhash",           &getblockhash,           true  },
     { "Blockchain",         "getblockheader",         &getblockheader,         true  },
     { "Blockchain",         "getblockheaders",        &getblockheaders,        true  },
@@ -291,6 +292,7 @@ static const CRPCCommand vRPCCommands[] =
     { "Blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
     { "Blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "Blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "Blockchain",         "getdbstats",             &getdbstats,             true  },
     { "Blockchain",         "verifychain",            &verifychain,            true  },
     { "Blockchain",         "getspentinfo",           &getspentinfo,           false },
 
@@ -411,6 +413,7 @@ static const CRPCCommand vRPCCommands[] =
     { "DDNS",               "name_scan",              &name_scan,              true  },
     { "DDNS",               "name_filter",            &name_filter,            true  },
     { "DDNS",               "name_show",              &name_show,              true  },
+    { "DDNS",               "name_cacheinfo",         &name_cacheinfo,         true  },
     { "DDNS",               "name_history",           &name_history,           true  },
     { "DDNS",               "name_mempool",           &name_mempool,           true  },
     { "DDNS",               "name_new",               &name_new,               true  },
@@ -31,6 +31,7 @@ namespace RPCServer
 }
 
 class CBlockIndex;
+class CIndexBuilder;
 class CNetAddr;
 
 class JSONRequest
@@ -173,6 +174,7 @@ extern std::string HelpExampleCli(const std::string& methodname, const std::stri
 extern std::string HelpExampleRpc(const std::string& methodname, const std::string& args);
 
 extern void EnsureWalletIsUnlocked();
+extern void EnsureIndexSynced(const CIndexBuilder* pbuilder); // in rpcblockchain.cpp
 
 extern UniValue getconnectioncount(const UniValue& params, bool fHelp); // in rpcnet.cpp
 extern UniValue getmemoryinfo(const UniValue& params, bool fHelp);
@@ -204,6 +206,7 @@ extern UniValue importwallet(const UniValue& params, bool fHelp);
 extern UniValue name_scan(const UniValue& params, bool fHelp); // for DDNS
 extern UniValue name_filter(const UniValue& params, bool fHelp);
 extern UniValue name_show(const UniValue& params, bool fHelp);
+extern UniValue name_cacheinfo(const UniValue& params, bool fHelp);
 extern UniValue name_history(const UniValue& params, bool fHelp);
 extern UniValue name_mempool(const UniValue& params, bool fHelp);
 extern UniValue name_new(const UniValue& params, bool fHelp);
@@ -306,11 +309,13 @@ extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp);
+extern UniValue gettimestampbuckets(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getblockheaders(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue getdbstats(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
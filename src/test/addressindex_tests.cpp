@@ -0,0 +1,339 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "indexbuilder.h"
+#include "key.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include "test/test_dynamic.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static void CheckSummary(CBlockTreeDB& db, const uint160& hash, CAmount balance, CAmount received, int64_t txCount, int64_t unspentCount)
+{
+    CAddressSummary summary;
+    BOOST_CHECK(db.ReadAddressSummary(hash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.balance, balance);
+    BOOST_CHECK_EQUAL(summary.received, received);
+    BOOST_CHECK_EQUAL(summary.txCount, txCount);
+    BOOST_CHECK_EQUAL(summary.unspentCount, unspentCount);
+}
+
+BOOST_AUTO_TEST_CASE(address_summary)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(std::vector<unsigned char>(20, 0x0a)), hashB(std::vector<unsigned char>(20, 0x0b));
+    uint256 tx1 = uint256S("01"), tx2 = uint256S("02");
+
+    // block 1: tx1 pays 5 and 3 to A and 2 to B
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1;
+    vBlock1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 1, 1, tx1, 0, false), 5 * COIN));
+    vBlock1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 1, 1, tx1, 1, false), 3 * COIN));
+    vBlock1.push_back(std::make_pair(CAddressIndexKey(1, hashB, 1, 1, tx1, 2, false), 2 * COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock1));
+    CheckSummary(db, hashA, 8 * COIN, 8 * COIN, 1, 2);
+    CheckSummary(db, hashB, 2 * COIN, 2 * COIN, 1, 1);
+
+    // block 2: tx2 spends the 5 of A, pays 4 to B and 1 back to A
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock2;
+    vBlock2.push_back(std::make_pair(CAddressIndexKey(1, hashA, 2, 1, tx2, 0, true), -5 * COIN));
+    vBlock2.push_back(std::make_pair(CAddressIndexKey(1, hashB, 2, 1, tx2, 0, false), 4 * COIN));
+    vBlock2.push_back(std::make_pair(CAddressIndexKey(1, hashA, 2, 1, tx2, 1, false), 1 * COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    CheckSummary(db, hashA, 4 * COIN, 9 * COIN, 2, 2);
+    CheckSummary(db, hashB, 6 * COIN, 6 * COIN, 2, 2);
+
+    // replaying a block that is already in the index, as after a crash, changes nothing
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    CheckSummary(db, hashA, 4 * COIN, 9 * COIN, 2, 2);
+    CheckSummary(db, hashB, 6 * COIN, 6 * COIN, 2, 2);
+
+    // summaries match the deltas they were built from
+    BOOST_CHECK(db.BuildAddressSummaries());
+    CheckSummary(db, hashA, 4 * COIN, 9 * COIN, 2, 2);
+    CheckSummary(db, hashB, 6 * COIN, 6 * COIN, 2, 2);
+
+    // disconnecting block 2 restores the previous totals
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    CheckSummary(db, hashA, 8 * COIN, 8 * COIN, 1, 2);
+    CheckSummary(db, hashB, 2 * COIN, 2 * COIN, 1, 1);
+
+    // and disconnecting it twice does too
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    CheckSummary(db, hashA, 8 * COIN, 8 * COIN, 1, 2);
+    CheckSummary(db, hashB, 2 * COIN, 2 * COIN, 1, 1);
+
+    // without any deltas left the summary is gone
+    BOOST_CHECK(db.EraseAddressIndex(vBlock1));
+    CheckSummary(db, hashA, 0, 0, 0, 0);
+    BOOST_CHECK(!db.Exists(std::make_pair('m', CAddressIndexIteratorKey(1, hashA))));
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pages)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA(std::vector<unsigned char>(20, 0x0a)), hashB(std::vector<unsigned char>(20, 0x0b));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vDeltas;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (int i = 1; i <= 5; i++) {
+        uint256 txid = ArithToUint256(arith_uint256(i));
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(1, hashA, i, 1, txid, 0, false), i * COIN));
+        vDeltas.push_back(std::make_pair(CAddressIndexKey(1, hashB, i, 1, txid, 1, false), COIN));
+        vUnspent.push_back(std::make_pair(CAddressUnspentKey(1, hashA, txid, 0), CAddressUnspentValue(i * COIN, CScript(), i)));
+    }
+    BOOST_CHECK(db.WriteAddressIndex(vDeltas));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUnspent));
+
+    // walking A two entries at a time sees every entry exactly once
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAll, vPage;
+    BOOST_CHECK(db.ReadAddressIndex(hashA, 1, vPage, 0, 0, NULL, 2));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    while (!vPage.empty()) {
+        vAll.insert(vAll.end(), vPage.begin(), vPage.end());
+        CAddressIndexKey after = vPage.back().first;
+        vPage.clear();
+        BOOST_CHECK(db.ReadAddressIndex(hashA, 1, vPage, 0, 0, &after, 2));
+    }
+    BOOST_CHECK_EQUAL(vAll.size(), 5U);
+    for (unsigned int i = 0; i < vAll.size(); i++) {
+        BOOST_CHECK_EQUAL(vAll[i].first.blockHeight, (int)i + 1);
+        BOOST_CHECK(vAll[i].first.hashBytes == hashA);
+    }
+
+    // the height range still applies behind a cursor
+    vPage.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashA, 1, vPage, 2, 4, &vAll[1].first, 10));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK_EQUAL(vPage.back().first.blockHeight, 4);
+
+    // and so does the start of the range, for a cursor in front of it
+    vPage.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashA, 1, vPage, 3, 4, &vAll[0].first, 10));
+    BOOST_CHECK_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK_EQUAL(vPage.front().first.blockHeight, 3);
+
+    // unspent outputs page the same way
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentPage;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashA, 1, vUnspentPage, NULL, 3));
+    BOOST_CHECK_EQUAL(vUnspentPage.size(), 3U);
+    CAddressUnspentKey afterUnspent = vUnspentPage.back().first;
+    vUnspentPage.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashA, 1, vUnspentPage, &afterUnspent, 3));
+    BOOST_CHECK_EQUAL(vUnspentPage.size(), 2U);
+}
+
+static void CheckBucket(CBlockTreeDB& db, unsigned int span, unsigned int time, int64_t count, int firstHeight, int lastHeight)
+{
+    std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > buckets;
+    BOOST_CHECK(db.ReadTimestampBuckets(span, time, time, buckets));
+    BOOST_REQUIRE_EQUAL(buckets.size(), count ? 1U : 0U);
+    if (!count)
+        return;
+    BOOST_CHECK_EQUAL(buckets[0].first.start, time - time % span);
+    BOOST_CHECK_EQUAL(buckets[0].second.count, count);
+    BOOST_CHECK_EQUAL(buckets[0].second.firstHeight, firstHeight);
+    BOOST_CHECK_EQUAL(buckets[0].second.lastHeight, lastHeight);
+}
+
+BOOST_AUTO_TEST_CASE(timestamp_buckets)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    const unsigned int nHour = 1000 * TIMESTAMP_BUCKET_HOUR;
+    // block 4 has an earlier timestamp than block 3, which is in the next hour of the same day
+    const unsigned int vTimes[] = { nHour + 10, nHour + 20, nHour + TIMESTAMP_BUCKET_HOUR + 5, nHour + 15 };
+    CBlockLocator locator;
+    for (int i = 0; i < 4; i++) {
+        CIndexBlockUpdate update;
+        update.timestampIndex.push_back(CTimestampIndexKey(vTimes[i], ArithToUint256(arith_uint256(i + 1))));
+        update.nHeight = i + 1;
+        BOOST_CHECK(db.WriteIndexBlock("timestampindex", update, false, locator));
+    }
+    CheckBucket(db, TIMESTAMP_BUCKET_HOUR, nHour, 3, 1, 4);
+    CheckBucket(db, TIMESTAMP_BUCKET_HOUR, nHour + TIMESTAMP_BUCKET_HOUR, 1, 3, 3);
+    CheckBucket(db, TIMESTAMP_BUCKET_DAY, nHour, 4, 1, 4);
+
+    // a range covers every bucket it touches
+    std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > buckets;
+    BOOST_CHECK(db.ReadTimestampBuckets(TIMESTAMP_BUCKET_HOUR, nHour + TIMESTAMP_BUCKET_HOUR, nHour + 30, buckets));
+    BOOST_CHECK_EQUAL(buckets.size(), 2U);
+
+    // pages of the index itself in timestamp order
+    std::vector<uint256> hashes;
+    BOOST_CHECK(db.ReadTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, hashes, 1, 2));
+    BOOST_REQUIRE_EQUAL(hashes.size(), 2U);
+    BOOST_CHECK(hashes[0] == ArithToUint256(arith_uint256(4)));
+    BOOST_CHECK(hashes[1] == ArithToUint256(arith_uint256(2)));
+
+    // and resumed behind the last key of a page, which gives the same order
+    std::vector<uint256> vAll;
+    std::vector<CTimestampIndexKey> keys;
+    BOOST_CHECK(db.ReadTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, vAll));
+    hashes.clear();
+    BOOST_CHECK(db.ReadTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, hashes, 0, 1, NULL, &keys));
+    while (!keys.empty()) {
+        CTimestampIndexKey after = keys.back();
+        keys.clear();
+        BOOST_CHECK(db.ReadTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, hashes, 0, 1, &after, &keys));
+    }
+    BOOST_CHECK(hashes == vAll);
+
+    // disconnecting the highest block of a bucket finds the new bounds
+    for (int i = 3; i >= 2; i--) {
+        CIndexBlockUpdate update;
+        update.timestampIndex.push_back(CTimestampIndexKey(vTimes[i], ArithToUint256(arith_uint256(i + 1))));
+        update.nHeight = i + 1;
+        BOOST_CHECK(db.WriteIndexBlock("timestampindex", update, true, locator));
+    }
+    CheckBucket(db, TIMESTAMP_BUCKET_HOUR, nHour, 2, 1, 2);
+    CheckBucket(db, TIMESTAMP_BUCKET_HOUR, nHour + TIMESTAMP_BUCKET_HOUR, 0, 0, 0);
+    CheckBucket(db, TIMESTAMP_BUCKET_DAY, nHour, 2, 1, 2);
+
+    // and wiping the index removes the buckets
+    BOOST_CHECK(db.WipeIndex("timestampindex"));
+    CheckBucket(db, TIMESTAMP_BUCKET_DAY, nHour, 0, 0, 0);
+}
+
+static size_t CountTimestampIndex()
+{
+    std::vector<uint256> hashes;
+    BOOST_CHECK(GetTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, hashes));
+    return hashes.size();
+}
+
+static size_t CountAddressIndex(const uint160& hash)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(GetAddressIndex(hash, 1, addressIndex));
+    return addressIndex.size();
+}
+
+BOOST_FIXTURE_TEST_CASE(index_builder_catch_up, TestChain100Setup)
+{
+    // enabling the indexes on an existing chain builds them in the background
+    fAddressIndex = fSpentIndex = fTimestampIndex = true;
+    boost::thread_group threadGroup;
+    StartIndexBuilders(threadGroup);
+    BOOST_CHECK(WaitForIndexBuilders(60000));
+
+    // every block after the genesis block, the fixture mines COINBASE_MATURITY of them
+    const size_t nBlocks = chainActive.Height();
+    BOOST_CHECK(nBlocks > 0);
+    BOOST_CHECK_EQUAL(CountTimestampIndex(), nBlocks);
+
+    // a block that pays to a key hash and spends the first coinbase
+    CKey key;
+    key.MakeNewKey(true);
+    uint160 hashKey = key.GetPubKey().GetID();
+    CScript scriptKeyHash = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptCoinbase = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptKeyHash;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(coinbaseKey.Sign(SignatureHash(scriptCoinbase, spend, 0, SIGHASH_ALL), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, spend), scriptKeyHash);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(WaitForIndexBuilders(60000));
+
+    // the builders follow the tip: the coinbase and the payment to the key, the spent coinbase
+    BOOST_CHECK_EQUAL(CountTimestampIndex(), nBlocks + 1);
+    BOOST_CHECK_EQUAL(CountAddressIndex(hashKey), 2U);
+    CAddressSummary summary;
+    BOOST_CHECK(GetAddressSummary(hashKey, 1, summary));
+    BOOST_CHECK_EQUAL(summary.txCount, 2);
+    BOOST_CHECK_EQUAL(summary.received, block.vtx[0].vout[0].nValue + 11 * CENT);
+    CSpentIndexKey spentKey(coinbaseTxns[0].GetHash(), 0);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(GetSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(spentValue.txid == spend.GetHash());
+
+    // each locator leads back to the genesis block through older blocks
+    CBlockLocator locator;
+    BOOST_CHECK(pblocktree->ReadIndexLocator("addressindex", locator));
+    BOOST_CHECK(locator.vHave.size() > 1);
+    BOOST_CHECK(locator.vHave.front() == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(locator.vHave.back() == chainActive.Genesis()->GetBlockHash());
+
+    // a reorg removes the entries of the block again
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), mapBlockIndex[block.GetHash()]));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+    BOOST_CHECK(WaitForIndexBuilders(60000));
+    BOOST_CHECK_EQUAL(CountTimestampIndex(), nBlocks);
+    BOOST_CHECK_EQUAL(CountAddressIndex(hashKey), 0U);
+    BOOST_CHECK(GetAddressSummary(hashKey, 1, summary));
+    BOOST_CHECK(summary.IsNull());
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(spentKey, spentValue));
+
+    // and brings them back when the block returns
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ReconsiderBlock(state, mapBlockIndex[block.GetHash()]));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(WaitForIndexBuilders(60000));
+    BOOST_CHECK_EQUAL(CountAddressIndex(hashKey), 2U);
+    BOOST_CHECK(GetAddressSummary(hashKey, 1, summary));
+    BOOST_CHECK_EQUAL(summary.txCount, 2);
+    BOOST_CHECK(pblocktree->ReadSpentIndex(spentKey, spentValue));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    StopIndexBuilders();
+
+    // a locator whose newest blocks never made it into the block index resumes at the
+    // last known one, the blocks after it are indexed again without counting them twice
+    std::vector<uint256> vHave(1, GetRandHash());
+    vHave.push_back(chainActive[nBlocks - 10]->GetBlockHash());
+    vHave.push_back(chainActive.Genesis()->GetBlockHash());
+    BOOST_CHECK(pblocktree->WriteIndexBlock("addressindex", CIndexBlockUpdate(), false, CBlockLocator(vHave)));
+    BOOST_CHECK(pblocktree->WriteIndexBlock("timestampindex", CIndexBlockUpdate(), false, CBlockLocator(vHave)));
+
+    StartIndexBuilders(threadGroup);
+    BOOST_CHECK(WaitForIndexBuilders(60000));
+    BOOST_CHECK_EQUAL(CountTimestampIndex(), nBlocks + 1);
+    BOOST_CHECK_EQUAL(CountAddressIndex(hashKey), 2U);
+    CAddressSummary summaryAfter;
+    BOOST_CHECK(GetAddressSummary(hashKey, 1, summaryAfter));
+    BOOST_CHECK_EQUAL(summaryAfter.received, summary.received);
+    BOOST_CHECK_EQUAL(summaryAfter.txCount, 2);
+    std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > buckets;
+    BOOST_CHECK(GetTimestampBuckets(TIMESTAMP_BUCKET_DAY, std::numeric_limits<unsigned int>::max(), 0, buckets));
+    int64_t nBucketed = 0;
+    for (unsigned int i = 0; i < buckets.size(); i++)
+        nBucketed += buckets[i].second.count;
+    BOOST_CHECK_EQUAL(nBucketed, (int64_t)nBlocks + 1);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    StopIndexBuilders();
+    fAddressIndex = fSpentIndex = fTimestampIndex = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "net.h"
+#include "validation.h"
+#include "test/test_dynamic.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockfilemap_memoryreader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)42 << std::string("dynamic");
+
+    CMemoryReader reader(&ss[0], &ss[0] + ss.size(), SER_DISK, CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n;
+    BOOST_CHECK_EQUAL(n, 42U);
+    BOOST_CHECK_EQUAL(reader.size(), 8U);
+    reader.ignore(1);
+    BOOST_CHECK_THROW(reader.ignore(8), std::ios_base::failure);
+    BOOST_CHECK_THROW(reader >> n >> n, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_genesis)
+{
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex != NULL);
+
+    CMappedData data;
+    if (!MapBlockFromDisk(data, pindex, chainparams.MessageStart())) {
+        // Block files are not mapped on this platform
+        BOOST_CHECK(data.IsNull());
+        return;
+    }
+
+    // The mapped bytes are the block as it is sent to peers
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << chainparams.GenesisBlock();
+    BOOST_CHECK(std::string(data.begin(), data.end()) == ss.str());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(data, SER_NETWORK, PROTOCOL_VERSION), ss.size());
+
+    CBlock block;
+    data.GetReader(SER_DISK, CLIENT_VERSION) >> block;
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+
+    CBlock blockRead;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, pindex, chainparams.GetConsensus()));
+    BOOST_CHECK(blockRead.GetHash() == pindex->GetBlockHash());
+
+    // Queued for sending, the header is followed by the payload where it lives
+    std::vector<char> vHeader(CMessageHeader::HEADER_SIZE, 'h');
+    CSendMessage msg(vHeader.begin(), vHeader.end(), data);
+    BOOST_CHECK_EQUAL(msg.size(), vHeader.size() + data.size());
+    size_t nChunk;
+    BOOST_CHECK(*msg.GetData(1, nChunk) == 'h');
+    BOOST_CHECK_EQUAL(nChunk, vHeader.size() - 1);
+    BOOST_CHECK(msg.GetData(vHeader.size() + 10, nChunk) == (const char*)data.begin() + 10);
+    BOOST_CHECK_EQUAL(nChunk, data.size() - 10);
+
+    // A transaction located by the txindex is read from a mapping of its block only
+    CMappedData dataAt;
+    BOOST_CHECK(MapBlockFileAt(dataAt, pindex->GetBlockPos()));
+    BOOST_CHECK_EQUAL(dataAt.size(), data.size());
+    CMemoryReader reader = dataAt.GetReader(SER_DISK, CLIENT_VERSION);
+    CBlockHeader header;
+    CTransaction tx;
+    reader >> header;
+    reader.ignore(GetSizeOfCompactSize(block.vtx.size()));
+    reader >> tx;
+    BOOST_CHECK(tx.GetHash() == block.vtx[0].GetHash());
+    BOOST_CHECK_THROW(reader >> tx, std::ios_base::failure);
+
+    // Wrong network magic
+    CMessageHeader::MessageStartChars messageStart;
+    memcpy(messageStart, chainparams.MessageStart(), MESSAGE_START_SIZE);
+    messageStart[0] ^= 0xff;
+    CMappedData dataBad;
+    BOOST_CHECK(!MapBlockFromDisk(dataBad, pindex->GetBlockPos(), messageStart));
+
+    // The mapping outlives the block file being dropped from the map
+    UnmapBlockFile(pindex->GetBlockPos().nFile);
+    BOOST_CHECK(std::string(data.begin(), data.end()) == ss.str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
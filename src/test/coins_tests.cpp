@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "test_random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "test/test_dynamic.h"
 #include "validation.h"
@@ -75,7 +76,7 @@ public:
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.DynamicMemoryUsage();
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
@@ -347,4 +348,228 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+BOOST_AUTO_TEST_CASE(coins_warm_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    uint256 txidOld = GetRandHash(), txidNew = GetRandHash();
+
+    // an entry that was modified in the cache must not be replaced by a stale read
+    {
+        CCoinsModifier entry = cache.ModifyCoins(txidOld);
+        entry->vout.resize(1);
+        entry->vout[0].nValue = 2;
+    }
+    CCoins stale;
+    stale.vout.resize(1);
+    stale.vout[0].nValue = 1;
+    cache.WarmCoins(txidOld, stale);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txidOld)->vout[0].nValue, 2);
+
+    // an uncached entry is taken over as a lookup would have loaded it
+    CCoins fetched;
+    fetched.vout.resize(2);
+    fetched.vout[1].nValue = 3;
+    cache.WarmCoins(txidNew, fetched);
+    BOOST_CHECK(cache.HaveCoinsInCache(txidNew));
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txidNew)->vout[1].nValue, 3);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(coins_sync_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    uint256 txidClean = GetRandHash(), txidDirty = GetRandHash(), txidSpent = GetRandHash();
+
+    {
+        CCoinsModifier coins = cache.ModifyCoins(txidClean);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1;
+    }
+    {
+        CCoinsModifier coins = cache.ModifyCoins(txidSpent);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 2;
+    }
+    BOOST_CHECK(cache.Flush());
+
+    // load the flushed entries again and modify some of them
+    BOOST_CHECK(cache.HaveCoins(txidClean));
+    cache.ModifyCoins(txidSpent)->Spend(0);
+    {
+        CCoinsModifier coins = cache.ModifyCoins(txidDirty);
+        coins->vout.resize(2);
+        coins->vout[1].nValue = 3;
+    }
+
+    // syncing writes the changes, keeps the live entries and drops the spent one
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK(cache.HaveCoinsInCache(txidClean));
+    BOOST_CHECK(cache.HaveCoinsInCache(txidDirty));
+    BOOST_CHECK(!cache.HaveCoinsInCache(txidSpent));
+    CCoins coins;
+    BOOST_CHECK(base.GetCoins(txidDirty, coins));
+    BOOST_CHECK_EQUAL(coins.vout[1].nValue, 3);
+    BOOST_CHECK(!base.GetCoins(txidSpent, coins) || coins.IsPruned());
+
+    // lookups of synced entries are answered from the cache
+    uint64_t nHits, nMisses, nHitsAfter, nMissesAfter;
+    cache.GetCacheHits(nHits, nMisses);
+    BOOST_CHECK(cache.AccessCoins(txidDirty));
+    cache.GetCacheHits(nHitsAfter, nMissesAfter);
+    BOOST_CHECK_EQUAL(nHitsAfter, nHits + 1);
+    BOOST_CHECK_EQUAL(nMissesAfter, nMisses);
+
+    // trimming never drops modified entries
+    cache.ModifyCoins(txidDirty)->vout[0].nValue = 4;
+    BOOST_CHECK_EQUAL(cache.Trim(0), 1);
+    BOOST_CHECK(!cache.HaveCoinsInCache(txidClean));
+    BOOST_CHECK(cache.HaveCoinsInCache(txidDirty));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(coins_trim_lru_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<uint256> vTxids;
+    for (int i = 0; i < 3; i++) {
+        vTxids.push_back(GetRandHash());
+        CCoinsModifier coins = cache.ModifyCoins(vTxids.back());
+        coins->vout.resize(1);
+        coins->vout[0].nValue = i + 1;
+    }
+    BOOST_CHECK(cache.Flush());
+
+    // load the entries in order, then read the first one again
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(cache.HaveCoins(vTxids[i]));
+    BOOST_CHECK(cache.AccessCoins(vTxids[0]));
+
+    // the recently read entry survives, the coldest ones go first
+    BOOST_CHECK_EQUAL(cache.Trim(cache.DynamicMemoryUsage() - 1), 1);
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[0]));
+    BOOST_CHECK(!cache.HaveCoinsInCache(vTxids[1]));
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[2]));
+    BOOST_CHECK_EQUAL(cache.Trim(cache.DynamicMemoryUsage() - 1), 1);
+    BOOST_CHECK(cache.HaveCoinsInCache(vTxids[0]));
+    BOOST_CHECK(!cache.HaveCoinsInCache(vTxids[2]));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(coins_sync_nested_test)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest parent(&base);
+    uint256 txid = GetRandHash(), txidSpent = GetRandHash();
+
+    {
+        CCoinsModifier coins = parent.ModifyCoins(txid);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1;
+    }
+    {
+        CCoinsModifier coins = parent.ModifyCoins(txidSpent);
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 2;
+    }
+    BOOST_CHECK(parent.Flush());
+    parent.ModifyCoins(txid)->vout[0].nValue = 5;
+
+    // a cache on top of a cache syncs into its parent, not past it
+    CCoinsViewCacheTest child(&parent);
+    child.ModifyCoins(txid)->vout[0].nValue = 6;
+    child.ModifyCoins(txidSpent)->Spend(0);
+    BOOST_CHECK(child.Sync());
+    child.SelfTest();
+    parent.SelfTest();
+    BOOST_CHECK(child.HaveCoinsInCache(txid));
+
+    CCoins coins;
+    BOOST_CHECK(parent.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 6);
+    BOOST_CHECK(!parent.HaveCoins(txidSpent));
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 1);
+
+    // the parent holds the newest values and writes them on its own flush
+    BOOST_CHECK(parent.Flush());
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 6);
+    BOOST_CHECK(!base.GetCoins(txidSpent, coins) || coins.IsPruned());
+
+    // the child entry is clean now and later changes sync again
+    child.ModifyCoins(txid)->vout[0].nValue = 7;
+    BOOST_CHECK(child.Sync());
+    BOOST_CHECK(parent.Flush());
+    BOOST_CHECK(base.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout[0].nValue, 7);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_outputs_test, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    uint256 txid = GetRandHash();
+    uint256 hashTip = chainActive.Tip()->GetBlockHash();
+
+    // a new transaction is stored one record per output
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier coins = cache.ModifyNewCoins(txid);
+            coins->nHeight = 5;
+            coins->nVersion = 2;
+            coins->vout.resize(3);
+            for (unsigned int n = 0; n < 3; n++) {
+                coins->vout[n].nValue = 100 + n;
+                coins->vout[n].scriptPubKey = CScript() << OP_TRUE;
+            }
+        }
+        cache.SetBestBlock(hashTip);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins coins;
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 3);
+    BOOST_CHECK_EQUAL(coins.nHeight, 5);
+    BOOST_CHECK_EQUAL(coins.nVersion, 2);
+    BOOST_CHECK_EQUAL(coins.vout[2].nValue, 102);
+
+    CCoinsStats stats;
+    BOOST_CHECK(db.GetStats(stats));
+    BOOST_CHECK_EQUAL(stats.nTransactions, 1);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 3);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, 303);
+
+    // spending through nested caches only touches the spent output
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsViewCache child(&cache);
+            BOOST_CHECK(child.ModifyCoins(txid)->Spend(1));
+            BOOST_CHECK(child.Flush());
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK(coins.IsAvailable(0));
+    BOOST_CHECK(!coins.IsAvailable(1));
+    BOOST_CHECK(coins.IsAvailable(2));
+
+    // and spending the rest removes the transaction
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            modifier->Spend(0);
+            modifier->Spend(2);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, coins));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -324,6 +324,49 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    std::string strError;
+    mapMultiArgs["-dbopt"].clear();
+    mapMultiArgs["-dbopt"].push_back("chainstate:maxopenfiles=500");
+    mapMultiArgs["-dbopt"].push_back("chainstate:BlockSize=16384");
+    mapMultiArgs["-dbopt"].push_back("chainstate:writebuffer=67108864");
+    mapMultiArgs["-dbopt"].push_back("ddns:bloombits=0");
+    BOOST_CHECK(CheckDBOptions(strError));
+
+    CDBProfile profile = GetDBProfile("chainstate");
+    BOOST_CHECK_EQUAL(profile.nMaxOpenFiles, 500);
+    BOOST_CHECK_EQUAL(profile.nBlockSize, 16384);
+    BOOST_CHECK_EQUAL(profile.nBloomBits, 10);
+    BOOST_CHECK_EQUAL(GetDBProfile("ddns").nBloomBits, 0);
+    BOOST_CHECK_EQUAL(GetDBProfile("blockindex").nMaxOpenFiles, 64);
+    // files beyond the defaults are reserved as file descriptors at startup
+    BOOST_CHECK_EQUAL(GetDBExtraFileDescriptors(), 500 - 64);
+
+    // a named database is opened with its profile and can be inspected
+    {
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, "chainstate");
+        BOOST_CHECK_EQUAL(dbw.GetProfile().nMaxOpenFiles, 500);
+        // the write buffer stays within half of the database cache
+        BOOST_CHECK_EQUAL(dbw.GetWriteBufferSize(), (size_t)(1 << 19));
+        BOOST_CHECK(dbw.Write('k', GetRandHash()));
+        BOOST_CHECK(!dbw.GetProperty("stats").empty());
+        BOOST_CHECK(dbw.GetProperty("no-such-property").empty());
+        std::vector<std::string> vNames;
+        ForEachDBWrapper([&vNames](const CDBWrapper& db) { vNames.push_back(db.GetName()); });
+        BOOST_CHECK(std::find(vNames.begin(), vNames.end(), "chainstate") != vNames.end());
+    }
 
+    mapMultiArgs["-dbopt"].push_back("chainstate:maxopenfiles=abc");
+    BOOST_CHECK(!CheckDBOptions(strError));
+    mapMultiArgs["-dbopt"].back() = strprintf("chainstate:maxopenfiles=%d", MAX_DB_OPEN_FILES + 1);
+    BOOST_CHECK(!CheckDBOptions(strError));
+    mapMultiArgs["-dbopt"].back() = "wallet:maxopenfiles=100";
+    BOOST_CHECK(!CheckDBOptions(strError));
+    mapMultiArgs["-dbopt"].back() = "chainstate:cachesize=100";
+    BOOST_CHECK(!CheckDBOptions(strError));
+    mapMultiArgs["-dbopt"].clear();
+}
 
 BOOST_AUTO_TEST_SUITE_END()
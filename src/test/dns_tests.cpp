@@ -0,0 +1,275 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dns/dns.h"
+#include "dns/hooks.h"
+#include "validation.h"
+
+#include "test/test_dynamic.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(dns_tests, TestingSetup)
+
+static CNameRecord MakeNameRecord(const std::string& strValue, int op = OP_NAME_NEW)
+{
+    CNameRecord rec;
+    rec.vtxPos.push_back(CNameIndex(CDiskTxPos(), 1, nameValFromString(strValue)));
+    rec.vtxPos.back().op = op;
+    return rec;
+}
+
+static std::vector<std::string> IterateNames(CNameDB& db, const std::string& strStart, const std::string& strPrefix)
+{
+    std::vector<std::string> vNames;
+    for (CNameIterator it(db, nameValFromString(strStart), nameValFromString(strPrefix)); it.Valid(); it.Next())
+        vNames.push_back(stringFromNameVal(it.GetName()));
+    return vNames;
+}
+
+BOOST_AUTO_TEST_CASE(dns_regex_literal_prefix)
+{
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix(""), "");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("id/"), "");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^id/"), "id/");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^id/.*"), "id/");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^id/bob$"), "id/bob");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^ids?/"), "id");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^ids+/"), "ids");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^a\\.b"), "a.b");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^id\\d"), "id");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^id/|^d/"), "");
+    BOOST_CHECK_EQUAL(GetRegexLiteralPrefix("^[a-z]"), "");
+}
+
+BOOST_AUTO_TEST_CASE(dns_name_iterator)
+{
+    CNameDB db(1 << 20, true);
+
+    db.WriteName(nameValFromString("a"), MakeNameRecord("1"));
+    db.WriteName(nameValFromString("id/bob"), MakeNameRecord("2"));
+    db.WriteName(nameValFromString("id/z"), MakeNameRecord("3"));
+    db.WriteName(nameValFromString("id/alice"), MakeNameRecord("4"));
+    db.WriteName(nameValFromString("id/carol"), MakeNameRecord("5"));
+    db.WriteName(nameValFromString("idx"), MakeNameRecord("6"));
+    db.WriteName(nameValFromString("id/eve"), MakeNameRecord("7", OP_NAME_DELETE));
+    BOOST_CHECK(db.FlushNames());
+
+    // names are ordered by name, not by length
+    std::vector<std::string> vNames = IterateNames(db, "", "id/");
+    BOOST_CHECK_EQUAL(vNames.size(), 4U);
+    BOOST_CHECK_EQUAL(vNames[0], "id/alice");
+    BOOST_CHECK_EQUAL(vNames[3], "id/z");
+
+    // changes that are not flushed yet are merged in
+    db.EraseName(nameValFromString("id/carol"));
+    db.WriteName(nameValFromString("id/dave"), MakeNameRecord("8"));
+    db.WriteName(nameValFromString("id/bob"), MakeNameRecord("9"));
+
+    vNames = IterateNames(db, "", "id/");
+    BOOST_CHECK_EQUAL(vNames.size(), 4U);
+    BOOST_CHECK_EQUAL(vNames[0], "id/alice");
+    BOOST_CHECK_EQUAL(vNames[1], "id/bob");
+    BOOST_CHECK_EQUAL(vNames[2], "id/dave");
+    BOOST_CHECK_EQUAL(vNames[3], "id/z");
+
+    CNameIterator it(db, nameValFromString("id/b"), nameValFromString("id/"));
+    BOOST_CHECK(it.Valid());
+    BOOST_CHECK_EQUAL(stringFromNameVal(it.GetRecord().vtxPos.back().value), "9");
+
+    // a start name past the prefix skips the names before it
+    vNames = IterateNames(db, "id/c", "id/");
+    BOOST_CHECK_EQUAL(vNames.size(), 2U);
+    BOOST_CHECK_EQUAL(vNames[0], "id/dave");
+
+    BOOST_CHECK_EQUAL(IterateNames(db, "", "").size(), 6U);
+    BOOST_CHECK(db.FlushNames());
+    BOOST_CHECK_EQUAL(IterateNames(db, "", "").size(), 6U);
+    BOOST_CHECK(IterateNames(db, "", "q").empty());
+}
+
+BOOST_AUTO_TEST_CASE(dns_name_bloom)
+{
+    CNameDB db(1 << 20, true);
+    for (int i = 0; i < 1000; i++)
+        db.WriteName(nameValFromString(strprintf("id/name%d", i)), MakeNameRecord("1"));
+    BOOST_CHECK(db.FlushNames());
+    db.WriteName(nameValFromString("id/dirty"), MakeNameRecord("2"));
+
+    CNameBloom bloom;
+    BOOST_CHECK(!bloom.IsEnabled());
+    BOOST_CHECK(bloom.MayContain(nameValFromString("anything")));
+
+    BOOST_CHECK(db.FillNameBloom(bloom, 0.01, 1 << 20));
+    BOOST_CHECK(bloom.IsEnabled());
+    BOOST_CHECK_EQUAL(bloom.GetElements(), 1001U);
+
+    // no false negatives, neither for flushed nor for pending names
+    for (int i = 0; i < 1000; i++)
+        BOOST_CHECK(bloom.MayContain(nameValFromString(strprintf("id/name%d", i))));
+    BOOST_CHECK(bloom.MayContain(nameValFromString("id/dirty")));
+
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+        if (bloom.MayContain(nameValFromString(strprintf("%d.random.dyn", i))))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 200);
+    BOOST_CHECK(bloom.GetFPRate() < 0.01);
+
+    bloom.Insert(nameValFromString("id/new"));
+    BOOST_CHECK(bloom.MayContain(nameValFromString("id/new")));
+    BOOST_CHECK(!bloom.IsOverfull());
+
+    // memory limit wins over the target rate
+    bloom.Reset(1000000, 0.0001, 1024);
+    BOOST_CHECK_EQUAL(bloom.GetBytes(), 1024U);
+    bloom.Reset(1000000, 0.0001, 0);
+    BOOST_CHECK(!bloom.IsEnabled());
+}
+
+static void QueryNameBloom(CNameBloom& bloom, const std::atomic<bool>& fStop, std::atomic<int>& nQueries, std::atomic<int>& nMissed)
+{
+    while (!fStop)
+    {
+        for (int i = 0; i < 1000; i += 7)
+        {
+            if (!bloom.MayContain(nameValFromString(strprintf("id/name%d", i))))
+                nMissed++;
+            nQueries++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dns_name_bloom_rebuild)
+{
+    CNameDB db(1 << 20, true);
+    for (int i = 0; i < 1000; i++)
+        db.WriteName(nameValFromString(strprintf("id/name%d", i)), MakeNameRecord("1"));
+    BOOST_CHECK(db.FlushNames());
+
+    CNameBloom bloom;
+    BOOST_CHECK(db.FillNameBloom(bloom, 0.01, 1 << 20));
+
+    // resolver threads query the filter while it gets rebuilt, a registered name must never be rejected
+    std::atomic<bool> fStop(false);
+    std::atomic<int> nQueries(0), nMissed(0);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&QueryNameBloom, boost::ref(bloom), boost::cref(fStop), boost::ref(nQueries), boost::ref(nMissed)));
+    for (int i = 0; i < 50; i++)
+        BOOST_CHECK(db.FillNameBloom(bloom, 0.0001 * (1 + i % 5), 1 << 20));
+    while (nQueries < 1000)
+        boost::this_thread::yield();
+    fStop = true;
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(nMissed, 0);
+    BOOST_CHECK_EQUAL(bloom.GetElements(), 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(dns_name_index_init)
+{
+    CBlockIndex* pindexTip = chainActive.Tip();
+    BOOST_CHECK(pindexTip != NULL);
+
+    // a name index that belongs to the chain tip is kept
+    BOOST_CHECK(InitNameIndex(1 << 20, true));
+    pnameDB->WriteName(nameValFromString("id/kept"), MakeNameRecord("1"));
+    pnameDB->SetBestBlock(pindexTip->GetBlockHash());
+    BOOST_CHECK(pnameDB->FlushNames());
+    BOOST_CHECK(InitNameIndex(1 << 20));
+    BOOST_CHECK(pnameDB->ExistsName(nameValFromString("id/kept")));
+
+    // a reindex starts from an empty name index of the current format
+    BOOST_CHECK(InitNameIndex(1 << 20, true));
+    BOOST_CHECK(!pnameDB->ExistsName(nameValFromString("id/kept")));
+    BOOST_CHECK(pnameDB->GetBestBlock().IsNull());
+    int nVersion = 0;
+    BOOST_CHECK(pnameDB->ReadVersion(nVersion));
+    BOOST_CHECK_EQUAL(nVersion, NAMEINDEX_VERSION);
+
+    // without a chain tip, a name index that has seen blocks is stale and gets rebuilt
+    pnameDB->WriteName(nameValFromString("id/stale"), MakeNameRecord("2"));
+    pnameDB->SetBestBlock(pindexTip->GetBlockHash());
+    BOOST_CHECK(pnameDB->FlushNames());
+    chainActive.SetTip(NULL);
+    BOOST_CHECK(InitNameIndex(1 << 20));
+    chainActive.SetTip(pindexTip);
+    BOOST_CHECK(!pnameDB->ExistsName(nameValFromString("id/stale")));
+    BOOST_CHECK(pnameDB->GetBestBlock().IsNull());
+
+    delete pnameDB;
+    pnameDB = NULL;
+}
+
+static CTransaction MakeNameTx(int op, const std::string& strName, uint32_t nLockTime)
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = NAMECOIN_TX_VERSION;
+    mtx.nLockTime = nLockTime;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    CScript script;
+    std::string strError;
+    BOOST_REQUIRE(createNameScript(script, nameValFromString(strName), nameValFromString("value"), 30, op, strError));
+    script << OP_TRUE;
+    mtx.vout.push_back(CTxOut(COIN, script));
+    return mtx;
+}
+
+BOOST_AUTO_TEST_CASE(dns_disconnect_unapplied_ops)
+{
+    BOOST_CHECK(InitNameIndex(1 << 20, true));
+    CNameVal name = nameValFromString("id/dup");
+
+    // the first name_new got applied, a duplicate in the same block was skipped by ConnectBlock
+    CTransaction txApplied = MakeNameTx(OP_NAME_NEW, "id/dup", 1);
+    CTransaction txDuplicate = MakeNameTx(OP_NAME_NEW, "id/dup", 2);
+    CNameRecord rec = MakeNameRecord("value");
+    rec.vtxPos.back().txHash = txApplied.GetHash();
+    pnameDB->WriteName(name, rec);
+
+    // disconnecting in reverse order leaves the applied op alone until its own turn
+    BOOST_CHECK(hooks->DisconnectInputs(txDuplicate));
+    CNameRecord recRead;
+    BOOST_CHECK(pnameDB->ReadName(name, recRead));
+    BOOST_CHECK_EQUAL(recRead.vtxPos.size(), 1U);
+    BOOST_CHECK(hooks->DisconnectInputs(txApplied));
+    BOOST_CHECK(!pnameDB->ExistsName(name));
+
+    // a rejected update of a name that was never registered has nothing to undo
+    BOOST_CHECK(hooks->DisconnectInputs(MakeNameTx(OP_NAME_UPDATE, "id/unknown", 3)));
+    BOOST_CHECK(!pnameDB->ExistsName(nameValFromString("id/unknown")));
+
+    delete pnameDB;
+    pnameDB = NULL;
+}
+
+BOOST_AUTO_TEST_CASE(dns_corrupt_name_record)
+{
+    CBlockIndex* pindexTip = chainActive.Tip();
+    BOOST_CHECK(InitNameIndex(1 << 20, true));
+
+    // a record pointing past its own history fails to read instead of aborting
+    CNameRecord rec = MakeNameRecord("1");
+    rec.nLastActiveChainIndex = 5;
+    pnameDB->WriteName(nameValFromString("id/corrupt"), rec);
+    pnameDB->SetBestBlock(pindexTip->GetBlockHash());
+    BOOST_CHECK(pnameDB->FlushNames());
+    CNameRecord recRead;
+    BOOST_CHECK(!pnameDB->ReadName(nameValFromString("id/corrupt"), recRead));
+
+    // later flushes do not restore the best block, so the next start rebuilds the index
+    pnameDB->SetBestBlock(pindexTip->GetBlockHash());
+    BOOST_CHECK(pnameDB->FlushNames());
+    BOOST_CHECK(pnameDB->GetBestBlock().IsNull());
+
+    delete pnameDB;
+    pnameDB = NULL;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
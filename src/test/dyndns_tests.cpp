@@ -0,0 +1,376 @@
+// Copyright (c) 2016-2017 Duality Blockchain Solutions Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dns/dyndns.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include "test/test_dynamic.h"
+
+#include <fstream>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+BOOST_FIXTURE_TEST_SUITE(dyndns_tests, BasicTestingSetup)
+
+// Build a query for a single label name, optionally with an EDNS0 OPT record
+static size_t MakeNameQuery(uint8_t* buf, uint16_t id, const char* name, uint16_t qtype, uint16_t nPayload = 0)
+{
+    DNSHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msgID = id;
+    hdr.QDCount = 1;
+    hdr.ARCount = nPayload ? 1 : 0;
+    hdr.Transcode();
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    uint8_t* p = buf + sizeof(hdr);
+    *p++ = strlen(name);
+    memcpy(p, name, strlen(name));
+    p += strlen(name);
+    *p++ = 0;
+    *p++ = qtype >> 8; *p++ = qtype;
+    *p++ = 0; *p++ = 1; // QCLASS IN
+    if (nPayload) {
+        *p++ = 0;                                  // root
+        *p++ = 0; *p++ = 41;                       // OPT
+        *p++ = nPayload >> 8; *p++ = nPayload;     // UDP payload size
+        *p++ = 0; *p++ = 0; *p++ = 0; *p++ = 0;    // ext. RCODE, version, flags
+        *p++ = 0; *p++ = 0;                        // RDLENGTH
+    }
+    return p - buf;
+}
+
+// Header and the types of the answer and additional records of a response
+struct DNSTestAnswer
+{
+    DNSHeader hdr;
+    std::string strName;
+    std::vector<uint16_t> vTypes;
+    std::vector<uint16_t> vAdditional;
+    size_t nSize;
+};
+
+static DNSTestAnswer ParseAnswer(const uint8_t* buf, size_t len)
+{
+    DNSTestAnswer answer;
+    BOOST_REQUIRE(len >= sizeof(DNSHeader));
+    memcpy(&answer.hdr, buf, sizeof(DNSHeader));
+    answer.hdr.Transcode();
+    answer.nSize = len;
+
+    const uint8_t* p = buf + sizeof(DNSHeader);
+    answer.strName.assign((const char*)p + 1, *p);
+    while (*p)
+        p += *p + 1;
+    p += 5;
+    for (int i = 0; i < answer.hdr.ANCount + answer.hdr.NSCount + answer.hdr.ARCount; i++) {
+        if ((*p & 0xc0) == 0xc0)
+            p += 2;
+        else
+            p += 1; // root, only used by OPT
+        BOOST_REQUIRE(p + 10 <= buf + len);
+        uint16_t type = (p[0] << 8) | p[1];
+        if (i < answer.hdr.ANCount)
+            answer.vTypes.push_back(type);
+        else if (i >= answer.hdr.ANCount + answer.hdr.NSCount)
+            answer.vAdditional.push_back(type);
+        p += 10 + ((p[8] << 8) | p[9]);
+    }
+    BOOST_CHECK(p == buf + len);
+    return answer;
+}
+
+static DNSTestAnswer QueryUDP(uint16_t port, const char* name, uint16_t qtype, uint16_t nPayload = 0)
+{
+    int sock = socket(PF_INET, SOCK_DGRAM, 0);
+    BOOST_REQUIRE(sock >= 0);
+    struct timeval tv;
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    uint8_t buf[8192];
+    size_t len = MakeNameQuery(buf, 1, name, qtype, nPayload);
+    BOOST_REQUIRE(sendto(sock, buf, len, 0, (struct sockaddr*)&addr, sizeof(addr)) == (ssize_t)len);
+    ssize_t rcvlen = recv(sock, buf, sizeof(buf), 0);
+    close(sock);
+    BOOST_REQUIRE(rcvlen > 0);
+    return ParseAnswer(buf, rcvlen);
+}
+
+static int ConnectTCP(uint16_t port)
+{
+    int sock = socket(PF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(sock >= 0);
+    struct timeval tv;
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    BOOST_REQUIRE(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    return sock;
+}
+
+// Send one query over an open connection and read its answer
+static DNSTestAnswer ExchangeTCP(int sock, const char* name, uint16_t qtype)
+{
+    uint8_t buf[32768];
+    size_t len = MakeNameQuery(buf + 2, 1, name, qtype);
+    buf[0] = len >> 8;
+    buf[1] = len;
+    BOOST_REQUIRE(send(sock, buf, len + 2, 0) == (ssize_t)(len + 2));
+
+    // length prefix, then the message, possibly in several segments
+    size_t nHave = 0, nWant = 2;
+    while (nHave < nWant) {
+        ssize_t rcvlen = recv(sock, buf + nHave, sizeof(buf) - nHave, 0);
+        BOOST_REQUIRE(rcvlen > 0);
+        nHave += rcvlen;
+        if (nWant == 2 && nHave >= 2)
+            nWant = 2 + ((buf[0] << 8) | buf[1]);
+    }
+    BOOST_REQUIRE_EQUAL(nHave, nWant);
+    return ParseAnswer(buf + 2, nWant - 2);
+}
+
+static DNSTestAnswer QueryTCP(uint16_t port, const char* name, uint16_t qtype)
+{
+    int sock = ConnectTCP(port);
+    DNSTestAnswer answer = ExchangeTCP(sock, name, qtype);
+    close(sock);
+    return answer;
+}
+
+// One address cannot hold more than DYNDNS_TCPMAXPERIP connections
+BOOST_FIXTURE_TEST_CASE(dyndns_tcp_per_address, TestChain100Setup)
+{
+    boost::filesystem::path pathLocal = GetDataDir() / "dyndns_tcp.cf";
+    {
+        std::ofstream local(pathLocal.string().c_str());
+        local << "www=A=10.0.0.1\n";
+    }
+
+    // the sockets are listening once the resolver is constructed
+    DynDns dyndns("127.0.0.1", 0, "", "", pathLocal.string().c_str(), "", "", 0, 1, true);
+    const uint16_t port = dyndns.GetPort();
+
+    // an answer on each connection shows it was accepted before the next one is opened
+    std::vector<int> vSocks;
+    for (int i = 0; i <= DYNDNS_TCPMAXPERIP; i++) {
+        vSocks.push_back(ConnectTCP(port));
+        if (i < DYNDNS_TCPMAXPERIP)
+            BOOST_CHECK_EQUAL(ExchangeTCP(vSocks.back(), "www", 1).vTypes.size(), 1U);
+    }
+
+    // the connection over the limit is closed by the resolver
+    char c;
+    BOOST_CHECK_EQUAL(recv(vSocks.back(), &c, 1, 0), 0);
+
+    // the resolver drops a client when it reads its end of stream, then closes its side
+    BOOST_FOREACH(int sock, vSocks) {
+        shutdown(sock, SHUT_WR);
+        BOOST_CHECK_EQUAL(recv(sock, &c, 1, 0), 0);
+        close(sock);
+    }
+
+    // with the connections gone the address is served again
+    BOOST_CHECK_EQUAL(QueryTCP(port, "www", 1).vTypes.size(), 1U);
+}
+
+// Drive the resolver from a local load generator, keeping a window of queries in flight,
+// and report the queries per second for one and for several threads. The queries come
+// from several sockets, as the kernel hands all datagrams of one source to the same thread.
+BOOST_FIXTURE_TEST_CASE(dyndns_throughput, TestChain100Setup)
+{
+    boost::filesystem::path pathLocal = GetDataDir() / "dyndns_throughput.cf";
+    {
+        std::ofstream local(pathLocal.string().c_str());
+        local << "www=A=10.0.0.1,10.0.0.2\n";
+    }
+
+    const int nQueries = 20000;
+    const int nSockets = 8;
+    const unsigned int nWindow = 8; // per socket
+    const uint8_t vThreads[] = {1, 4};
+    for (unsigned int t = 0; t < sizeof(vThreads) / sizeof(vThreads[0]); t++) {
+        DynDns dyndns("127.0.0.1", 0, "", "", pathLocal.string().c_str(), "", "", 0, vThreads[t]);
+        const uint16_t port = dyndns.GetPort();
+        BOOST_REQUIRE(port != 0);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+        struct pollfd vPoll[nSockets];
+        std::set<uint16_t> vPending[nSockets];
+        for (int i = 0; i < nSockets; i++) {
+            vPoll[i].fd = socket(PF_INET, SOCK_DGRAM, 0);
+            vPoll[i].events = POLLIN;
+            BOOST_REQUIRE(vPoll[i].fd >= 0);
+        }
+
+        int nSent = 0, nAnswered = 0, nLost = 0;
+        uint8_t buf[512];
+        int64_t nStart = GetTimeMicros();
+
+        while (nAnswered + nLost < nQueries) {
+            for (int i = 0; i < nSockets; i++) {
+                while (nSent < nQueries && vPending[i].size() < nWindow) {
+                    uint16_t id = nSent++ & 0xffff;
+                    size_t len = MakeNameQuery(buf, id, "www", 1);
+                    BOOST_REQUIRE(sendto(vPoll[i].fd, buf, len, 0, (struct sockaddr*)&addr, sizeof(addr)) == (ssize_t)len);
+                    vPending[i].insert(id);
+                }
+            }
+
+            if (poll(vPoll, nSockets, 1000) <= 0) {
+                // lost datagrams, count them and refill the windows
+                for (int i = 0; i < nSockets; i++) {
+                    nLost += vPending[i].size();
+                    vPending[i].clear();
+                }
+                continue;
+            }
+
+            for (int i = 0; i < nSockets; i++) {
+                if (!(vPoll[i].revents & POLLIN))
+                    continue;
+                ssize_t len;
+                while ((len = recv(vPoll[i].fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                    DNSTestAnswer answer = ParseAnswer(buf, len);
+                    BOOST_CHECK(answer.hdr.Bits & DNSHeader::QR_MASK);
+                    BOOST_CHECK_EQUAL(answer.hdr.Bits & DNSHeader::RCODE_MASK, 0);
+                    BOOST_CHECK(vPending[i].erase(answer.hdr.msgID) == 1);
+                    nAnswered++;
+                }
+            }
+        }
+        for (int i = 0; i < nSockets; i++)
+            close(vPoll[i].fd);
+
+        int64_t nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+        BOOST_TEST_MESSAGE(strprintf("dyndns: %d queries answered in %dms by %u threads, %d qps, %d lost",
+            nAnswered, nElapsed / 1000, vThreads[t], nAnswered * 1000000LL / nElapsed, nLost));
+
+        // loopback may drop a few datagrams under load, but not many
+        BOOST_CHECK(nAnswered >= nQueries * 99 / 100);
+    }
+}
+
+// Every UDP resolver thread answers, and destroying the resolver stops all of them
+BOOST_FIXTURE_TEST_CASE(dyndns_workers, TestChain100Setup)
+{
+    boost::filesystem::path pathLocal = GetDataDir() / "dyndns_workers.cf";
+    {
+        std::ofstream local(pathLocal.string().c_str());
+        local << "www=A=10.0.0.1,10.0.0.2\n";
+    }
+
+    for (int nRun = 0; nRun < 3; nRun++) {
+        DynDns dyndns("127.0.0.1", 0, "", "", pathLocal.string().c_str(), "", "", 0, 4, true);
+        const uint16_t port = dyndns.GetPort();
+        BOOST_REQUIRE(port != 0);
+
+        // a new socket per query, so that queries are spread over the threads
+        for (int i = 0; i < 32; i++) {
+            DNSTestAnswer answer = QueryUDP(port, "www", 1);
+            BOOST_CHECK_EQUAL(answer.hdr.Bits & DNSHeader::RCODE_MASK, 0);
+            BOOST_CHECK_EQUAL(answer.vTypes.size(), 2U);
+        }
+        BOOST_CHECK_EQUAL(QueryTCP(port, "www", 1).vTypes.size(), 2U);
+    }
+}
+
+// Resolve local names of every record type over UDP, UDP with EDNS0 and TCP.
+// A synced chain is needed, the resolver answers SERVFAIL during initial block download.
+BOOST_FIXTURE_TEST_CASE(dyndns_transports, TestChain100Setup)
+{
+    boost::filesystem::path pathLocal = GetDataDir() / "dyndns_local.cf";
+    {
+        std::ofstream local(pathLocal.string().c_str());
+        local << "www=A=10.0.0.1,10.0.0.2|AAAA=2001:db8::1|MX=mail.example.com:10|TXT=hello world"
+                 "|NS=ns1.example.com|CNAME=alias.example.com|PTR=ptr.example.com|TTL=300\n";
+        // 30 AAAA records do not fit into 512 bytes
+        local << "big=AAAA=";
+        for (int i = 1; i <= 30; i++)
+            local << (i > 1 ? "," : "") << strprintf("::%x", i);
+        local << "\n";
+    }
+
+    DynDns dyndns("127.0.0.1", 0, "", "", pathLocal.string().c_str(), "", "", 0, 1, true);
+    const uint16_t port = dyndns.GetPort();
+
+    const uint16_t vQTypes[] = {1, 2, 5, 12, 15, 16, 28};
+    const size_t vExpected[] = {2, 1, 1, 1, 1, 1, 1};
+    for (unsigned int i = 0; i < sizeof(vQTypes) / sizeof(vQTypes[0]); i++) {
+        for (int nTransport = 0; nTransport < 3; nTransport++) {
+            DNSTestAnswer answer = nTransport == 2 ? QueryTCP(port, "www", vQTypes[i]) :
+                                   QueryUDP(port, "www", vQTypes[i], nTransport == 1 ? 4096 : 0);
+            BOOST_CHECK_EQUAL(answer.hdr.Bits & DNSHeader::RCODE_MASK, 0);
+            BOOST_CHECK_EQUAL(answer.vTypes.size(), vExpected[i]);
+            BOOST_FOREACH(uint16_t type, answer.vTypes)
+                BOOST_CHECK_EQUAL(type, vQTypes[i]);
+            // only EDNS0 requests get an OPT record back
+            BOOST_CHECK_EQUAL(answer.vAdditional.size(), nTransport == 1 ? 1U : 0U);
+        }
+    }
+
+    // names are case-insensitive, a cached answer is shared but the reply keeps the case of the question
+    for (int nTransport = 0; nTransport < 2; nTransport++) {
+        DNSTestAnswer answer = nTransport ? QueryTCP(port, "wWw", 1) : QueryUDP(port, "WwW", 1);
+        BOOST_CHECK_EQUAL(answer.hdr.Bits & DNSHeader::RCODE_MASK, 0);
+        BOOST_CHECK_EQUAL(answer.vTypes.size(), 2U);
+        BOOST_CHECK_EQUAL(answer.strName, nTransport ? "wWw" : "WwW");
+    }
+
+    // ANY returns A, NS, CNAME, PTR, MX and AAAA
+    DNSTestAnswer any = QueryTCP(port, "www", 255);
+    BOOST_CHECK_EQUAL(any.vTypes.size(), 7U);
+
+    // large answer: truncated over plain UDP, complete with EDNS0 and over TCP
+    DNSTestAnswer big = QueryUDP(port, "big", 28);
+    BOOST_CHECK(big.hdr.Bits & DNSHeader::TC_MASK);
+    BOOST_CHECK(big.nSize <= 512);
+    BOOST_CHECK(big.vTypes.size() < 30);
+
+    big = QueryUDP(port, "big", 28, 4096);
+    BOOST_CHECK(!(big.hdr.Bits & DNSHeader::TC_MASK));
+    BOOST_CHECK_EQUAL(big.vTypes.size(), 30U);
+    BOOST_REQUIRE_EQUAL(big.vAdditional.size(), 1U);
+    BOOST_CHECK_EQUAL(big.vAdditional[0], 41);
+
+    big = QueryTCP(port, "big", 28);
+    BOOST_CHECK(!(big.hdr.Bits & DNSHeader::TC_MASK));
+    BOOST_CHECK_EQUAL(big.vTypes.size(), 30U);
+
+    // a client with a small EDNS0 buffer still gets at least 512 bytes, and no more than it asked for
+    big = QueryUDP(port, "big", 28, 600);
+    BOOST_CHECK(big.hdr.Bits & DNSHeader::TC_MASK);
+    BOOST_CHECK(big.nSize <= 600);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif // WIN32
@@ -326,6 +326,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 
     CMutableTransaction tx1 = CMutableTransaction();
     tx1.vin.resize(1);
+    tx1.vin[0].prevout.n = 0;
     tx1.vin[0].scriptSig = CScript() << OP_1;
     tx1.vout.resize(1);
     tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
@@ -473,4 +474,57 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolNameIndexTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    std::list<CTransaction> removed;
+    CNameVal name(3, 'a'), name2(3, 'b');
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout.n = 0;
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+
+    // tx2 spends the same input as tx1, which is mined instead of it
+    CMutableTransaction tx2 = tx1;
+    tx2.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.FromTx(tx2));
+    pool.addNameIndex(entry.FromTx(tx2), name);
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout.n = 1;
+    tx3.vin[0].scriptSig = CScript() << OP_2;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.FromTx(tx3));
+    pool.addNameIndex(entry.FromTx(tx3), name2);
+
+    std::set<uint256> setPending;
+    BOOST_CHECK(pool.getNameIndex(name, setPending));
+    BOOST_CHECK_EQUAL(setPending.size(), 1);
+    BOOST_CHECK(setPending.count(tx2.GetHash()));
+    std::map<CNameVal, std::set<uint256> > mapPending;
+    pool.getNameIndex(mapPending);
+    BOOST_CHECK_EQUAL(mapPending.size(), 2);
+
+    // mining tx1 evicts the conflicting tx2, the name is no longer pending
+    std::vector<CTransaction> vtx;
+    vtx.push_back(tx1);
+    pool.removeForBlock(vtx, 1, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK(!pool.getNameIndex(name, setPending));
+    BOOST_CHECK(pool.getNameIndex(name2, setPending));
+
+    pool.remove(tx3, removed);
+    BOOST_CHECK(!pool.getNameIndex(name2, setPending));
+    pool.getNameIndex(mapPending);
+    BOOST_CHECK(mapPending.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,15 +9,20 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "compressor.h"
 #include "hash.h"
+#include "ui_interface.h"
 #include "validation.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
 
+#include <set>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
@@ -25,6 +30,9 @@ static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSSUMMARY = 'm';
+static const char DB_TIMESTAMPBUCKET = 'S';
+static const char DB_INDEX_LOCATOR = 'I';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -33,16 +41,132 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+/**
+ * A transaction with unspent outputs also has a marker record, keyed by
+ * DB_COIN and its txid, holding its number of outputs. The marker sorts right
+ * in front of the outputs, so a lookup that misses is a single point read and
+ * one that hits has the outputs in the block it just read.
+ */
+static const unsigned int COINS_MARKER_KEY_SIZE = 1 + 32;
+
+/** Key of an unspent output in the coin database */
+struct CCoinsDBKey
+{
+    char prefix;
+    uint256 txid;
+    uint32_t n;
+
+    CCoinsDBKey() : prefix(DB_COIN), n(0) {}
+    CCoinsDBKey(const uint256& txidIn, uint32_t nIn) : prefix(DB_COIN), txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(prefix);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * An unspent output as stored in the coin database. The transaction metadata
+ * is repeated in every record so that each output can be written and erased
+ * on its own:
+ *  - VARINT(nHeight * 2 + fCoinBase)
+ *  - VARINT(nVersion)
+ *  - the output, compressed with CTxOutCompressor
+ */
+struct CCoinsDBOutput
+{
+    int nHeight;
+    bool fCoinBase;
+    int nTxVersion;
+    CTxOut out;
+
+    CCoinsDBOutput() : nHeight(0), fCoinBase(false), nTxVersion(0) {}
+    CCoinsDBOutput(const CCoins& coins, unsigned int n) : nHeight(coins.nHeight), fCoinBase(coins.fCoinBase), nTxVersion(coins.nVersion), out(coins.vout[n]) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        READWRITE(VARINT(nTxVersion));
+        READWRITE(REF(CTxOutCompressor(out)));
+        if (ser_action.ForRead()) {
+            nHeight = nCode / 2;
+            fCoinBase = nCode & 1;
+        }
+    }
+
+    //! Add this output to the coins of its transaction
+    void AddTo(CCoins& coins, uint32_t n) const {
+        coins.fCoinBase = fCoinBase;
+        coins.nHeight = nHeight;
+        coins.nVersion = nTxVersion;
+        if (coins.vout.size() <= n)
+            coins.vout.resize(n + 1);
+        coins.vout[n] = out;
+    }
+};
+
+/**
+ * Read the outputs of the transaction the cursor points at into coins and
+ * leave the cursor on the first record of the next transaction. Returns false
+ * if the cursor is not on an output record.
+ */
+bool ReadCoinsAt(CDBIterator& cursor, uint256& txid, CCoins& coins, unsigned int* pnSize = NULL)
+{
+    // step over the marker in front of the outputs
+    std::pair<char, uint256> marker;
+    if (cursor.Valid() && cursor.GetKeySize() == COINS_MARKER_KEY_SIZE && cursor.GetKey(marker) && marker.first == DB_COIN) {
+        if (pnSize)
+            *pnSize += cursor.GetKeySize() + cursor.GetValueSize();
+        cursor.Next();
+    }
+
+    CCoinsDBKey key;
+    if (!cursor.Valid() || !cursor.GetKey(key) || key.prefix != DB_COIN)
+        return false;
+    txid = key.txid;
+    coins.Clear();
+    do {
+        CCoinsDBOutput output;
+        if (!cursor.GetValue(output))
+            throw std::runtime_error("Database read failure");
+        output.AddTo(coins, key.n);
+        if (pnSize)
+            *pnSize += cursor.GetKeySize() + cursor.GetValueSize();
+        cursor.Next();
+    } while (cursor.Valid() && cursor.GetKey(key) && key.prefix == DB_COIN && key.txid == txid);
+    return true;
+}
+
+} // anonymous namespace
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, "chainstate")
 {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+    // Most lookups that miss the cache are for transactions without unspent
+    // outputs. The marker answers those with a point read, which the bloom
+    // filters usually resolve without touching a table.
+    if (!db.Exists(std::make_pair(DB_COIN, txid)))
+        return false;
+
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(CCoinsDBKey(txid, 0));
+    uint256 txidFound;
+    return ReadCoinsAt(*pcursor, txidFound, coins) && txidFound == txid;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+    return db.Exists(std::make_pair(DB_COIN, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -52,16 +176,64 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+size_t CCoinsViewDB::WriteEntry(CDBBatch &batch, const uint256 &txid, const CCoinsCacheEntry &entry) {
+    const CCoins& coins = entry.coins;
+    size_t outputs = 0;
+    if (entry.flags & CCoinsCacheEntry::FRESH) {
+        // Nothing of this transaction is on disk yet.
+        for (unsigned int n = 0; n < coins.vout.size(); n++) {
+            if (!coins.vout[n].IsNull()) {
+                batch.Write(CCoinsDBKey(txid, n), CCoinsDBOutput(coins, n));
+                outputs++;
+            }
+        }
+    } else if (entry.flags & CCoinsCacheEntry::OUTPUTS_TRACKED) {
+        for (unsigned int n = 0; n < entry.vChanged.size(); n++) {
+            if (!entry.vChanged[n])
+                continue;
+            if (coins.IsAvailable(n))
+                batch.Write(CCoinsDBKey(txid, n), CCoinsDBOutput(coins, n));
+            else
+                batch.Erase(CCoinsDBKey(txid, n));
+            outputs++;
+        }
+    } else {
+        // Which outputs changed is unknown: drop the records that are
+        // no longer unspent and rewrite the others.
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+        CCoinsDBKey key;
+        for (pcursor->Seek(CCoinsDBKey(txid, 0)); pcursor->Valid() && pcursor->GetKey(key) && key.prefix == DB_COIN && key.txid == txid; pcursor->Next()) {
+            if (!coins.IsAvailable(key.n)) {
+                batch.Erase(key);
+                outputs++;
+            }
+        }
+        for (unsigned int n = 0; n < coins.vout.size(); n++) {
+            if (!coins.vout[n].IsNull()) {
+                batch.Write(CCoinsDBKey(txid, n), CCoinsDBOutput(coins, n));
+                outputs++;
+            }
+        }
+    }
+
+    // Keep the marker of a transaction with unspent outputs in step with its records
+    if (outputs > 0 || !(entry.flags & (CCoinsCacheEntry::FRESH | CCoinsCacheEntry::OUTPUTS_TRACKED))) {
+        if (coins.IsPruned())
+            batch.Erase(std::make_pair(DB_COIN, txid));
+        else
+            batch.Write(std::make_pair(DB_COIN, txid), (uint32_t)coins.vout.size());
+    }
+    return outputs;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(&db.GetObfuscateKey());
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(std::make_pair(DB_COINS, it->first));
-            else
-                batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+            outputs += WriteEntry(batch, it->first, it->second);
             changed++;
         }
         count++;
@@ -71,11 +243,78 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", (unsigned int)outputs, (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewDB::BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    CDBBatch batch(&db.GetObfuscateKey());
+    size_t changed = 0;
+    size_t outputs = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            outputs += WriteEntry(batch, it->first, it->second);
+            changed++;
+        }
+    }
+    if (!hashBlock.IsNull())
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u, kept cached) to coin database...\n", (unsigned int)outputs, (unsigned int)changed, (unsigned int)mapCoins.size());
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::Upgrade() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid())
+        return true;
+
+    LogPrintf("Upgrading chainstate to one record per unspent output...\n");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    CDBBatch batch(&db.GetObfuscateKey());
+    size_t count = 0;
+    size_t outputs = 0;
+    int nReportDone = 0;
+    std::pair<char, uint256> key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COINS) {
+        boost::this_thread::interruption_point();
+        CCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("%s: cannot parse coins record", __func__);
+        // Records of a transaction are written in the same batch as the erasure
+        // of the old one, so an interrupted upgrade resumes where it stopped.
+        for (unsigned int n = 0; n < coins.vout.size(); n++) {
+            if (!coins.vout[n].IsNull()) {
+                batch.Write(CCoinsDBKey(key.second, n), CCoinsDBOutput(coins, n));
+                outputs++;
+            }
+        }
+        if (!coins.IsPruned())
+            batch.Write(std::make_pair(DB_COIN, key.second), (uint32_t)coins.vout.size());
+        batch.Erase(key);
+        if (++count % 10000 == 0) {
+            if (!db.WriteBatch(batch))
+                return error("%s: cannot write converted coins", __func__);
+            batch.Clear();
+            // Transaction ids are uniformly distributed, their first byte tells how far along we are.
+            int nReport = (int)*key.second.begin() * 100 / 256;
+            if (nReport > nReportDone) {
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), nReport);
+                LogPrintf("[%d%%]...", nReport);
+                nReportDone = nReport;
+            }
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s: cannot write converted coins", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[DONE]. Moved %u outputs of %u transactions.\n", (unsigned int)outputs, (unsigned int)count);
+    return true;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -103,38 +342,36 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
+    pcursor->Seek(DB_COIN);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+    // Outputs are keyed by outpoint, so those of a transaction are adjacent
+    // and are gathered again to keep the serialized hash of the old layout.
+    uint256 txid;
+    CCoins coins;
+    unsigned int nSize = 0;
+    try {
+        while (ReadCoinsAt(*pcursor, txid, coins, &nSize)) {
+            boost::this_thread::interruption_point();
+            stats.nTransactions++;
+            for (unsigned int i=0; i<coins.vout.size(); i++) {
+                const CTxOut &out = coins.vout[i];
+                if (!out.IsNull()) {
+                    stats.nTransactionOutputs++;
+                    ss << VARINT(i+1);
+                    ss << out;
+                    nTotalAmount += out.nValue;
                 }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
-            } else {
-                return error("CCoinsViewDB::GetStats() : unable to read value");
             }
-        } else {
-            break;
+            ss << VARINT(0);
         }
-        pcursor->Next();
+    } catch (const std::runtime_error&) {
+        return error("CCoinsViewDB::GetStats() : unable to read value");
     }
+    stats.nSerializedSize = nSize;
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
@@ -196,16 +433,31 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           const CAddressUnspentKey *pAfter, size_t nLimit) {
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pAfter) {
+        // Resume right behind the last entry of the previous page
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, *pAfter));
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
+    size_t nRead = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+            if (pAfter && key.second == *pAfter) {
+                pcursor->Next();
+                continue;
+            }
+            if (nLimit > 0 && nRead >= nLimit) {
+                break;
+            }
+            nRead++;
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
@@ -221,10 +473,49 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
+// Adds (or with fUndo, subtracts) the deltas of one block to the summaries of their addresses.
+// Must be called before the batch writes (or erases) the index entries: entries already in that
+// state on disk are skipped, so a block replayed after a crash or a migration is not counted twice.
+static bool UpdateAddressSummaries(CBlockTreeDB& db, CDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> >&vect, bool fUndo) {
+    std::map<std::pair<unsigned int, uint160>, CAddressSummary> mapDeltas;
+    std::set<std::pair<std::pair<unsigned int, uint160>, uint256> > setTxs;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (db.Exists(std::make_pair(DB_ADDRESSINDEX, it->first)) != fUndo)
+            continue;
+        std::pair<unsigned int, uint160> address(it->first.type, it->first.hashBytes);
+        CAddressSummary &delta = mapDeltas[address];
+        delta.balance += it->second;
+        if (it->second > 0)
+            delta.received += it->second;
+        delta.unspentCount += it->first.spending ? -1 : 1;
+        if (setTxs.insert(std::make_pair(address, it->first.txhash)).second)
+            delta.txCount++;
+    }
+
+    int nSign = fUndo ? -1 : 1;
+    for (std::map<std::pair<unsigned int, uint160>, CAddressSummary>::const_iterator it=mapDeltas.begin(); it!=mapDeltas.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        CAddressSummary summary;
+        if (db.Exists(std::make_pair(DB_ADDRESSSUMMARY, key)) && !db.Read(std::make_pair(DB_ADDRESSSUMMARY, key), summary))
+            return error("failed to read address summary");
+        summary.balance += nSign * it->second.balance;
+        summary.received += nSign * it->second.received;
+        summary.txCount += nSign * it->second.txCount;
+        summary.unspentCount += nSign * it->second.unspentCount;
+        if (summary.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSSUMMARY, key));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSSUMMARY, key), summary);
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    if (!UpdateAddressSummaries(*this, batch, vect, false))
+        return false;
     return WriteBatch(batch);
 }
 
@@ -232,21 +523,91 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    if (!UpdateAddressSummaries(*this, batch, vect, true))
+        return false;
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary) {
+    summary.SetNull();
+    CAddressIndexIteratorKey key(type, addressHash);
+    if (!Exists(std::make_pair(DB_ADDRESSSUMMARY, key)))
+        return true; // never used
+    return Read(std::make_pair(DB_ADDRESSSUMMARY, key), summary);
+}
+
+// Creates the summaries of an address index written before they existed, in one pass over the index.
+// Deltas are sorted by address and then by height, so the deltas of one tx are adjacent.
+bool CBlockTreeDB::BuildAddressSummaries() {
+    LogPrintf("Building address summaries from the address index...\n");
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    CDBBatch batch(&GetObfuscateKey());
+    CAddressIndexIteratorKey current;
+    CAddressSummary summary;
+    uint256 lastTx;
+    int64_t nAddresses = 0;
+    bool fHaveCurrent = false;
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        if (fHaveCurrent && (!fValid || key.second.type != current.type || key.second.hashBytes != current.hashBytes)) {
+            if (!summary.IsNull())
+                batch.Write(std::make_pair(DB_ADDRESSSUMMARY, current), summary);
+            if (++nAddresses % 100000 == 0) {
+                if (!WriteBatch(batch))
+                    return error("failed to write address summaries");
+                batch = CDBBatch(&GetObfuscateKey());
+            }
+            fHaveCurrent = false;
+        }
+        if (!fValid)
+            break;
+
+        if (!fHaveCurrent) {
+            current = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+            summary.SetNull();
+            lastTx.SetNull();
+            fHaveCurrent = true;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        summary.balance += nValue;
+        if (nValue > 0)
+            summary.received += nValue;
+        summary.unspentCount += key.second.spending ? -1 : 1;
+        if (key.second.txhash != lastTx) {
+            summary.txCount++;
+            lastTx = key.second.txhash;
+        }
+        pcursor->Next();
+    }
+    if (!WriteBatch(batch))
+        return error("failed to write address summaries");
+    LogPrintf("Built summaries of %d addresses\n", nAddresses);
+    return true;
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+                                    int start, int end,
+                                    const CAddressIndexKey *pAfter, size_t nLimit) {
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pAfter && !(start > 0 && end > 0 && pAfter->blockHeight < start)) {
+        // Resume right behind the last entry of the previous page
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, *pAfter));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
+    size_t nRead = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
@@ -254,6 +615,14 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            if (pAfter && key.second == *pAfter) {
+                pcursor->Next();
+                continue;
+            }
+            if (nLimit > 0 && nRead >= nLimit) {
+                break;
+            }
+            nRead++;
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(std::make_pair(key.second, nValue));
@@ -269,23 +638,61 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(&GetObfuscateKey());
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes,
+                                      size_t nOffset, size_t nLimit,
+                                      const CTimestampIndexKey *pAfter, std::vector<CTimestampIndexKey> *pKeys) {
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (pAfter && pAfter->timestamp >= low) {
+        // Resume right behind the last entry of the previous page
+        pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, *pAfter));
+    } else {
+        pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    }
+
+    size_t nRead = 0;
+    size_t nSkipped = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp <= high) {
+            if (pAfter && key.second.timestamp == pAfter->timestamp && key.second.blockHash == pAfter->blockHash) {
+                pcursor->Next();
+                continue;
+            }
+            if (nSkipped < nOffset) {
+                nSkipped++;
+            } else {
+                hashes.push_back(key.second.blockHash);
+                if (pKeys)
+                    pKeys->push_back(key.second);
+                nRead++;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+bool CBlockTreeDB::ReadTimestampBuckets(unsigned int span, const unsigned int &high, const unsigned int &low,
+                                        std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > &buckets) {
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPBUCKET, CTimestampBucketKey(span, low)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp <= high) {
-            hashes.push_back(key.second.blockHash);
+        std::pair<char, CTimestampBucketKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPBUCKET && key.second.span == span && key.second.start <= high) {
+            CTimestampBucket bucket;
+            if (!pcursor->GetValue(bucket))
+                return error("failed to get time bucket value");
+            buckets.push_back(std::make_pair(key.second, bucket));
             pcursor->Next();
         } else {
             break;
@@ -295,6 +702,141 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+// Finds the lowest and highest height among the timestamp index entries of a bucket, except one block
+static bool ReadTimestampBucketBounds(CBlockTreeDB& db, const CTimestampBucketKey& bucketKey, const uint256& hashExcept, CTimestampBucket& bucket) {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(bucketKey.start)));
+
+    bucket.firstHeight = -1;
+    bucket.lastHeight = -1;
+    while (pcursor->Valid()) {
+        std::pair<char, CTimestampIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIMESTAMPINDEX || key.second.timestamp - bucketKey.start >= bucketKey.span)
+            break;
+        if (key.second.blockHash != hashExcept) {
+            int nHeight;
+            if (!pcursor->GetValue(nHeight))
+                return error("failed to get timestamp index value");
+            if (bucket.firstHeight == -1 || nHeight < bucket.firstHeight)
+                bucket.firstHeight = nHeight;
+            if (nHeight > bucket.lastHeight)
+                bucket.lastHeight = nHeight;
+        }
+        pcursor->Next();
+    }
+    return true;
+}
+
+// Counts a block in (or with fUndo, removes it from) the hour and day buckets of its timestamp
+static bool UpdateTimestampBuckets(CBlockTreeDB& db, CDBBatch& batch, const CTimestampIndexKey& entry, int nHeight, bool fUndo) {
+    const unsigned int spans[] = { TIMESTAMP_BUCKET_HOUR, TIMESTAMP_BUCKET_DAY };
+    for (unsigned int i = 0; i < sizeof(spans) / sizeof(spans[0]); i++) {
+        CTimestampBucketKey key(spans[i], entry.timestamp);
+        CTimestampBucket bucket;
+        if (db.Exists(std::make_pair(DB_TIMESTAMPBUCKET, key)) && !db.Read(std::make_pair(DB_TIMESTAMPBUCKET, key), bucket))
+            return error("failed to read time bucket");
+        if (!fUndo) {
+            if (bucket.IsNull() || nHeight < bucket.firstHeight)
+                bucket.firstHeight = nHeight;
+            if (bucket.IsNull() || nHeight > bucket.lastHeight)
+                bucket.lastHeight = nHeight;
+            bucket.count++;
+        } else {
+            bucket.count--;
+            // Only a block at one of the bounds moves them, the entry itself is still on disk
+            if (!bucket.IsNull() && (nHeight == bucket.firstHeight || nHeight == bucket.lastHeight) &&
+                !ReadTimestampBucketBounds(db, key, entry.blockHash, bucket))
+                return false;
+        }
+        if (bucket.count <= 0)
+            batch.Erase(std::make_pair(DB_TIMESTAMPBUCKET, key));
+        else
+            batch.Write(std::make_pair(DB_TIMESTAMPBUCKET, key), bucket);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteIndexBlock(const std::string &name, const CIndexBlockUpdate &update, bool fDisconnect, const CBlockLocator &locator) {
+    // The entries of the block and the new locator of the index are committed together
+    CDBBatch batch(&GetObfuscateKey());
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.addressIndex.begin(); it!=update.addressIndex.end(); it++) {
+        if (fDisconnect)
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    }
+    if (!update.addressIndex.empty() && !UpdateAddressSummaries(*this, batch, update.addressIndex, fDisconnect))
+        return false;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=update.addressUnspentIndex.begin(); it!=update.addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it=update.spentIndex.begin(); it!=update.spentIndex.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+    }
+    for (std::vector<CTimestampIndexKey>::const_iterator it=update.timestampIndex.begin(); it!=update.timestampIndex.end(); it++) {
+        // A block connected again after a crash is counted in its buckets already
+        if (Exists(std::make_pair(DB_TIMESTAMPINDEX, *it)) != fDisconnect)
+            continue;
+        if (fDisconnect)
+            batch.Erase(std::make_pair(DB_TIMESTAMPINDEX, *it));
+        else
+            batch.Write(std::make_pair(DB_TIMESTAMPINDEX, *it), update.nHeight);
+        if (!UpdateTimestampBuckets(*this, batch, *it, update.nHeight, fDisconnect))
+            return false;
+    }
+    batch.Write(std::make_pair(DB_INDEX_LOCATOR, name), locator);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadIndexLocator(const std::string &name, CBlockLocator &locator) {
+    return Read(std::make_pair(DB_INDEX_LOCATOR, name), locator);
+}
+
+template<typename K>
+static bool WipeIndexRecords(CBlockTreeDB& db, char chPrefix) {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(&db.GetObfuscateKey());
+    size_t nErased = 0;
+
+    pcursor->Seek(chPrefix);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        if (!pcursor->GetKey(key) || key.first != chPrefix)
+            break;
+        batch.Erase(key);
+        if (++nErased % 100000 == 0) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch = CDBBatch(&db.GetObfuscateKey());
+        }
+        pcursor->Next();
+    }
+    return db.WriteBatch(batch);
+}
+
+// Removes whatever an index holds so it can be rebuilt from scratch
+bool CBlockTreeDB::WipeIndex(const std::string &name) {
+    bool fSuccess = true;
+    if (name == "addressindex") {
+        fSuccess = WipeIndexRecords<CAddressIndexKey>(*this, DB_ADDRESSINDEX) &&
+                   WipeIndexRecords<CAddressUnspentKey>(*this, DB_ADDRESSUNSPENTINDEX) &&
+                   WipeIndexRecords<CAddressIndexIteratorKey>(*this, DB_ADDRESSSUMMARY);
+    } else if (name == "spentindex") {
+        fSuccess = WipeIndexRecords<CSpentIndexKey>(*this, DB_SPENTINDEX);
+    } else if (name == "timestampindex") {
+        fSuccess = WipeIndexRecords<CTimestampIndexKey>(*this, DB_TIMESTAMPINDEX) &&
+                   WipeIndexRecords<CTimestampBucketKey>(*this, DB_TIMESTAMPBUCKET);
+    }
+    return fSuccess && Erase(std::make_pair(DB_INDEX_LOCATOR, name));
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
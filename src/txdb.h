@@ -23,9 +23,14 @@ class uint256;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
 struct CAddressIndexKey;
+struct CAddressSummary;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
+struct CBlockLocator;
 struct CDiskTxPos;
+struct CIndexBlockUpdate;
+struct CTimestampBucket;
+struct CTimestampBucketKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampIndexKey;
 struct CSpentIndexKey;
@@ -46,11 +51,18 @@ static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 32;
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/). Every unspent output
+ * is a record of its own, keyed by outpoint, so spending one output of a
+ * transaction does not rewrite the others.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Queue the output records that changed in a dirty cache entry, returns how many
+    size_t WriteEntry(CDBBatch &batch, const uint256 &txid, const CCoinsCacheEntry &entry);
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -58,7 +70,11 @@ public:
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchSync(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+
+    //! Convert per-transaction records written by older versions into per-output ones
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -81,14 +97,24 @@ public:
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CAddressUnspentKey *pAfter = NULL, size_t nLimit = 0);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
+                          int start = 0, int end = 0,
+                          const CAddressIndexKey *pAfter = NULL, size_t nLimit = 0);
+    bool ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary);
+    bool BuildAddressSummaries();
+    bool WriteIndexBlock(const std::string &name, const CIndexBlockUpdate &update, bool fDisconnect, const CBlockLocator &locator);
+    bool ReadIndexLocator(const std::string &name, CBlockLocator &locator);
+    bool WipeIndex(const std::string &name);
+    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect,
+                            size_t nOffset = 0, size_t nLimit = 0,
+                            const CTimestampIndexKey *pAfter = NULL, std::vector<CTimestampIndexKey> *pKeys = NULL);
+    bool ReadTimestampBuckets(unsigned int span, const unsigned int &high, const unsigned int &low,
+                              std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
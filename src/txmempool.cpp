@@ -563,6 +563,48 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::addNameIndex(const CTxMemPoolEntry &entry, const CNameVal &name)
+{
+    LOCK(cs);
+    const uint256 txhash = entry.GetTx().GetHash();
+    mapNames[name].insert(txhash);
+    mapNamesInserted.insert(std::make_pair(txhash, name));
+}
+
+bool CTxMemPool::getNameIndex(const CNameVal &name, std::set<uint256> &hashes)
+{
+    LOCK(cs);
+    mapNameIndex::iterator it = mapNames.find(name);
+    if (it == mapNames.end())
+        return false;
+    hashes = it->second;
+    return true;
+}
+
+void CTxMemPool::getNameIndex(std::map<CNameVal, std::set<uint256> > &results)
+{
+    LOCK(cs);
+    results = mapNames;
+}
+
+bool CTxMemPool::removeNameIndex(const uint256 txhash)
+{
+    LOCK(cs);
+    mapNameIndexInserted::iterator it = mapNamesInserted.find(txhash);
+
+    if (it != mapNamesInserted.end()) {
+        mapNameIndex::iterator mit = mapNames.find(it->second);
+        if (mit != mapNames.end()) {
+            mit->second.erase(txhash);
+            if (mit->second.empty())
+                mapNames.erase(mit);
+        }
+        mapNamesInserted.erase(it);
+    }
+
+    return true;
+}
+
 void CTxMemPool::removeUnchecked(txiter it)
 {
     const uint256 hash = it->GetTx().GetHash();
@@ -578,6 +620,7 @@ void CTxMemPool::removeUnchecked(txiter it)
     minerPolicyEstimator->removeTx(hash);
     removeAddressIndex(hash);
     removeSpentIndex(hash);
+    removeNameIndex(hash);
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -735,6 +778,8 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapNames.clear();
+    mapNamesInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -442,6 +442,12 @@ private:
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    typedef std::map<CNameVal, std::set<uint256> > mapNameIndex;
+    mapNameIndex mapNames;
+
+    typedef std::map<uint256, CNameVal> mapNameIndexInserted;
+    mapNameIndexInserted mapNamesInserted;
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -482,6 +488,11 @@ public:
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool removeSpentIndex(const uint256 txhash);
 
+    void addNameIndex(const CTxMemPoolEntry &entry, const CNameVal &name);
+    bool getNameIndex(const CNameVal &name, std::set<uint256> &hashes);
+    void getNameIndex(std::map<CNameVal, std::set<uint256> > &results);
+    bool removeNameIndex(const uint256 txhash);
+
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
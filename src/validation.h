@@ -37,6 +37,7 @@
 
 class CBloomFilter;
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CInv;
@@ -105,6 +106,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1536;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Default for -dbcachewatermark, the share (in percent) of the coins cache it may fill before dirty entries are written */
+static const unsigned int DEFAULT_COINS_CACHE_WATERMARK = 90;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -168,18 +171,35 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+extern unsigned int nCoinCacheWatermark;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern bool fEnableReplacement;
 
 extern std::map<uint256, int64_t> mapRejectedBlocks;
 
+/** How the coins cache was written to disk, protected by cs_main */
+struct CCoinsFlushStats
+{
+    uint64_t nFlushes;
+    int64_t nLastFlushTime; //! duration of the last flush in microseconds
+    size_t nLastFlushTrimmed; //! clean entries dropped after the last flush to get below the watermark
+    uint64_t nHitsAtFlush; //! cache hits of pcoinsTip at the end of the last flush
+    uint64_t nMissesAtFlush;
+
+    CCoinsFlushStats() : nFlushes(0), nLastFlushTime(0), nLastFlushTrimmed(0), nHitsAtFlush(0), nMissesAtFlush(0) {}
+};
+extern CCoinsFlushStats coinsFlushStats;
+
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
@@ -247,6 +267,8 @@ bool LoadBlockIndex();
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the coins prefetch thread */
+void ThreadCoinsPrefetch();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -371,6 +393,75 @@ struct CTimestampIndexKey {
     }
 };
 
+/** Widths of the time buckets that summarize the timestamp index, in seconds */
+static const unsigned int TIMESTAMP_BUCKET_HOUR = 60 * 60;
+static const unsigned int TIMESTAMP_BUCKET_DAY = 24 * 60 * 60;
+
+struct CTimestampBucketKey {
+    unsigned int span;
+    unsigned int start;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, span);
+        ser_writedata32be(s, start);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        span = ser_readdata32be(s);
+        start = ser_readdata32be(s);
+    }
+
+    // The bucket of the given width that contains time
+    CTimestampBucketKey(unsigned int spanIn, unsigned int time) {
+        span = spanIn;
+        start = time - time % spanIn;
+    }
+
+    CTimestampBucketKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        span = 0;
+        start = 0;
+    }
+};
+
+// The blocks of the timestamp index within one time bucket, keyed by CTimestampBucketKey.
+// Kept current together with the timestamp index, so a coarse time query is a single read.
+struct CTimestampBucket {
+    int64_t count;
+    int firstHeight;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(count);
+        READWRITE(firstHeight);
+        READWRITE(lastHeight);
+    }
+
+    CTimestampBucket() {
+        SetNull();
+    }
+
+    void SetNull() {
+        count = 0;
+        firstHeight = -1;
+        lastHeight = -1;
+    }
+
+    bool IsNull() const {
+        return count == 0;
+    }
+};
+
 struct CAddressUnspentKey {
     unsigned int type;
     uint160 hashBytes;
@@ -412,6 +503,10 @@ struct CAddressUnspentKey {
         txhash.SetNull();
         index = 0;
     }
+
+    friend bool operator==(const CAddressUnspentKey& a, const CAddressUnspentKey& b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes && a.txhash == b.txhash && a.index == b.index;
+    }
 };
 
 struct CAddressUnspentValue {
@@ -510,6 +605,10 @@ struct CAddressIndexKey {
         spending = false;
     }
 
+    friend bool operator==(const CAddressIndexKey& a, const CAddressIndexKey& b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes && a.blockHeight == b.blockHeight &&
+               a.txindex == b.txindex && a.txhash == b.txhash && a.index == b.index && a.spending == b.spending;
+    }
 };
 
 struct CAddressIndexIteratorKey {
@@ -545,6 +644,40 @@ struct CAddressIndexIteratorKey {
     }
 };
 
+// Running totals of the address index deltas of one address, keyed by CAddressIndexIteratorKey.
+// Kept current together with the address index, so a balance is a single read.
+struct CAddressSummary {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;      // transactions with at least one delta
+    int64_t unspentCount; // outputs received minus outputs spent
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+        READWRITE(unspentCount);
+    }
+
+    CAddressSummary() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        unspentCount = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0 && txCount == 0 && unspentCount == 0;
+    }
+};
+
 struct CAddressIndexIteratorHeightKey {
     unsigned int type;
     uint160 hashBytes;
@@ -583,6 +716,17 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** The entries one block adds to (or, when disconnected, removes from) the optional indexes */
+struct CIndexBlockUpdate {
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<CTimestampIndexKey> timestampIndex;
+    int nHeight; // of the block, stored with its timestamp index entry
+
+    CIndexBlockUpdate() : nHeight(0) {}
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -713,19 +857,27 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
+bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes,
+                       size_t nOffset = 0, size_t nLimit = 0,
+                       const CTimestampIndexKey *pAfter = NULL, std::vector<CTimestampIndexKey> *pKeys = NULL);
+bool GetTimestampBuckets(unsigned int span, const unsigned int &high, const unsigned int &low,
+                         std::vector<std::pair<CTimestampBucketKey, CTimestampBucket> > &buckets);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0,
+                     const CAddressIndexKey *pAfter = NULL, size_t nLimit = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pAfter = NULL, size_t nLimit = 0);
+bool GetAddressSummary(uint160 addressHash, int type, CAddressSummary &summary);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
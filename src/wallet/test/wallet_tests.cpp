@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "wallet/wallet.h"
+#include "privatesend.h"
 
 #include <set>
 #include <stdint.h>
@@ -358,4 +359,37 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 101);
 }
 
+BOOST_AUTO_TEST_CASE(privatesend_rounds_depth_cap)
+{
+    CWallet walletChain;
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CAmount nDenom = 10 * COIN + 10000;
+
+    CPrivateSend::InitStandardDenominations();
+    LOCK(walletChain.cs_wallet);
+    BOOST_CHECK(walletChain.AddKeyPubKey(key, key.GetPubKey()));
+
+    // a chain of 20 denominated txs, each one spending the output of the one before
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = i == 0 ? COutPoint(GetRandHash(), 0) : COutPoint(vHashes.back(), 0);
+        tx.vout.push_back(CTxOut(nDenom, scriptPubKey));
+        CWalletTx wtx(&walletChain, tx);
+        vHashes.push_back(wtx.GetHash());
+        walletChain.mapWallet.insert(std::make_pair(wtx.GetHash(), wtx));
+    }
+
+    // the walk from the last tx hits the depth cap
+    BOOST_CHECK_EQUAL(walletChain.GetRealOutpointPrivateSendRounds(COutPoint(vHashes[19], 0), 0), 16);
+
+    // a capped result was not cached, the shorter chain is seen once the start of it is gone
+    for (int i = 0; i < 10; i++)
+        walletChain.mapWallet.erase(vHashes[i]);
+    BOOST_CHECK_EQUAL(walletChain.GetRealOutpointPrivateSendRounds(COutPoint(vHashes[19], 0), 0), 9);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
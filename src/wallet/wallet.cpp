@@ -703,7 +703,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
-    setWalletUTXO.erase(outpoint);
+    RemoveFromWalletUTXO(outpoint);
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -722,6 +722,77 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToWalletUTXO(const COutPoint& outpoint)
+{
+    setWalletUTXO.insert(outpoint);
+    if (fDenomUTXOIndexed)
+        AddToDenomIndex(outpoint);
+}
+
+void CWallet::RemoveFromWalletUTXO(const COutPoint& outpoint)
+{
+    setWalletUTXO.erase(outpoint);
+
+    std::map<COutPoint, DenomRoundsKey>::iterator it = mapDenomUTXOKeys.find(outpoint);
+    if (it == mapDenomUTXOKeys.end())
+        return;
+    std::map<DenomRoundsKey, std::set<COutPoint> >::iterator itDenom = mapDenomUTXO.find(it->second);
+    if (itDenom != mapDenomUTXO.end()) {
+        itDenom->second.erase(outpoint);
+        if (itDenom->second.empty())
+            mapDenomUTXO.erase(itDenom);
+    }
+    mapDenomUTXOKeys.erase(it);
+}
+
+void CWallet::AddToDenomIndex(const COutPoint& outpoint) const
+{
+    const CWalletTx* wtx = GetWalletTx(outpoint.hash);
+    if (wtx == NULL || outpoint.n >= wtx->vout.size())
+        return;
+
+    CAmount nValue = wtx->vout[outpoint.n].nValue;
+    if (!IsDenominatedAmount(nValue))
+        return;
+
+    DenomRoundsKey key(nValue, GetRealOutpointPrivateSendRounds(outpoint, 0));
+    mapDenomUTXO[key].insert(outpoint);
+    mapDenomUTXOKeys[outpoint] = key;
+}
+
+void CWallet::UpdateDenomIndex(const COutPoint& outpoint, int nRounds) const
+{
+    std::map<COutPoint, DenomRoundsKey>::iterator it = mapDenomUTXOKeys.find(outpoint);
+    if (it == mapDenomUTXOKeys.end() || it->second.second == nRounds)
+        return;
+
+    std::map<DenomRoundsKey, std::set<COutPoint> >::iterator itDenom = mapDenomUTXO.find(it->second);
+    if (itDenom != mapDenomUTXO.end()) {
+        itDenom->second.erase(outpoint);
+        if (itDenom->second.empty())
+            mapDenomUTXO.erase(itDenom);
+    }
+    it->second.second = nRounds;
+    mapDenomUTXO[it->second].insert(outpoint);
+}
+
+bool CWallet::EnsureDenomIndex() const
+{
+    AssertLockHeld(cs_wallet);
+    if (fDenomUTXOIndexed)
+        return true;
+    // can't tell denominated outputs apart before denominations are initialized
+    if (CPrivateSend::GetStandardDenominations().empty())
+        return false;
+
+    BOOST_FOREACH(const COutPoint& outpoint, setWalletUTXO)
+        AddToDenomIndex(outpoint);
+    WritePrivateSendRounds();
+    fDenomUTXOIndexed = true;
+    LogPrint("privatesend", "CWallet::EnsureDenomIndex -- indexed %d denominated outputs\n", mapDenomUTXOKeys.size());
+    return true;
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -960,9 +1031,19 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
             AddToSpends(hash);
             for(int i = 0; i < wtx.vout.size(); ++i) {
                 if (IsMine(wtx.vout[i]) && !IsSpent(hash, i)) {
-                    setWalletUTXO.insert(COutPoint(hash, i));
+                    AddToWalletUTXO(COutPoint(hash, i));
                 }
             }
+            // rounds are only kept on disk for unspent outputs
+            BOOST_FOREACH(const CTxIn& txin, wtx.vin) {
+                if (pwalletdb && mapOutpointRoundsCache.count(txin.prevout))
+                    pwalletdb->ErasePrivateSendRounds(txin.prevout);
+            }
+            // wallet txs spending this one were counted without it
+            RecalculatePrivateSendRounds(hash, pwalletdb);
+            // the new outputs went into the denomination index, which calculated their rounds
+            if (pwalletdb)
+                WritePrivateSendRounds(pwalletdb);
         }
 
         bool fUpdated = false;
@@ -1240,12 +1321,82 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
     return 0;
 }
 
-// Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input)
+void CWallet::SetOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const
+{
+    mapOutpointRoundsCache[outpoint] = nRounds;
+    UpdateDenomIndex(outpoint, nRounds);
+    LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", outpoint.hash.ToString(), outpoint.n, nRounds);
+}
+
+void CWallet::RecalculatePrivateSendRounds(const uint256& hash, CWalletDB* pwalletdb) const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<uint256> vTodo(1, hash);
+    std::set<uint256> setSeen;
+    std::vector<COutPoint> vForgotten;
+    for (unsigned int i = 0; i < vTodo.size(); i++) {
+        const CWalletTx* wtx = GetWalletTx(vTodo[i]);
+        if (wtx == NULL)
+            continue;
+        for (unsigned int n = 0; n < wtx->vout.size(); n++) {
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(vTodo[i], n));
+            for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+                const CWalletTx* wtxSpend = GetWalletTx(it->second);
+                if (wtxSpend == NULL || !setSeen.insert(it->second).second)
+                    continue;
+                for (unsigned int k = 0; k < wtxSpend->vout.size(); k++) {
+                    COutPoint outpoint(it->second, k);
+                    if (mapOutpointRoundsCache.erase(outpoint))
+                        vForgotten.push_back(outpoint);
+                }
+                vTodo.push_back(it->second);
+            }
+        }
+    }
+
+    // indexed outputs get their new rounds right away, and move to the matching key
+    BOOST_FOREACH(const COutPoint& outpoint, vForgotten) {
+        if (mapDenomUTXOKeys.count(outpoint))
+            GetRealOutpointPrivateSendRounds(outpoint, 0);
+        else if (pwalletdb)
+            pwalletdb->ErasePrivateSendRounds(outpoint);
+    }
+}
+
+void CWallet::WritePrivateSendRounds(CWalletDB* pwalletdb) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!fFileBacked || vPrivateSendRoundsToWrite.empty())
+        return;
+
+    if (pwalletdb) {
+        for (const auto& item : vPrivateSendRoundsToWrite)
+            pwalletdb->WritePrivateSendRounds(item.first, item.second);
+    } else {
+        CWalletDB walletdb(strWalletFile);
+        walletdb.TxnBegin();
+        for (const auto& item : vPrivateSendRoundsToWrite)
+            walletdb.WritePrivateSendRounds(item.first, item.second);
+        walletdb.TxnCommit();
+    }
+    vPrivateSendRoundsToWrite.clear();
+}
+
 int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
+    bool fFinal = true;
+    return GetRealOutpointPrivateSendRounds(outpoint, nRounds, fFinal);
+}
 
-    if(nRounds >= 16) return 15; // 16 rounds max
+// Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input).
+// fFinal is cleared if the chain was cut off at the maximum depth or the denominations are not known yet,
+// the result may then still change and is neither cached nor written to disk.
+int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds, bool& fFinal) const
+{
+    if(nRounds >= 16) { // 16 rounds max
+        fFinal = false;
+        return 15;
+    }
 
     uint256 hash = outpoint.hash;
     unsigned int nout = outpoint.n;
@@ -1253,17 +1404,12 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
     const CWalletTx* wtx = GetWalletTx(hash);
     if(wtx != NULL)
     {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        if (mdwi == mDenomWtxes.end()) {
-            // not known yet, let's add it
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        } else if(mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            // found and it's not an initial value, just return it
-            return mDenomWtxes[hash].vout[nout].nRounds;
+        std::map<COutPoint, int>::const_iterator mdwi = mapOutpointRoundsCache.find(outpoint);
+        if (mdwi != mapOutpointRoundsCache.end()) {
+            // found, only final rounds are cached
+            return mdwi->second;
         }
 
-
         // bounds check
         if (nout >= wtx->vout.size()) {
             // should never actually hit this
@@ -1271,17 +1417,22 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
             return -4;
         }
 
+        // denominations are not initialized yet, nothing reliable to cache
+        if (CPrivateSend::GetStandardDenominations().empty()) {
+            fFinal = false;
+            return -2;
+        }
+
+        // the amounts alone decide these, they are cheap to get again and not written to disk
         if (IsCollateralAmount(wtx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            SetOutpointPrivateSendRounds(outpoint, -3);
+            return -3;
         }
 
         //make sure the final output is non-denominate
         if (!IsDenominatedAmount(wtx->vout[nout].nValue)) { //NOT DENOM
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            SetOutpointPrivateSendRounds(outpoint, -2);
+            return -2;
         }
 
         bool fAllDenoms = true;
@@ -1291,17 +1442,17 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
 
         // this one is denominated but there is another non-denominated output found in the same tx
         if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+            SetOutpointPrivateSendRounds(outpoint, 0);
+            return 0;
         }
 
         int nShortest = -10; // an initial value, should be no way to get this by calculations
         bool fDenomFound = false;
+        bool fInputsFinal = true;
         // only denoms here so let's look up
         BOOST_FOREACH(CTxIn txinNext, wtx->vin) {
             if (IsMine(txinNext)) {
-                int n = GetRealOutpointPrivateSendRounds(txinNext.prevout, nRounds + 1);
+                int n = GetRealOutpointPrivateSendRounds(txinNext.prevout, nRounds + 1, fInputsFinal);
                 // denom found, find the shortest chain or initially assign nShortest with the first found value
                 if(n >= 0 && (n < nShortest || nShortest == -10)) {
                     nShortest = n;
@@ -1309,11 +1460,19 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
                 }
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
+        int nRoundsRet = fDenomFound
                 ? (nShortest >= 15 ? 16 : nShortest + 1) // good, we a +1 to the shortest one but only 16 rounds max allowed
                 : 0;            // too bad, we are the fist one in that chain
-        LogPrint("privatesend", "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        if (!fInputsFinal) {
+            fFinal = false;
+            return nRoundsRet;
+        }
+
+        // the chain walk is what is worth keeping across restarts, for outputs that can still be mixed or spent
+        SetOutpointPrivateSendRounds(outpoint, nRoundsRet);
+        if ((IsMine(wtx->vout[nout]) & ISMINE_SPENDABLE) && !IsSpent(hash, nout))
+            vPrivateSendRoundsToWrite.push_back(std::make_pair(outpoint, nRoundsRet));
+        return nRoundsRet;
     }
 
     return nRounds - 1;
@@ -1323,7 +1482,13 @@ int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRo
 int CWallet::GetOutpointPrivateSendRounds(const COutPoint& outpoint) const
 {
     LOCK(cs_wallet);
-    int realPrivateSendRounds = GetRealOutpointPrivateSendRounds(outpoint, 0);
+    int realPrivateSendRounds;
+    std::map<COutPoint, DenomRoundsKey>::const_iterator it = mapDenomUTXOKeys.find(outpoint);
+    if (it != mapDenomUTXOKeys.end())
+        realPrivateSendRounds = it->second.second;
+    else
+        realPrivateSendRounds = GetRealOutpointPrivateSendRounds(outpoint, 0);
+    WritePrivateSendRounds();
     return realPrivateSendRounds > privateSendClient.nPrivateSendRounds ? privateSendClient.nPrivateSendRounds : realPrivateSendRounds;
 }
 
@@ -2424,6 +2589,42 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed,
     }
 }
 
+void CWallet::AvailableDenominatedCoins(std::vector<COutput>& vCoins, CAmount nDenomAmount, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax) const
+{
+    vCoins.clear();
+
+    LOCK2(cs_main, cs_wallet);
+    if (!EnsureDenomIndex())
+        return;
+
+    // rounds are capped by the current settings, the cap keeps them ordered
+    std::map<DenomRoundsKey, std::set<COutPoint> >::const_iterator it = mapDenomUTXO.lower_bound(DenomRoundsKey(nDenomAmount, nPrivateSendRoundsMin));
+    for (; it != mapDenomUTXO.end() && it->first.first == nDenomAmount; ++it) {
+        int nRounds = std::min(it->first.second, privateSendClient.nPrivateSendRounds);
+        if (nRounds < nPrivateSendRoundsMin) continue;
+        if (nRounds >= nPrivateSendRoundsMax) break;
+
+        // same checks as AvailableCoins(ONLY_DENOMINATED) but for indexed outputs only
+        BOOST_FOREACH(const COutPoint& outpoint, it->second) {
+            const CWalletTx* pcoin = GetWalletTx(outpoint.hash);
+            if (pcoin == NULL) continue;
+            if (!CheckFinalTx(*pcoin)) continue;
+            if (!pcoin->IsTrusted()) continue;
+            if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0) continue;
+
+            int nDepth = pcoin->GetDepthInMainChain(false);
+            if (nDepth == 0 && !pcoin->InMempool()) continue;
+
+            isminetype mine = IsMine(pcoin->vout[outpoint.n]);
+            if (mine == ISMINE_NO || IsSpent(outpoint.hash, outpoint.n) || IsLockedCoin(outpoint.hash, outpoint.n)) continue;
+
+            vCoins.push_back(COutput(pcoin, outpoint.n, nDepth,
+                                     (mine & ISMINE_SPENDABLE) != ISMINE_NO,
+                                     (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
+        }
+    }
+}
+
 static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
                                   vector<char>& vfBest, CAmount& nBest, int iterations = 1000, bool fUseInstantSend = false)
 {
@@ -2770,11 +2971,6 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
     vCoinsRet.clear();
     nValueRet = 0;
 
-    std::vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, ONLY_DENOMINATED);
-
-    std::random_shuffle(vCoins.rbegin(), vCoins.rend(), GetRandInt);
-
     // ( bit on if present )
     // bit 0 - 100DYN+1
     // bit 1 - 10DYN+1
@@ -2788,20 +2984,26 @@ bool CWallet::SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount
 
     int nDenomResult = 0;
 
+    LOCK2(cs_main, cs_wallet);
+
+    // only look at outputs of requested denominations with matching rounds
     std::vector<CAmount> vecPrivateSendDenominations = CPrivateSend::GetStandardDenominations();
+    std::vector<COutput> vCoins;
+    BOOST_FOREACH(int nBit, vecBits) {
+        std::vector<COutput> vCoinsDenom;
+        AvailableDenominatedCoins(vCoinsDenom, vecPrivateSendDenominations[nBit], nPrivateSendRoundsMin, nPrivateSendRoundsMax);
+        vCoins.insert(vCoins.end(), vCoinsDenom.begin(), vCoinsDenom.end());
+    }
+
+    std::random_shuffle(vCoins.rbegin(), vCoins.rend(), GetRandInt);
+
     InsecureRand insecureRand;
     BOOST_FOREACH(const COutput& out, vCoins)
     {
-        // dynode-like input should not be selected by AvailableCoins now anyway
-        //if(out.tx->vout[out.i].nValue == 1000*COIN) continue;
         if(nValueRet + out.tx->vout[out.i].nValue <= nValueMax){
 
             CTxIn txin = CTxIn(out.tx->GetHash(), out.i);
 
-            int nRounds = GetOutpointPrivateSendRounds(txin.prevout);
-            if(nRounds >= nPrivateSendRoundsMax) continue;
-            if(nRounds < nPrivateSendRoundsMin) continue;
-
             BOOST_FOREACH(int nBit, vecBits) {
                 if(out.tx->vout[out.i].nValue == vecPrivateSendDenominations[nBit]) {
                     if(nValueRet >= nValueMin) {
@@ -2853,6 +3055,9 @@ bool CWallet::SelectCoinsGrouppedByAddresses(std::vector<CompactTallyItem>& vecT
         }
     }
 
+    // rounds of denominated outputs come from the index
+    if(fAnonymizable) EnsureDenomIndex();
+
     CAmount nSmallestDenom = CPrivateSend::GetSmallestDenomination();
 
     // Tally
@@ -3655,10 +3860,27 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         for (auto& pair : mapWallet) {
             for(int i = 0; i < pair.second.vout.size(); ++i) {
                 if (IsMine(pair.second.vout[i]) && !IsSpent(pair.first, i)) {
-                    setWalletUTXO.insert(COutPoint(pair.first, i));
+                    AddToWalletUTXO(COutPoint(pair.first, i));
                 }
             }
         }
+
+        // drop the rounds of outputs that were spent or removed since they were written
+        std::vector<COutPoint> vStaleRounds;
+        for (const auto& item : mapOutpointRoundsCache) {
+            if (!setWalletUTXO.count(item.first))
+                vStaleRounds.push_back(item.first);
+        }
+        if (!vStaleRounds.empty()) {
+            CWalletDB walletdb(strWalletFile);
+            walletdb.TxnBegin();
+            for (const COutPoint& outpoint : vStaleRounds) {
+                walletdb.ErasePrivateSendRounds(outpoint);
+                mapOutpointRoundsCache.erase(outpoint);
+            }
+            walletdb.TxnCommit();
+            LogPrint("privatesend", "LoadWallet: erased PrivateSend rounds of %u spent outputs\n", vStaleRounds.size());
+        }
     }
 
     if (nLoadWalletRet != DB_LOAD_OK)
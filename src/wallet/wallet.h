@@ -572,6 +572,38 @@ private:
     void AddToSpends(const uint256& wtxid);
 
     std::set<COutPoint> setWalletUTXO;
+    void AddToWalletUTXO(const COutPoint& outpoint);
+    void RemoveFromWalletUTXO(const COutPoint& outpoint);
+
+    /**
+     * Denominated outputs from setWalletUTXO indexed by (amount, PrivateSend rounds).
+     * It is built lazily on first use (standard denominations are not known yet
+     * when the wallet is loaded) and then kept in sync with setWalletUTXO,
+     * so that mixing coin selection does not have to scan the whole wallet.
+     */
+    typedef std::pair<CAmount, int> DenomRoundsKey;
+    mutable bool fDenomUTXOIndexed;
+    mutable std::map<DenomRoundsKey, std::set<COutPoint> > mapDenomUTXO;
+    mutable std::map<COutPoint, DenomRoundsKey> mapDenomUTXOKeys;
+    void AddToDenomIndex(const COutPoint& outpoint) const;
+    /** Move an indexed output to the key of its new rounds */
+    void UpdateDenomIndex(const COutPoint& outpoint, int nRounds) const;
+    bool EnsureDenomIndex() const;
+
+    /**
+     * Final PrivateSend rounds of wallet outputs, including spent ones so that rounds
+     * of their descendants can be derived without walking the whole ancestry again.
+     * Rounds of unspent outputs that took a chain walk are also kept in the wallet file.
+     */
+    mutable std::map<COutPoint, int> mapOutpointRoundsCache;
+    //! rounds calculated since the last write, they go to disk together with the next wallet update
+    mutable std::vector<std::pair<COutPoint, int> > vPrivateSendRoundsToWrite;
+    void SetOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const;
+    /** Forget the rounds of the wallet outputs that descend from a tx, it arrived after them */
+    void RecalculatePrivateSendRounds(const uint256& hash, CWalletDB* pwalletdb) const;
+    /** Write the pending rounds through pwalletdb, or without one through a CWalletDB of their own, which needs that no wallet db transaction is open */
+    void WritePrivateSendRounds(CWalletDB* pwalletdb = NULL) const;
+    int GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds, bool& fFinal) const;
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -652,6 +684,10 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        fDenomUTXOIndexed = false;
+        mapDenomUTXO.clear();
+        mapDenomUTXOKeys.clear();
+        mapOutpointRoundsCache.clear();
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -684,6 +720,11 @@ public:
      * populate vCoins with vector of available COutputs.
      */
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, bool fIncludeZeroValue=false, AvailableCoinsType nCoinType=ALL_COINS, bool fUseInstantSend = false) const;
+    /**
+     * populate vCoins with confirmed outputs of a single denomination which have
+     * from nPrivateSendRoundsMin up to (but not including) nPrivateSendRoundsMax rounds.
+     */
+    void AvailableDenominatedCoins(std::vector<COutput>& vCoins, CAmount nDenomAmount, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax) const;
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
@@ -769,6 +810,9 @@ public:
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
+    //! Adds calculated PrivateSend rounds of an output to the cache, without saving it to disk (used by LoadWallet)
+    void LoadPrivateSendRounds(const COutPoint& outpoint, int nRounds) { AssertLockHeld(cs_wallet); mapOutpointRoundsCache[outpoint] = nRounds; }
+
     bool Unlock(const SecureString& strWalletPassphrase, bool fForMixingOnly = false);
     bool ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase);
     bool EncryptWallet(const SecureString& strWalletPassphrase);